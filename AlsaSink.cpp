@@ -0,0 +1,235 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AlsaSink.h"
+#include <iostream>
+#include <algorithm>
+
+AlsaSink::AlsaSink(const std::string &deviceName)
+    : m_deviceName{deviceName}
+{
+}
+
+int AlsaSink::setHwParams(int sampleRate, snd_pcm_access_t access)
+{
+    snd_pcm_hw_params_t *params;
+    snd_pcm_hw_params_alloca(&params);
+
+    int error;
+    unsigned int rate{(unsigned int)sampleRate};
+    unsigned int bufferTime{BUFFER_TIME_US};
+    unsigned int periodTime{PERIOD_TIME_US};
+    if ((error = snd_pcm_hw_params_any(m_pcm, params)) < 0
+            || (error = snd_pcm_hw_params_set_access(m_pcm, params, access)) < 0
+            || (error = snd_pcm_hw_params_set_format(m_pcm, params, SND_PCM_FORMAT_S16_LE)) < 0
+            || (error = snd_pcm_hw_params_set_channels(m_pcm, params, m_channelCount)) < 0
+            || (error = snd_pcm_hw_params_set_rate_near(m_pcm, params, &rate, nullptr)) < 0
+            || (error = snd_pcm_hw_params_set_buffer_time_near(m_pcm, params, &bufferTime, nullptr)) < 0
+            || (error = snd_pcm_hw_params_set_period_time_near(m_pcm, params, &periodTime, nullptr)) < 0
+            || (error = snd_pcm_hw_params(m_pcm, params)) < 0)
+        return error;
+
+    // We don't resample, the track would play at the wrong speed
+    if (rate != (unsigned int)sampleRate)
+        return -EINVAL;
+    return 0;
+}
+
+int AlsaSink::open(int sampleRate, int channelCount)
+{
+    int error{snd_pcm_open(&m_pcm, m_deviceName.c_str(), SND_PCM_STREAM_PLAYBACK, 0)};
+    if (error < 0)
+    {
+        std::cerr << "Failed to open ALSA device " << m_deviceName << ": "
+            << snd_strerror(error) << '\n';
+        m_pcm = nullptr;
+        return 1;
+    }
+    m_channelCount = channelCount;
+
+    m_isMmap = true;
+    if (setHwParams(sampleRate, SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0)
+    {
+        std::cout << "ALSA device can't be mapped, writing to it" << '\n';
+        m_isMmap = false;
+        if ((error = setHwParams(sampleRate, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+        {
+            std::cerr << "Failed to configure ALSA device: " << snd_strerror(error) << '\n';
+            close();
+            return 1;
+        }
+    }
+
+    // Start playing when a period is written, not at the first sample,
+    // so it doesn't underrun right away
+    snd_pcm_uframes_t bufferSize{};
+    snd_pcm_uframes_t periodSize{};
+    snd_pcm_get_params(m_pcm, &bufferSize, &periodSize);
+    snd_pcm_sw_params_t *swParams;
+    snd_pcm_sw_params_alloca(&swParams);
+    if ((error = snd_pcm_sw_params_current(m_pcm, swParams)) < 0
+            || (error = snd_pcm_sw_params_set_start_threshold(m_pcm, swParams, periodSize)) < 0
+            || (error = snd_pcm_sw_params(m_pcm, swParams)) < 0)
+    {
+        std::cerr << "Failed to configure ALSA device: " << snd_strerror(error) << '\n';
+        close();
+        return 1;
+    }
+
+    return 0;
+}
+
+int AlsaSink::recover(int error)
+{
+    error = snd_pcm_recover(m_pcm, error, 1);
+    if (error < 0)
+        std::cerr << "Failed to recover ALSA device: " << snd_strerror(error) << '\n';
+    return error;
+}
+
+int16_t* AlsaSink::beginWrite(size_t maxCount, size_t &count)
+{
+    if (!m_pcm)
+        return nullptr;
+
+    const snd_pcm_uframes_t maxFrames{maxCount / m_channelCount};
+    if (!m_isMmap)
+    {
+        count = maxFrames * m_channelCount;
+        if (m_buffer.size() < count)
+            m_buffer.resize(count);
+        return m_buffer.data();
+    }
+
+    while (true)
+    {
+        const snd_pcm_sframes_t available{snd_pcm_avail_update(m_pcm)};
+        if (available < 0)
+        {
+            if (recover(available) < 0)
+                return nullptr;
+            continue;
+        }
+
+        if (available == 0)
+        {
+            // The buffer is full before the start threshold was reached
+            if (snd_pcm_state(m_pcm) == SND_PCM_STATE_PREPARED)
+                snd_pcm_start(m_pcm);
+
+            // Sleep until the hardware plays a period
+            const int error{snd_pcm_wait(m_pcm, 1000)};
+            if (error < 0 && recover(error) < 0)
+                return nullptr;
+            continue;
+        }
+
+        m_mmapFrames = std::min<snd_pcm_uframes_t>(maxFrames, available);
+        const snd_pcm_channel_area_t *areas;
+        const int error{snd_pcm_mmap_begin(m_pcm, &areas, &m_mmapOffset, &m_mmapFrames)};
+        if (error < 0)
+        {
+            if (recover(error) < 0)
+                return nullptr;
+            continue;
+        }
+
+        // Interleaved, every channel is in the same area
+        count = m_mmapFrames * m_channelCount;
+        return (int16_t*)((uint8_t*)areas[0].addr
+                + areas[0].first / 8 + m_mmapOffset * areas[0].step / 8);
+    }
+}
+
+int AlsaSink::commitWrite(size_t count)
+{
+    if (!m_pcm)
+        return 1;
+
+    const snd_pcm_uframes_t frames{count / m_channelCount};
+    if (!m_isMmap)
+    {
+        const int16_t *samples{m_buffer.data()};
+        snd_pcm_uframes_t remaining{frames};
+        while (remaining > 0)
+        {
+            const snd_pcm_sframes_t written{snd_pcm_writei(m_pcm, samples, remaining)};
+            if (written < 0)
+            {
+                if (recover(written) < 0)
+                    return 1;
+                continue;
+            }
+            samples += written * m_channelCount;
+            remaining -= written;
+        }
+        return 0;
+    }
+
+    const snd_pcm_sframes_t committed{snd_pcm_mmap_commit(m_pcm, m_mmapOffset, frames)};
+    if (committed < 0 || (snd_pcm_uframes_t)committed != frames)
+    {
+        recover(committed < 0 ? committed : -EPIPE);
+        return 1;
+    }
+    return 0;
+}
+
+int64_t AlsaSink::getDelayFrames()
+{
+    snd_pcm_sframes_t delay{};
+    if (!m_pcm || snd_pcm_delay(m_pcm, &delay) < 0)
+        return 0;
+    return std::max<int64_t>(0, delay);
+}
+
+void AlsaSink::drain()
+{
+    if (!m_pcm)
+        return;
+
+    snd_pcm_drain(m_pcm);
+    // A drained device is stopped, get it ready for the next samples
+    snd_pcm_prepare(m_pcm);
+}
+
+void AlsaSink::close()
+{
+    if (m_pcm)
+    {
+        snd_pcm_drain(m_pcm);
+        snd_pcm_close(m_pcm);
+    }
+    m_pcm = nullptr;
+    m_channelCount = 0;
+}
+
+AlsaSink::~AlsaSink()
+{
+    close();
+}
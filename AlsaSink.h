@@ -0,0 +1,87 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <alsa/asoundlib.h>
+#include "AudioSink.h"
+
+/*
+ * Plays the samples with ALSA directly.
+ *
+ * With mmap access `beginWrite()` returns the free part of the ring buffer
+ * of the device, so the samples are put right where the hardware reads
+ * them. If the device can't be mapped (some plugins), the samples are
+ * written with `snd_pcm_writei()` from a buffer.
+ */
+class AlsaSink final : public AudioSink
+{
+public:
+    // Length of the device buffer, the latency
+    static constexpr unsigned int BUFFER_TIME_US{200'000};
+    static constexpr unsigned int PERIOD_TIME_US{50'000};
+
+private:
+    std::string m_deviceName;
+    snd_pcm_t *m_pcm{};
+    int m_channelCount{};
+    bool m_isMmap{};
+
+    // The area returned by the last `beginWrite()` in mmap mode
+    snd_pcm_uframes_t m_mmapOffset{};
+    snd_pcm_uframes_t m_mmapFrames{};
+    // Used instead of the device buffer if mmap is not supported
+    std::vector<int16_t> m_buffer;
+
+    /*
+     * Set the access, format, rate and buffer size.
+     * Returns 0 if succeeded, an ALSA error code otherwise.
+     */
+    int setHwParams(int sampleRate, snd_pcm_access_t access);
+    /*
+     * Bring the device back to work after an underrun or a suspend.
+     * Returns 0 if succeeded, an ALSA error code otherwise.
+     */
+    int recover(int error);
+
+public:
+    AlsaSink(const std::string &deviceName);
+
+    int open(int sampleRate, int channelCount) override;
+    int16_t* beginWrite(size_t maxCount, size_t &count) override;
+    int commitWrite(size_t count) override;
+    int64_t getDelayFrames() override;
+    void drain() override;
+    void close() override;
+    inline const char* getName() const override { return m_isMmap ? "ALSA mmap" : "ALSA"; }
+
+    ~AlsaSink();
+};
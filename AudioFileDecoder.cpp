@@ -0,0 +1,204 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AudioFileDecoder.h"
+#include "Music.h"
+#include <iostream>
+#include <vector>
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+}
+
+int AudioFileDecoder::open(const std::string &path)
+{
+    close();
+
+    m_formatContext = avformat_alloc_context();
+    if (!m_formatContext)
+        return 1;
+    if (m_mappedInput.open(path) == 0)
+        m_mappedInput.attach(m_formatContext);
+
+    // Frees the format context on failure
+    if (avformat_open_input(&m_formatContext, path.c_str(), nullptr, nullptr))
+    {
+        close();
+        return 1;
+    }
+
+    if (avformat_find_stream_info(m_formatContext, nullptr) < 0)
+    {
+        close();
+        return 1;
+    }
+
+    m_audioStreamI = av_find_best_stream(
+            m_formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (m_audioStreamI < 0)
+    {
+        close();
+        return 1;
+    }
+    const AVCodecParameters *codecParams{m_formatContext->streams[m_audioStreamI]->codecpar};
+
+    const AVCodec *codec{avcodec_find_decoder(codecParams->codec_id)};
+    if (!codec)
+    {
+        close();
+        return 1;
+    }
+    m_codecContext = avcodec_alloc_context3(codec);
+    if (!m_codecContext || avcodec_parameters_to_context(m_codecContext, codecParams) < 0)
+    {
+        close();
+        return 1;
+    }
+    // The jobs run side by side, more threads would only compete with them
+    m_codecContext->thread_count = 1;
+    if (avcodec_open2(m_codecContext, codec, nullptr))
+    {
+        close();
+        return 1;
+    }
+
+    m_sampleRate = m_codecContext->sample_rate;
+    m_channelCount = m_codecContext->channels;
+    if (m_sampleRate <= 0 || m_channelCount <= 0)
+    {
+        close();
+        return 1;
+    }
+    m_channelLayout = m_codecContext->channel_layout
+        ? m_codecContext->channel_layout
+        : (uint64_t)av_get_default_channel_layout(m_channelCount);
+
+    // Only the sample format is converted
+    m_resampleContext = swr_alloc_set_opts(
+            nullptr,
+            (int64_t)m_channelLayout,                   // Out channel layout
+            AV_SAMPLE_FMT_FLT,                          // Out sample format
+            m_sampleRate,                               // Out sample rate
+            (int64_t)m_channelLayout,                   // In channel layout
+            (AVSampleFormat)m_codecContext->sample_fmt, // In format
+            m_sampleRate,                               // In sample rate
+            0,
+            nullptr);
+    if (!m_resampleContext || swr_init(m_resampleContext))
+    {
+        close();
+        return 1;
+    }
+
+    return 0;
+}
+
+int AudioFileDecoder::decode(const SamplesCallback &callback, const std::atomic<bool> *isCancelled)
+{
+    if (!m_resampleContext)
+        return 1;
+
+    AVPacket *packet{av_packet_alloc()};
+    AVFrame *frame{av_frame_alloc()};
+    std::vector<float> samples;
+    int result{packet && frame ? 0 : 1};
+    bool isDraining{};
+    while (!result)
+    {
+        if (isCancelled && *isCancelled)
+        {
+            result = 1;
+            break;
+        }
+
+        if (!isDraining)
+        {
+            if (av_read_frame(m_formatContext, packet) < 0)
+            {
+                // Flush the decoder
+                isDraining = true;
+                avcodec_send_packet(m_codecContext, nullptr);
+            }
+            else
+            {
+                const bool isOurStream{packet->stream_index == m_audioStreamI};
+                // Skip broken packets like the player does
+                if (isOurStream && avcodec_send_packet(m_codecContext, packet) < 0)
+                    std::cerr << "Skipping broken packet" << '\n';
+                av_packet_unref(packet);
+                if (!isOurStream)
+                    continue;
+            }
+        }
+
+        int receiveResult;
+        while ((receiveResult = avcodec_receive_frame(m_codecContext, frame)) == 0)
+        {
+            samples.resize((size_t)frame->nb_samples*m_channelCount);
+            uint8_t *samplesPtr{(uint8_t*)samples.data()};
+            const int converted{swr_convert(
+                    m_resampleContext, &samplesPtr, frame->nb_samples,
+                    (const uint8_t**)frame->extended_data, frame->nb_samples)};
+            if (converted > 0)
+                callback(samples.data(), (size_t)converted);
+            av_frame_unref(frame);
+        }
+        if (receiveResult == AVERROR_EOF)
+            break;
+        if (receiveResult != AVERROR(EAGAIN))
+            result = 1;
+    }
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    return result;
+}
+
+TrackMetadata AudioFileDecoder::readMetadata() const
+{
+    if (!m_formatContext || m_audioStreamI < 0)
+        return {};
+    return Music::readMetadata(m_formatContext, m_audioStreamI);
+}
+
+void AudioFileDecoder::close()
+{
+    swr_free(&m_resampleContext);
+    avcodec_free_context(&m_codecContext);
+    if (m_formatContext)
+        avformat_close_input(&m_formatContext);
+    m_mappedInput.close();
+    m_audioStreamI = -1;
+    m_sampleRate = 0;
+    m_channelCount = 0;
+    m_channelLayout = 0;
+}
+
+AudioFileDecoder::~AudioFileDecoder()
+{
+    close();
+}
@@ -0,0 +1,108 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "LibraryIndex.h"
+#include "MappedInput.h"
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+}
+
+/*
+ * Decodes the audio stream of a file to interleaved float samples, at the
+ * sample rate and with the channels of the file.
+ *
+ * For the background jobs that analyze whole files (loudness, waveform),
+ * the player itself decodes with `Music`.
+ */
+class AudioFileDecoder final
+{
+public:
+    /*
+     * Receives the next decoded frames.
+     */
+    using SamplesCallback = std::function<void(const float *samples, size_t frames)>;
+
+private:
+    AVFormatContext *m_formatContext{};
+    MappedInput m_mappedInput;
+    AVCodecContext *m_codecContext{};
+    SwrContext *m_resampleContext{};
+    int m_audioStreamI{-1};
+
+    int m_sampleRate{};
+    int m_channelCount{};
+    uint64_t m_channelLayout{};
+
+public:
+    AudioFileDecoder() {}
+    AudioFileDecoder(const AudioFileDecoder&) = delete;
+    AudioFileDecoder(AudioFileDecoder&&) = delete;
+    AudioFileDecoder& operator=(const AudioFileDecoder&) = delete;
+    AudioFileDecoder& operator=(AudioFileDecoder&&) = delete;
+
+    /*
+     * Open the file and its decoder. Closes the previously opened file.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int open(const std::string &path);
+
+    /*
+     * Decode the whole file and pass the samples to `callback`.
+     * Stops early if `isCancelled` becomes true.
+     *
+     * Returns 0 if the file was decoded to the end, nonzero otherwise.
+     */
+    int decode(const SamplesCallback &callback, const std::atomic<bool> *isCancelled=nullptr);
+
+    void close();
+
+    inline int getSampleRate() const { return m_sampleRate; }
+    inline int getChannelCount() const { return m_channelCount; }
+    /*
+     * Return the libav channel layout (`AV_CH_*` flags).
+     */
+    inline uint64_t getChannelLayout() const { return m_channelLayout; }
+
+    /*
+     * Return the metadata of the opened file, see `Music::readMetadata()`.
+     */
+    TrackMetadata readMetadata() const;
+
+    ~AudioFileDecoder();
+};
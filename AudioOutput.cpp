@@ -0,0 +1,146 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AudioOutput.h"
+#include "StageTiming.h"
+#include <algorithm>
+#include <iostream>
+
+AudioOutput::AudioOutput(std::unique_ptr<AudioSink> sink)
+    : m_sink{std::move(sink)}
+{
+}
+
+void AudioOutput::closeSink()
+{
+    if (m_isSinkOpen)
+        m_sink->close();
+
+    m_isSinkOpen   = false;
+    m_sampleRate   = 0;
+    m_channelCount = 0;
+}
+
+int AudioOutput::configure(int sampleRate, int channelCount)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (m_isSinkOpen
+            && m_sampleRate == sampleRate && m_channelCount == channelCount)
+        return 0;
+
+    closeSink();
+
+    std::cout << "Opening " << m_sink->getName() << " output with " << sampleRate << " Hz, "
+        << channelCount << " channels" << '\n';
+    if (m_sink->open(sampleRate, channelCount))
+        return 1;
+
+    m_isSinkOpen   = true;
+    m_sampleRate   = sampleRate;
+    m_channelCount = channelCount;
+    return 0;
+}
+
+int AudioOutput::write(const int16_t *samples, size_t count)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (!m_isSinkOpen)
+        return 1;
+
+    TIME_STAGE(StageTiming::STAGE_SINK_WRITE);
+    if (m_sink->write(samples, count))
+    {
+        std::cerr << "Failed to write samples to output" << '\n';
+        return 1;
+    }
+    if (m_pcmTap)
+        m_pcmTap->write(samples, count / m_channelCount, m_channelCount, m_sampleRate);
+    return 0;
+}
+
+int AudioOutput::writeFrom(RingBuffer<int16_t> &buffer, size_t maxCount, size_t &takenCount)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    takenCount = 0;
+    // Being reconfigured, the caller waits for the new format
+    if (!m_isSinkOpen)
+        return 0;
+
+    const size_t available{buffer.getReadAvailable()};
+    const size_t count{std::min(maxCount, available) / m_channelCount * m_channelCount};
+    if (count == 0)
+        return 0;
+
+    TIME_STAGE(StageTiming::STAGE_SINK_WRITE);
+    size_t sinkBufferSize{};
+    int16_t *sinkBuffer{m_sink->beginWrite(count, sinkBufferSize)};
+    if (!sinkBuffer)
+    {
+        std::cerr << "Failed to write samples to output" << '\n';
+        return 1;
+    }
+
+    // The sink buffer may be smaller (the end of the device ring buffer)
+    takenCount = buffer.read(sinkBuffer, std::min(count, sinkBufferSize));
+    if (m_pcmTap)
+        m_pcmTap->write(sinkBuffer, takenCount / m_channelCount, m_channelCount, m_sampleRate);
+    if (m_sink->commitWrite(takenCount))
+    {
+        std::cerr << "Failed to write samples to output" << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int64_t AudioOutput::getDelayFrames()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_isSinkOpen ? m_sink->getDelayFrames() : 0;
+}
+
+void AudioOutput::flush()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (m_isSinkOpen)
+        m_sink->drain();
+}
+
+void AudioOutput::close()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    closeSink();
+}
+
+AudioOutput::~AudioOutput()
+{
+    close();
+}
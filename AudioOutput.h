@@ -0,0 +1,145 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "AudioSink.h"
+#include "RingBuffer.h"
+#include "PcmTap.h"
+
+/*
+ * An output session that outlives the tracks.
+ *
+ * The sink is opened when the first track configures it and is only
+ * reopened when a track needs a different sample rate or channel count.
+ * The samples are always interleaved signed 16-bit.
+ *
+ * `write()` may be called from another thread than `configure()`.
+ */
+class AudioOutput final
+{
+private:
+    // Guards the sink, so it can be written from another thread
+    std::mutex        m_mutex;
+    std::unique_ptr<AudioSink> m_sink;
+    bool              m_isSinkOpen{};
+    // Gets a copy of the written samples, can be nullptr
+    PcmTap           *m_pcmTap{};
+
+    // Readable from any thread
+    std::atomic<int>  m_sampleRate{};
+    std::atomic<int>  m_channelCount{};
+
+    /*
+     * Close the sink.
+     * `m_mutex` must be held.
+     */
+    void closeSink();
+
+public:
+    AudioOutput(std::unique_ptr<AudioSink> sink);
+    AudioOutput(const AudioOutput&) = delete;
+    AudioOutput(AudioOutput&&) = delete;
+    AudioOutput& operator=(const AudioOutput&) = delete;
+    AudioOutput& operator=(AudioOutput&&) = delete;
+
+    /*
+     * Make sure the sink is open with the passed parameters.
+     * Does nothing if it already is, reopens it otherwise.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int configure(int sampleRate, int channelCount);
+
+    /*
+     * Return whether the sink is open with the passed parameters,
+     * so `configure()` wouldn't reopen it.
+     */
+    inline bool isConfiguredFor(int sampleRate, int channelCount) const
+    {
+        return m_sampleRate == sampleRate && m_channelCount == channelCount;
+    }
+
+    /*
+     * Write interleaved samples to the sink.
+     * `count` is the number of samples, not frames.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int write(const int16_t *samples, size_t count);
+
+    /*
+     * Move at most `maxCount` samples (whole frames) from `buffer` right
+     * into the buffer of the sink. Called by the reader of `buffer`.
+     * `takenCount` is set to the number of samples taken out of `buffer`,
+     * they are gone even if the sink failed to play them.
+     * Nothing is taken while the sink is closed, that is not an error.
+     *
+     * Returns 0 if succeeded, nonzero if the sink failed.
+     */
+    int writeFrom(RingBuffer<int16_t> &buffer, size_t maxCount, size_t &takenCount);
+
+    /*
+     * Set the tap that gets a copy of the samples written to the sink,
+     * nullptr to remove it. When this returns, the old tap is not used anymore.
+     */
+    inline void setPcmTap(PcmTap *tap)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_pcmTap = tap;
+    }
+
+    /*
+     * Return the number of sample frames written to the sink
+     * that are not played yet. Returns 0 if the sink can't tell.
+     */
+    int64_t getDelayFrames();
+
+    /*
+     * Make the sink play everything written to it.
+     */
+    void flush();
+
+    /*
+     * Close the sink. The next `configure()` opens it again.
+     */
+    void close();
+
+    inline bool isOpen() const { return m_channelCount != 0; }
+    inline int getSampleRate() const { return m_sampleRate; }
+    /*
+     * Return the channel count of the sink or 0 if it's not open.
+     */
+    inline int getChannelCount() const { return m_channelCount; }
+
+    ~AudioOutput();
+};
@@ -0,0 +1,97 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AudioSink.h"
+#include "LibavSink.h"
+#include "FileSink.h"
+#include "NullSink.h"
+#ifdef LIGHTMUSIC_HAVE_ALSA
+#include "AlsaSink.h"
+#endif
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+std::unique_ptr<AudioSink> AudioSink::create(const std::string &description)
+{
+    // "TYPE:ARGUMENT" or "TYPE"
+    const size_t colonI{description.find(':')};
+    const std::string type{description.substr(0, colonI)};
+    const std::string argument{colonI == std::string::npos ? "" : description.substr(colonI + 1)};
+
+    if (type == "alsa")
+    {
+#ifdef LIGHTMUSIC_HAVE_ALSA
+        return std::make_unique<AlsaSink>(argument.empty() ? "default" : argument);
+#else
+        std::cout << "Built without ALSA, using the libavdevice ALSA output" << '\n';
+        return std::make_unique<LibavSink>("alsa");
+#endif
+    }
+    else if (type == "libav" && !argument.empty())
+    {
+        return std::make_unique<LibavSink>(argument);
+    }
+    else if ((type == "wav" || type == "raw") && !argument.empty())
+    {
+        return std::make_unique<FileSink>(argument,
+                type == "wav" ? FileSink::FILEFORMAT_WAV : FileSink::FILEFORMAT_RAW);
+    }
+    else if (type == "null")
+    {
+        char *end{};
+        const double speed{argument.empty() ? 0.0 : std::strtod(argument.c_str(), &end)};
+        if (!argument.empty() && (*end || speed < 0))
+        {
+            std::cerr << "Invalid null output speed: " << argument << '\n';
+            return nullptr;
+        }
+        return std::make_unique<NullSink>(speed);
+    }
+
+    std::cerr << "Invalid output: " << description << '\n';
+    return nullptr;
+}
+
+int AudioSink::write(const int16_t *samples, size_t count)
+{
+    while (count > 0)
+    {
+        size_t bufferSize{};
+        int16_t *buffer{beginWrite(count, bufferSize)};
+        if (!buffer || bufferSize == 0)
+            return 1;
+
+        std::memcpy(buffer, samples, bufferSize * sizeof(int16_t));
+        if (commitWrite(bufferSize))
+            return 1;
+        samples += bufferSize;
+        count -= bufferSize;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Where the played samples go: a sound card, a file or nowhere.
+ * The samples are always interleaved signed 16-bit.
+ *
+ * Writing is done in two steps, so the samples can be put right where the
+ * backend needs them: `beginWrite()` gives a buffer (the ring buffer of the
+ * device for the direct ALSA backend), `commitWrite()` hands it over.
+ *
+ * A sink is used by one thread at a time, `AudioOutput` serializes the calls.
+ */
+class AudioSink
+{
+public:
+    AudioSink() {}
+    AudioSink(const AudioSink&) = delete;
+    AudioSink(AudioSink&&) = delete;
+    AudioSink& operator=(const AudioSink&) = delete;
+    AudioSink& operator=(AudioSink&&) = delete;
+
+    /*
+     * Create a sink from a description:
+     *  - "alsa[:DEVICE]": the ALSA device, "default" if not set
+     *  - "libav:FORMAT": a libavdevice output format, like "libav:pulse"
+     *  - "wav:PATH" or "raw:PATH": write the samples to a file
+     *  - "null[:SPEED]": throw the samples away, at SPEED times the real
+     *    time, or as fast as possible if SPEED is 0 or not set
+     *
+     * Returns nullptr if the description is invalid.
+     */
+    static std::unique_ptr<AudioSink> create(const std::string &description);
+
+    /*
+     * Open the backend with the passed parameters.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    virtual int open(int sampleRate, int channelCount) = 0;
+
+    /*
+     * Return a buffer where at most `maxCount` samples can be put and set
+     * `count` to the number of samples it can take (whole frames).
+     * May wait until the backend can take more samples.
+     *
+     * Returns nullptr if failed.
+     */
+    virtual int16_t* beginWrite(size_t maxCount, size_t &count) = 0;
+
+    /*
+     * Hand over the first `count` samples of the buffer returned by the
+     * last `beginWrite()`.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    virtual int commitWrite(size_t count) = 0;
+
+    /*
+     * Write interleaved samples, `count` is the number of samples.
+     * Uses `beginWrite()` and `commitWrite()`.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int write(const int16_t *samples, size_t count);
+
+    /*
+     * Return the number of sample frames written, but not played yet.
+     */
+    virtual int64_t getDelayFrames() { return 0; }
+
+    /*
+     * Wait until everything written is played.
+     */
+    virtual void drain() {}
+
+    /*
+     * Close the backend. It may be opened again.
+     */
+    virtual void close() = 0;
+
+    /*
+     * Return the name of the backend, for the log.
+     */
+    virtual const char* getName() const = 0;
+
+    virtual ~AudioSink() {}
+};
@@ -0,0 +1,138 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "BufferPool.h"
+#include <iostream>
+
+int BufferPool::getSizeClass(size_t size)
+{
+    int sizeClass{};
+    size_t classSize{MIN_BLOCK_SIZE};
+    while (classSize < size)
+    {
+        classSize <<= 1;
+        ++sizeClass;
+    }
+    return sizeClass < SIZE_CLASS_COUNT ? sizeClass : -1;
+}
+
+AVFrame *BufferPool::acquireFrame()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_freeFrames.empty())
+        {
+            AVFrame *frame{m_freeFrames.back()};
+            m_freeFrames.pop_back();
+            return frame;
+        }
+    }
+
+    ++m_allocationCount;
+    return av_frame_alloc();
+}
+
+void BufferPool::releaseFrame(AVFrame *frame)
+{
+    if (!frame)
+        return;
+
+    av_frame_unref(frame);
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_freeFrames.push_back(frame);
+}
+
+AVPacket *BufferPool::acquirePacket()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_freePackets.empty())
+        {
+            AVPacket *packet{m_freePackets.back()};
+            m_freePackets.pop_back();
+            return packet;
+        }
+    }
+
+    ++m_allocationCount;
+    return av_packet_alloc();
+}
+
+void BufferPool::releasePacket(AVPacket *packet)
+{
+    if (!packet)
+        return;
+
+    av_packet_unref(packet);
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_freePackets.push_back(packet);
+}
+
+AVBufferRef *BufferPool::s_allocateBlock(void *opaque, int size)
+{
+    // Only called when the size class has no free block
+    ++((BufferPool*)opaque)->m_allocationCount;
+    return av_buffer_alloc(size);
+}
+
+AVBufferRef *BufferPool::acquireBlock(size_t size)
+{
+    const int sizeClass{getSizeClass(size)};
+    if (sizeClass < 0)
+    {
+        std::cerr << "Buffer pool: block of " << size << " bytes is too large" << '\n';
+        return nullptr;
+    }
+
+    AVBufferPool *blockPool;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_blockPools[sizeClass])
+        {
+            m_blockPools[sizeClass] = av_buffer_pool_init2(
+                    MIN_BLOCK_SIZE << sizeClass, this, &s_allocateBlock, nullptr);
+            if (!m_blockPools[sizeClass])
+                return nullptr;
+        }
+        blockPool = m_blockPools[sizeClass];
+    }
+
+    // Gives the memory back to the size class when the last reference is gone
+    return av_buffer_pool_get(blockPool);
+}
+
+BufferPool::~BufferPool()
+{
+    for (AVFrame *frame : m_freeFrames)
+        av_frame_free(&frame);
+    for (AVPacket *packet : m_freePackets)
+        av_packet_free(&packet);
+    // A pool is only freed after its last block is given back
+    for (AVBufferPool *&blockPool : m_blockPools)
+        av_buffer_pool_uninit(&blockPool);
+}
@@ -0,0 +1,127 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+/*
+ * Recycles the frames, packets and sample buffers of the playback loop.
+ *
+ * Sample buffers are handed out as `AVBufferRef`s from an `AVBufferPool`
+ * per size class (powers of 2). Only `LibavSink` uses them: the decoded
+ * samples go to the PCM ring buffer, the other sinks write straight
+ * from it.
+ *
+ * The pool only removes the allocations of the frame and packet structs
+ * and of the sample memory. libav still allocates in the steady state:
+ * the demuxer allocates the payload of every packet read, and every
+ * buffer taken from an `AVBufferPool` (the frames of the decoder and the
+ * blocks of this pool) gets a newly allocated `AVBufferRef`.
+ * `lightmusic-bench` measures both.
+ *
+ * Every function is thread safe.
+ */
+class BufferPool final
+{
+public:
+    // Size of the smallest size class in bytes
+    static constexpr size_t MIN_BLOCK_SIZE{4096};
+    // Number of size classes, the largest is `MIN_BLOCK_SIZE << (SIZE_CLASS_COUNT-1)`
+    static constexpr int SIZE_CLASS_COUNT{11};
+
+private:
+    std::mutex m_mutex;
+    std::vector<AVFrame*> m_freeFrames;
+    std::vector<AVPacket*> m_freePackets;
+    // Created when the first block of the class is acquired
+    AVBufferPool *m_blockPools[SIZE_CLASS_COUNT]{};
+
+    // Number of frames, packets and blocks allocated by the pool since its creation
+    std::atomic<size_t> m_allocationCount{};
+
+    static AVBufferRef *s_allocateBlock(void *opaque, int size);
+    static int getSizeClass(size_t size);
+
+public:
+    BufferPool() {}
+    BufferPool(const BufferPool&) = delete;
+    BufferPool(BufferPool&&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    BufferPool& operator=(BufferPool&&) = delete;
+
+    /*
+     * Return an unused, empty frame.
+     * Give it back with `releaseFrame()`.
+     */
+    AVFrame *acquireFrame();
+    /*
+     * Unreference the frame data and put the frame back to the pool.
+     */
+    void releaseFrame(AVFrame *frame);
+
+    /*
+     * Return an unused, empty packet.
+     * Give it back with `releasePacket()`.
+     */
+    AVPacket *acquirePacket();
+    /*
+     * Unreference the packet data and put the packet back to the pool.
+     */
+    void releasePacket(AVPacket *packet);
+
+    /*
+     * Return a reference to a buffer of at least `size` bytes.
+     * The memory returns to the pool when the last reference is unreferenced.
+     *
+     * Returns nullptr if `size` is too large or the allocation failed.
+     */
+    AVBufferRef *acquireBlock(size_t size);
+
+    /*
+     * Return the number of frames, packets and blocks allocated since the
+     * creation of the pool. Once the pool has warmed up, it doesn't grow.
+     */
+    inline size_t getAllocationCount() const { return m_allocationCount; }
+
+    /*
+     * Free everything. Blocks still referenced are freed when
+     * their last reference is unreferenced.
+     */
+    ~BufferPool();
+};
@@ -0,0 +1,642 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ControlServer.h"
+#include <iostream>
+#include <sstream>
+#include <future>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// A client sending a longer line is disconnected
+#define MAX_LINE_LENGTH (64 * 1024)
+
+namespace
+{
+
+// Write end of the wake pipe of the running server, for the signal handler
+volatile sig_atomic_t s_signalWakeFd{-1};
+
+void s_signalHandler(int)
+{
+    const int savedErrno{errno};
+    const char byte{};
+    if (s_signalWakeFd != -1)
+        (void)!write(s_signalWakeFd, &byte, 1);
+    errno = savedErrno;
+}
+
+/*
+ * Send the whole string.
+ * Returns 0 if succeeded, nonzero otherwise.
+ */
+int sendAll(int fd, const std::string &data)
+{
+    size_t sent{};
+    while (sent < data.size())
+    {
+        // Don't get killed by SIGPIPE if the client is gone
+        const ssize_t result{send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL)};
+        if (result < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        sent += result;
+    }
+    return 0;
+}
+
+/*
+ * Parse a whole string as a track index.
+ * Returns false if it is not a number.
+ */
+bool parseIndex(const std::string &str, size_t &output)
+{
+    if (str.empty() || str[0] == '-')
+        return false;
+    char *end{};
+    errno = 0;
+    const unsigned long long value{std::strtoull(str.c_str(), &end, 10)};
+    if (errno || *end)
+        return false;
+    output = value;
+    return true;
+}
+
+/*
+ * Parse a whole string as a non-negative number of seconds.
+ * Returns false if it is not a number.
+ */
+bool parseSeconds(const std::string &str, double &output)
+{
+    if (str.empty())
+        return false;
+    char *end{};
+    errno = 0;
+    const double value{std::strtod(str.c_str(), &end)};
+    if (errno || *end || !(value >= 0))
+        return false;
+    output = value;
+    return true;
+}
+
+const char* stateToString(Music::State state)
+{
+    switch (state)
+    {
+    case Music::STATE_UNINITIALIZED: return "stopped";
+    case Music::STATE_PAUSED:        return "paused";
+    case Music::STATE_PLAYING:       return "playing";
+    case Music::STATE_END:           return "ended";
+    case Music::STATE_ERROR:         return "error";
+    }
+    return "unknown";
+}
+
+} // namespace
+
+ControlServer::ControlServer(PlaybackEngine *engine, const std::string &socketPath)
+    : m_engine{engine}, m_socketPath{socketPath}
+{
+}
+
+std::string ControlServer::getDefaultSocketPath()
+{
+    if (const char *runtimeDir{std::getenv("XDG_RUNTIME_DIR")}; runtimeDir && *runtimeDir)
+        return std::string{runtimeDir} + "/lightmusic.sock";
+    return "/tmp/lightmusic-" + std::to_string(getuid()) + ".sock";
+}
+
+int ControlServer::start()
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (m_socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path is too long: " << m_socketPath << '\n';
+        return 1;
+    }
+    std::strcpy(address.sun_path, m_socketPath.c_str());
+
+    // A socket file left by a crash is removed, but nothing else is:
+    // not a file that isn't a socket and not a socket someone listens on
+    struct stat pathStat;
+    if (lstat(m_socketPath.c_str(), &pathStat) == 0)
+    {
+        if (!S_ISSOCK(pathStat.st_mode))
+        {
+            std::cerr << "Not a socket, refusing to replace it: " << m_socketPath << '\n';
+            return 1;
+        }
+
+        const int probeFd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+        if (probeFd == -1)
+        {
+            std::cerr << "Failed to create socket: " << std::strerror(errno) << '\n';
+            return 1;
+        }
+        const int connectResult{connect(probeFd, (const sockaddr*)&address, sizeof(address))};
+        const int connectErrno{errno};
+        close(probeFd);
+        if (connectResult == 0)
+        {
+            std::cerr << "Another instance is already listening on " << m_socketPath << '\n';
+            return 1;
+        }
+        if (connectErrno != ECONNREFUSED)
+        {
+            std::cerr << "Failed to check socket " << m_socketPath << ": "
+                << std::strerror(connectErrno) << '\n';
+            return 1;
+        }
+        if (unlink(m_socketPath.c_str()) != 0 && errno != ENOENT)
+        {
+            std::cerr << "Failed to remove stale socket " << m_socketPath << ": "
+                << std::strerror(errno) << '\n';
+            return 1;
+        }
+    }
+    else if (errno != ENOENT)
+    {
+        std::cerr << "Failed to check socket " << m_socketPath << ": " << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listenFd == -1)
+    {
+        std::cerr << "Failed to create socket: " << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    // Only the user may control the player
+    const mode_t oldUmask{umask(0077)};
+    const int bindResult{bind(m_listenFd, (const sockaddr*)&address, sizeof(address))};
+    umask(oldUmask);
+    if (bindResult != 0 || listen(m_listenFd, 8) != 0)
+    {
+        std::cerr << "Failed to listen on " << m_socketPath << ": " << std::strerror(errno) << '\n';
+        close(m_listenFd);
+        // Only remove the file if this instance created it
+        if (bindResult == 0)
+            unlink(m_socketPath.c_str());
+        m_listenFd = -1;
+        return 1;
+    }
+
+    if (pipe2(m_wakePipe, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        std::cerr << "Failed to create pipe: " << std::strerror(errno) << '\n';
+        m_wakePipe[0] = m_wakePipe[1] = -1;
+        return 1;
+    }
+    s_signalWakeFd = m_wakePipe[1];
+    struct sigaction action{};
+    action.sa_handler = s_signalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::cout << "Listening on " << m_socketPath << '\n';
+    return 0;
+}
+
+void ControlServer::stop()
+{
+    const char byte{};
+    if (m_wakePipe[1] != -1)
+        (void)!write(m_wakePipe[1], &byte, 1);
+}
+
+void ControlServer::run()
+{
+    if (m_listenFd == -1)
+        return;
+
+    std::vector<pollfd> pollFds;
+    while (!m_isShutdownRequested)
+    {
+        pollFds.clear();
+        pollFds.push_back({m_wakePipe[0], POLLIN, 0});
+        pollFds.push_back({m_listenFd, POLLIN, 0});
+        for (const Client &client : m_clients)
+            pollFds.push_back({client.fd, POLLIN, 0});
+
+        if (poll(pollFds.data(), pollFds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "poll() failed: " << std::strerror(errno) << '\n';
+            break;
+        }
+
+        if (pollFds[0].revents)
+        {
+            std::cout << "Stopping" << '\n';
+            break;
+        }
+
+        // Serve the clients first, `acceptClient()` changes `m_clients`
+        for (size_t i{}, clientI{}; i < pollFds.size() - 2; ++i)
+        {
+            if (pollFds[i + 2].revents && !serveClient(m_clients[clientI]))
+            {
+                close(m_clients[clientI].fd);
+                m_clients.erase(m_clients.begin() + clientI);
+                continue;
+            }
+            ++clientI;
+        }
+
+        if (pollFds[1].revents & POLLIN)
+            acceptClient();
+    }
+    closeClients();
+}
+
+void ControlServer::acceptClient()
+{
+    const int fd{accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC)};
+    if (fd == -1)
+    {
+        std::cerr << "Failed to accept connection: " << std::strerror(errno) << '\n';
+        return;
+    }
+    Client client;
+    client.fd = fd;
+    m_clients.push_back(std::move(client));
+}
+
+bool ControlServer::serveClient(Client &client)
+{
+    char buffer[4096];
+    const ssize_t received{recv(client.fd, buffer, sizeof(buffer), 0)};
+    if (received < 0)
+        return errno == EINTR || errno == EAGAIN;
+    if (received == 0)
+        return false;
+    client.input.append(buffer, received);
+
+    size_t lineStart{};
+    for (size_t newlineI; (newlineI = client.input.find('\n', lineStart)) != std::string::npos;)
+    {
+        std::string line{client.input, lineStart, newlineI - lineStart};
+        lineStart = newlineI + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        const std::string reply{handleLine(client, line)};
+        if (!reply.empty() && sendAll(client.fd, reply) != 0)
+            return false;
+        if (m_isShutdownRequested)
+            break;
+    }
+    client.input.erase(0, lineStart);
+
+    if (client.input.size() > MAX_LINE_LENGTH)
+    {
+        sendAll(client.fd, "ERR line too long\n");
+        return false;
+    }
+    return true;
+}
+
+std::string ControlServer::handleLine(Client &client, const std::string &line)
+{
+    const size_t firstCharI{line.find_first_not_of(" \t")};
+    // Ignore empty lines
+    if (firstCharI == std::string::npos)
+        return "";
+    const std::string trimmed{line.substr(firstCharI)};
+
+    if (trimmed == "begin")
+    {
+        if (client.isInBatch)
+            return "ERR already in a batch\n";
+        client.isInBatch = true;
+        return "OK\n";
+    }
+    if (trimmed == "end")
+    {
+        if (!client.isInBatch)
+            return "ERR not in a batch\n";
+        client.isInBatch = false;
+        std::string replies;
+        for (const std::string &reply : runCommands(client.batch))
+            replies += reply + '\n';
+        client.batch.clear();
+        return replies + "OK\n";
+    }
+    if (trimmed == "shutdown")
+    {
+        if (client.isInBatch)
+        {
+            client.batch.push_back({"ERR shutdown is not allowed in a batch", {}, false, {}});
+            return "";
+        }
+        m_isShutdownRequested = true;
+        return "OK\n";
+    }
+
+    ParsedCommand command{parseCommand(trimmed)};
+    if (client.isInBatch)
+    {
+        client.batch.push_back(std::move(command));
+        return "";
+    }
+    std::vector<ParsedCommand> commands;
+    commands.push_back(std::move(command));
+    return runCommands(commands)[0] + '\n';
+}
+
+ControlServer::ParsedCommand ControlServer::parseCommand(const std::string &line)
+{
+    const size_t nameEnd{line.find_first_of(" \t")};
+    const std::string name{line.substr(0, nameEnd)};
+    std::string argument;
+    if (nameEnd != std::string::npos)
+    {
+        const size_t argumentStart{line.find_first_not_of(" \t", nameEnd)};
+        if (argumentStart != std::string::npos)
+            argument = line.substr(argumentStart);
+        // Allow trailing whitespace after numbers, but keep it in paths
+        if (name != "add")
+            argument.erase(argument.find_last_not_of(" \t") + 1);
+    }
+
+    ParsedCommand command;
+    if (name == "add")
+    {
+        if (argument.empty())
+            return {"ERR missing path", {}, false, {}};
+        command.action = [argument](Playlist &playlist, bool){
+            const bool wasEmpty{playlist.getNumOfTracks() == 0};
+            playlist.addNewTrack(argument);
+            if (wasEmpty)
+                playlist.startPlaying();
+            return "OK " + std::to_string(playlist.getNumOfTracks() - 1);
+        };
+        // Starting the first track changes what is played,
+        // adding to the end doesn't
+        command.flushCheck = [](const Playlist &playlist){
+            return playlist.getNumOfTracks() == 0;
+        };
+    }
+    else if (name == "remove")
+    {
+        size_t index{};
+        if (!parseIndex(argument, index))
+            return {"ERR invalid index", {}, false, {}};
+        command.action = [index](Playlist &playlist, bool) -> std::string {
+            if (index >= playlist.getNumOfTracks())
+                return "ERR no such track";
+            playlist.removeTrack(index);
+            return "OK";
+        };
+        // Removing the current track opens another one,
+        // removing any other doesn't change what is played
+        command.flushCheck = [index](const Playlist &playlist){
+            return index < playlist.getNumOfTracks()
+                && index == (size_t)playlist.getCurrentTrackIndex();
+        };
+    }
+    else if (name == "play")
+    {
+        if (argument.empty())
+        {
+            command.action = [](Playlist &playlist, bool) -> std::string {
+                if (playlist.getNumOfTracks() == 0)
+                    return "ERR playlist is empty";
+                playlist.startPlaying();
+                return "OK";
+            };
+        }
+        else
+        {
+            size_t index{};
+            if (!parseIndex(argument, index))
+                return {"ERR invalid index", {}, false, {}};
+            command.action = [index](Playlist &playlist, bool) -> std::string {
+                if (index >= playlist.getNumOfTracks())
+                    return "ERR no such track";
+                playlist.openTrackAtIndex(index);
+                return "OK";
+            };
+            command.isFlushNeeded = true;
+        }
+    }
+    else if (name == "pause" && argument.empty())
+    {
+        command.action = [](Playlist &playlist, bool){
+            playlist.pauseCurrentTrack();
+            return std::string{"OK"};
+        };
+    }
+    else if (name == "seek")
+    {
+        double seconds{};
+        if (!parseSeconds(argument, seconds))
+            return {"ERR invalid position", {}, false, {}};
+        command.action = [seconds](Playlist &playlist, bool) -> std::string {
+            Music *track{playlist.getCurrentTrack()};
+            if (track->getState() == Music::STATE_UNINITIALIZED)
+                return "ERR no track is open";
+            if (playlist.seekCurrentTrackToS(seconds))
+                return "ERR seek failed";
+            return "OK";
+        };
+        command.isFlushNeeded = true;
+    }
+    else if ((name == "next" || name == "prev") && argument.empty())
+    {
+        const bool isNext{name == "next"};
+        command.action = [isNext](Playlist &playlist, bool) -> std::string {
+            if (playlist.getNumOfTracks() == 0)
+                return "ERR playlist is empty";
+            if (isNext)
+                playlist.jumpToNextTrack();
+            else
+                playlist.jumpToPrevTrack();
+            return "OK " + std::to_string(playlist.getCurrentTrackIndex());
+        };
+        command.isFlushNeeded = true;
+    }
+    else if (name == "crossfade")
+    {
+        const size_t curveStart{argument.find_first_of(" \t")};
+        double seconds{};
+        auto curve{Crossfader::CURVE_EQUAL_POWER};
+        if (!parseSeconds(argument.substr(0, curveStart), seconds) || seconds > Crossfader::MAX_DURATION_S)
+            return {"ERR invalid duration", {}, false, {}};
+        if (curveStart != std::string::npos
+                && Crossfader::parseCurve(argument.substr(argument.find_first_not_of(" \t", curveStart)), curve))
+            return {"ERR invalid curve", {}, false, {}};
+        command.action = [seconds, curve](Playlist &playlist, bool){
+            playlist.setCrossfade(curve, seconds);
+            return std::string{"OK"};
+        };
+    }
+    else if (name == "replaygain")
+    {
+        const size_t preampStart{argument.find_first_of(" \t")};
+        auto mode{Playlist::REPLAYGAIN_OFF};
+        double preampDb{};
+        if (Playlist::parseReplayGainMode(argument.substr(0, preampStart), mode))
+            return {"ERR invalid mode", {}, false, {}};
+        if (preampStart != std::string::npos)
+        {
+            const std::string preamp{argument.substr(argument.find_first_not_of(" \t", preampStart))};
+            char *end{};
+            preampDb = std::strtod(preamp.c_str(), &end);
+            if (*end || end == preamp.c_str())
+                return {"ERR invalid preamp", {}, false, {}};
+        }
+        command.action = [mode, preampDb](Playlist &playlist, bool){
+            playlist.setReplayGain(mode, preampDb);
+            return std::string{"OK"};
+        };
+    }
+    else if (name == "status" && argument.empty())
+    {
+        command.action = [engine=m_engine](Playlist &playlist, bool isAfterFlush){
+            const Music *track{playlist.getCurrentTrack()};
+            // After a seek in the same batch the clock still shows
+            // the old position, the decoder is at the new one
+            double positionS{engine->getPositionS()};
+            if (isAfterFlush)
+                positionS = track->getOutputSampleRate()
+                    ? (double)track->getOutputFramePosition() / track->getOutputSampleRate() : 0;
+
+            std::stringstream ss;
+            ss << "OK state=" << stateToString(track->getState())
+               << " index=" << playlist.getCurrentTrackIndex()
+               << " tracks=" << playlist.getNumOfTracks()
+               << " position=" << positionS
+               << " duration=" << track->getDurationS()
+               // Last, so it can contain spaces
+               << " path=" << playlist.getCurrentTrackName();
+            return ss.str();
+        };
+    }
+    else if (name == "prefetch" && argument.empty())
+    {
+        command.action = [](Playlist &playlist, bool) -> std::string {
+            Prefetcher *prefetcher{playlist.getPrefetcher()};
+            if (!prefetcher)
+                return "ERR prefetching is off";
+
+            const Prefetcher::Stats stats{prefetcher->getStats()};
+            std::stringstream ss;
+            ss << "OK hits=" << stats.hitCount
+               << " misses=" << stats.missCount
+               << " cancelled=" << stats.cancelledCount
+               << " bytes=" << stats.prefetchedBytes;
+            return ss.str();
+        };
+    }
+    else
+    {
+        return {"ERR unknown command: " + line, {}, false, {}};
+    }
+    return command;
+}
+
+std::vector<std::string> ControlServer::runCommands(std::vector<ParsedCommand> &commands)
+{
+    std::vector<std::string> replies(commands.size());
+    bool isAnyAction{};
+    for (size_t i{}; i < commands.size(); ++i)
+    {
+        if (commands[i].action)
+            isAnyAction = true;
+        else
+            replies[i] = commands[i].immediateReply;
+    }
+    if (!isAnyAction)
+        return replies;
+
+    // Run them as one command, so nothing is decoded between them.
+    // The buffered samples are only thrown away if one of them
+    // changed what is played.
+    std::promise<void> done;
+    std::future<void> doneFuture{done.get_future()};
+    m_engine->postFlushIf([&commands, &replies, &done](Playlist &playlist){
+        bool isAfterFlush{};
+        for (size_t i{}; i < commands.size(); ++i)
+        {
+            if (!commands[i].action)
+                continue;
+            const bool isFlushing{commands[i].isFlushNeeded
+                || (commands[i].flushCheck && commands[i].flushCheck(playlist))};
+            // The mix of a crossfade is thrown away with the rest
+            if (isFlushing)
+                playlist.cancelCrossfade();
+            replies[i] = commands[i].action(playlist, isAfterFlush);
+            isAfterFlush |= isFlushing;
+        }
+        done.set_value();
+        return isAfterFlush;
+    });
+    doneFuture.wait();
+    return replies;
+}
+
+void ControlServer::closeClients()
+{
+    for (const Client &client : m_clients)
+        close(client.fd);
+    m_clients.clear();
+}
+
+ControlServer::~ControlServer()
+{
+    closeClients();
+    if (m_listenFd != -1)
+    {
+        close(m_listenFd);
+        unlink(m_socketPath.c_str());
+    }
+    if (m_wakePipe[0] != -1)
+    {
+        s_signalWakeFd = -1;
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        close(m_wakePipe[0]);
+        close(m_wakePipe[1]);
+    }
+}
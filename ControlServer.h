@@ -0,0 +1,163 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "PlaybackEngine.h"
+
+/*
+ * Controls a `PlaybackEngine` through a Unix domain socket, for running
+ * without a GUI. Every client sends commands as lines and gets one reply
+ * line for each: "OK", "OK <data>" or "ERR <reason>".
+ *
+ * Commands:
+ *   add PATH         Append a file to the playlist
+ *   remove INDEX     Remove the track at INDEX (counted from 0)
+ *   play [INDEX]     Unpause, or play the track at INDEX
+ *   pause            Pause
+ *   seek SECONDS     Seek in the current track
+ *   next, prev       Play the next or the previous track
+ *   crossfade SECONDS [CURVE]
+ *                    Set the crossfade between the tracks (0 turns it off),
+ *                    CURVE is "linear", "equal-power" or "s-curve"
+ *   replaygain MODE [PREAMP_DB]
+ *                    Set the ReplayGain mode: "off", "track" or "album"
+ *   status           "OK state=S index=I tracks=N position=P duration=D path=PATH"
+ *   prefetch         "OK hits=H misses=M cancelled=C bytes=B", see `Prefetcher`
+ *   shutdown         Stop the player
+ *   begin ... end    Run the commands between them at once, without
+ *                    playing anything in between. "begin" is answered
+ *                    right away, the replies of the commands are sent
+ *                    when "end" arrives, followed by the reply of "end".
+ *
+ * Everything runs on one thread with `poll()`, it sleeps while there is
+ * nothing to do.
+ */
+class ControlServer final
+{
+private:
+    /*
+     * Changes the playlist and returns the reply, run on the decode thread.
+     * `isAfterFlush` is true if a command before it in the same batch
+     * threw away the buffered samples, so the engine clock is not
+     * updated yet.
+     */
+    using Action = std::function<std::string(Playlist&, bool isAfterFlush)>;
+    /*
+     * Tells whether the action is going to change what is played,
+     * run on the decode thread right before the action.
+     */
+    using FlushCheck = std::function<bool(const Playlist&)>;
+
+    struct ParsedCommand
+    {
+        // Replied right away, without touching the playlist (status, errors)
+        std::string immediateReply;
+        Action action;
+        // The action always changes what is played (seek, track change)
+        bool isFlushNeeded{};
+        // Set if the action only sometimes does
+        FlushCheck flushCheck;
+    };
+
+    struct Client
+    {
+        int fd{-1};
+        // Received bytes without a newline yet
+        std::string input;
+        bool isInBatch{};
+        std::vector<ParsedCommand> batch;
+    };
+
+    PlaybackEngine *m_engine{};
+    std::string m_socketPath;
+    int m_listenFd{-1};
+    // Signal handlers and `stop()` write to it to wake up `run()`
+    int m_wakePipe[2]{-1, -1};
+    std::vector<Client> m_clients;
+    bool m_isShutdownRequested{};
+
+    ParsedCommand parseCommand(const std::string &line);
+    /*
+     * Run the actions on the decode thread and wait for them.
+     * Returns the replies in order.
+     */
+    std::vector<std::string> runCommands(std::vector<ParsedCommand> &commands);
+    /*
+     * Handle one line from `client` and return the reply
+     * (empty while a batch is collected).
+     */
+    std::string handleLine(Client &client, const std::string &line);
+    /*
+     * Read what `client` sent and answer the complete lines.
+     * Returns false if the client disconnected.
+     */
+    bool serveClient(Client &client);
+    void acceptClient();
+    void closeClients();
+
+public:
+    ControlServer(PlaybackEngine *engine, const std::string &socketPath);
+    ControlServer(const ControlServer&) = delete;
+    ControlServer(ControlServer&&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+    ControlServer& operator=(ControlServer&&) = delete;
+
+    /*
+     * Return "$XDG_RUNTIME_DIR/lightmusic.sock", or a path in /tmp
+     * with the user ID if the runtime directory is not set.
+     */
+    static std::string getDefaultSocketPath();
+
+    /*
+     * Create the socket and make SIGINT and SIGTERM stop `run()`.
+     * A stale socket file left by a crashed instance is replaced.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int start();
+
+    /*
+     * Serve the clients until the "shutdown" command, SIGINT,
+     * SIGTERM or `stop()`.
+     */
+    void run();
+
+    /*
+     * Make `run()` return. Can be called from any thread.
+     */
+    void stop();
+
+    /*
+     * Close the connections and remove the socket file.
+     */
+    ~ControlServer();
+};
@@ -0,0 +1,264 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Crossfader.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Number of frames mixed at once
+#define MIX_BLOCK_FRAMES 1024
+
+namespace
+{
+
+inline int16_t mixSample(int16_t outgoing, int16_t incoming, float outgoingGain, float incomingGain)
+{
+    float mixed{outgoing * outgoingGain + incoming * incomingGain};
+    mixed = mixed < 32767.0f ? mixed : 32767.0f;
+    mixed = mixed > -32768.0f ? mixed : -32768.0f;
+    return (int16_t)lrintf(mixed);
+}
+
+/*
+ * Write `outgoing * outgoingGains + incoming * incomingGains` to `output`,
+ * `count` samples, with a gain for every sample.
+ */
+void mixSamples(const int16_t *outgoing, const int16_t *incoming,
+        const float *outgoingGains, const float *incomingGains,
+        int16_t *output, size_t count)
+{
+    size_t i{};
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i outgoingVec{_mm_loadu_si128((const __m128i*)(outgoing + i))};
+        const __m128i incomingVec{_mm_loadu_si128((const __m128i*)(incoming + i))};
+        // Sign-extend to 32 bits: put the sample to the high half and shift it back
+        const __m128 outgoingLow{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(outgoingVec, outgoingVec), 16))};
+        const __m128 outgoingHigh{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(outgoingVec, outgoingVec), 16))};
+        const __m128 incomingLow{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(incomingVec, incomingVec), 16))};
+        const __m128 incomingHigh{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(incomingVec, incomingVec), 16))};
+
+        const __m128 mixedLow{_mm_add_ps(
+                _mm_mul_ps(outgoingLow, _mm_loadu_ps(outgoingGains + i)),
+                _mm_mul_ps(incomingLow, _mm_loadu_ps(incomingGains + i)))};
+        const __m128 mixedHigh{_mm_add_ps(
+                _mm_mul_ps(outgoingHigh, _mm_loadu_ps(outgoingGains + i + 4)),
+                _mm_mul_ps(incomingHigh, _mm_loadu_ps(incomingGains + i + 4)))};
+        // The pack saturates
+        _mm_storeu_si128((__m128i*)(output + i),
+                _mm_packs_epi32(_mm_cvtps_epi32(mixedLow), _mm_cvtps_epi32(mixedHigh)));
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8)
+    {
+        const int16x8_t outgoingVec{vld1q_s16(outgoing + i)};
+        const int16x8_t incomingVec{vld1q_s16(incoming + i)};
+        const float32x4_t outgoingLow{vcvtq_f32_s32(vmovl_s16(vget_low_s16(outgoingVec)))};
+        const float32x4_t outgoingHigh{vcvtq_f32_s32(vmovl_s16(vget_high_s16(outgoingVec)))};
+        const float32x4_t incomingLow{vcvtq_f32_s32(vmovl_s16(vget_low_s16(incomingVec)))};
+        const float32x4_t incomingHigh{vcvtq_f32_s32(vmovl_s16(vget_high_s16(incomingVec)))};
+
+        // Not fused, so the result is the same as the scalar code's
+        const float32x4_t mixedLow{vaddq_f32(
+                vmulq_f32(outgoingLow, vld1q_f32(outgoingGains + i)),
+                vmulq_f32(incomingLow, vld1q_f32(incomingGains + i)))};
+        const float32x4_t mixedHigh{vaddq_f32(
+                vmulq_f32(outgoingHigh, vld1q_f32(outgoingGains + i + 4)),
+                vmulq_f32(incomingHigh, vld1q_f32(incomingGains + i + 4)))};
+        vst1q_s16(output + i, vcombine_s16(
+                vqmovn_s32(vcvtnq_s32_f32(mixedLow)), vqmovn_s32(vcvtnq_s32_f32(mixedHigh))));
+    }
+#endif
+    for (; i < count; ++i)
+        output[i] = mixSample(outgoing[i], incoming[i], outgoingGains[i], incomingGains[i]);
+}
+
+} // namespace
+
+void Crossfader::setFade(Curve curve, double durationS)
+{
+    m_curve = curve;
+    m_durationS = std::clamp(durationS, 0.0, MAX_DURATION_S);
+}
+
+int Crossfader::parseCurve(const std::string &name, Curve &output)
+{
+    if (name == "linear")
+        output = CURVE_LINEAR;
+    else if (name == "equal-power")
+        output = CURVE_EQUAL_POWER;
+    else if (name == "s-curve")
+        output = CURVE_S_CURVE;
+    else
+        return 1;
+    return 0;
+}
+
+const char* Crossfader::getCurveName(Curve curve)
+{
+    switch (curve)
+    {
+    case CURVE_LINEAR:      return "linear";
+    case CURVE_EQUAL_POWER: return "equal-power";
+    case CURVE_S_CURVE:     return "s-curve";
+    }
+    return "unknown";
+}
+
+void Crossfader::start(int64_t lengthFrames, int sampleRate, int channels)
+{
+    // A preloaded track has a quarter second decoded, and a tick
+    // writes at most a packet
+    const size_t stagingSize{STAGING_LOOKAHEAD
+        + ((size_t)sampleRate / 4 + MAX_PACKET_FRAMES) * channels};
+    if (!m_outgoingBuffer || m_outgoingBuffer->getCapacity() < stagingSize)
+    {
+        m_outgoingBuffer = std::make_unique<RingBuffer<int16_t>>(stagingSize);
+        m_incomingBuffer = std::make_unique<RingBuffer<int16_t>>(stagingSize);
+    }
+
+    m_isActive = true;
+    m_channels = channels;
+    m_fadePosition = 0;
+    m_fadeLength = std::max<int64_t>(lengthFrames, 1);
+
+    const size_t blockSize{(size_t)MIX_BLOCK_FRAMES * channels};
+    m_outgoingBlock.resize(blockSize);
+    m_incomingBlock.resize(blockSize);
+    m_mixedBlock.resize(blockSize);
+    m_outgoingGains.resize(blockSize);
+    m_incomingGains.resize(blockSize);
+}
+
+void Crossfader::calculateGains(size_t frames)
+{
+    for (size_t i{}; i < frames; ++i)
+    {
+        const double progress{std::min(1.0, (double)(m_fadePosition + i) / m_fadeLength)};
+        double outgoingGain{};
+        double incomingGain{};
+        switch (m_curve)
+        {
+        case CURVE_LINEAR:
+            incomingGain = progress;
+            outgoingGain = 1.0 - progress;
+            break;
+
+        case CURVE_EQUAL_POWER:
+            incomingGain = std::sin(progress * M_PI / 2);
+            outgoingGain = std::cos(progress * M_PI / 2);
+            break;
+
+        case CURVE_S_CURVE:
+            incomingGain = progress * progress * (3.0 - 2.0 * progress);
+            outgoingGain = 1.0 - incomingGain;
+            break;
+        }
+
+        for (int ch{}; ch < m_channels; ++ch)
+        {
+            m_outgoingGains[i * m_channels + ch] = (float)outgoingGain;
+            m_incomingGains[i * m_channels + ch] = (float)incomingGain;
+        }
+    }
+}
+
+size_t Crossfader::mix(RingBuffer<int16_t> &output, bool isOutgoingEnded)
+{
+    if (!m_isActive)
+        return 0;
+
+    const size_t channels{(size_t)m_channels};
+    const size_t incomingFrames{m_incomingBuffer->getReadAvailable() / channels};
+    const size_t outgoingFrames{m_outgoingBuffer->getReadAvailable() / channels};
+    size_t frames{isOutgoingEnded ? incomingFrames : std::min(incomingFrames, outgoingFrames)};
+    frames = std::min<size_t>(frames, m_fadeLength - m_fadePosition);
+    // The rest is mixed when the output stage made room
+    frames = std::min(frames, output.getWriteAvailable() / channels);
+
+    size_t mixed{};
+    while (mixed < frames)
+    {
+        const size_t blockFrames{std::min<size_t>(frames - mixed, MIX_BLOCK_FRAMES)};
+        const size_t count{blockFrames * channels};
+
+        m_incomingBuffer->read(m_incomingBlock.data(), count);
+        // The end of the outgoing track may be missing, mix silence instead
+        const size_t outgoingCount{m_outgoingBuffer->read(m_outgoingBlock.data(), count)};
+        std::fill(m_outgoingBlock.begin() + outgoingCount, m_outgoingBlock.begin() + count, 0);
+
+        calculateGains(blockFrames);
+        mixSamples(m_outgoingBlock.data(), m_incomingBlock.data(),
+                m_outgoingGains.data(), m_incomingGains.data(),
+                m_mixedBlock.data(), count);
+
+        output.write(m_mixedBlock.data(), count);
+
+        mixed += blockFrames;
+        m_fadePosition += blockFrames;
+    }
+    return mixed;
+}
+
+bool Crossfader::finish(RingBuffer<int16_t> &output)
+{
+    int16_t block[4096];
+    // Only whole frames are published, like `Music::pushToPcmBuffer()` does
+    const size_t maxCount{sizeof(block) / sizeof(block[0]) / m_channels * m_channels};
+    while (m_incomingBuffer->getReadAvailable() > 0)
+    {
+        const size_t count{std::min({m_incomingBuffer->getReadAvailable(), maxCount,
+                output.getWriteAvailable() / m_channels * m_channels})};
+        // Continued when the output stage made room
+        if (count == 0)
+            return false;
+        m_incomingBuffer->read(block, count);
+        output.write(block, count);
+    }
+    cancel();
+    return true;
+}
+
+void Crossfader::cancel()
+{
+    if (m_outgoingBuffer)
+    {
+        m_outgoingBuffer->discardUntil(m_outgoingBuffer->getWritePosition());
+        m_incomingBuffer->discardUntil(m_incomingBuffer->getWritePosition());
+    }
+    m_isActive = false;
+    m_fadePosition = 0;
+    m_fadeLength = 0;
+}
@@ -0,0 +1,179 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "RingBuffer.h"
+
+/*
+ * Mixes the end of a track with the beginning of the next one.
+ *
+ * During a fade both tracks decode into their own staging buffer
+ * instead of the PCM buffer of the engine, and `mix()` combines them into
+ * the PCM buffer with the gains of the curve. The playlist keeps both
+ * decoders ahead of the mix point, so the mix never waits for one.
+ *
+ * The mix is done on floats with SSE2 or NEON, the result is saturated
+ * to 16 bits.
+ */
+class Crossfader final
+{
+public:
+    enum Curve
+    {
+        // The gains sum to 1, the middle of the fade is quieter
+        CURVE_LINEAR,
+        // The powers sum to 1, the loudness stays the same for
+        // uncorrelated tracks
+        CURVE_EQUAL_POWER,
+        // Linear with smoothed ends (smoothstep), no sudden change
+        // at the start and the end of the fade
+        CURVE_S_CURVE,
+    };
+
+    static constexpr double MAX_DURATION_S{12.0};
+    // The decoders stop when their staging buffer has this many samples
+    static constexpr size_t STAGING_LOOKAHEAD{1 << 14};
+    // The largest packet a staging buffer has room for, in frames
+    // (the limit of FLAC)
+    static constexpr size_t MAX_PACKET_FRAMES{1 << 16};
+
+private:
+    Curve m_curve{CURVE_EQUAL_POWER};
+    double m_durationS{};
+
+    // Created by the first fade, grown if a track needs more. A track
+    // stops decoding while its samples don't fit, so they should hold
+    // what a tick writes, or the fade stalls every other tick.
+    std::unique_ptr<RingBuffer<int16_t>> m_outgoingBuffer;
+    std::unique_ptr<RingBuffer<int16_t>> m_incomingBuffer;
+
+    bool m_isActive{};
+    int m_channels{};
+    // Number of frames mixed and the length of the current fade
+    int64_t m_fadePosition{};
+    int64_t m_fadeLength{};
+
+    // Scratch space of `mix()`, one block of samples
+    std::vector<int16_t> m_outgoingBlock;
+    std::vector<int16_t> m_incomingBlock;
+    std::vector<int16_t> m_mixedBlock;
+    std::vector<float> m_outgoingGains;
+    std::vector<float> m_incomingGains;
+
+    /*
+     * Write the gains of the next `frames` frames of the fade,
+     * repeated for every channel.
+     */
+    void calculateGains(size_t frames);
+
+public:
+    Crossfader() {}
+    Crossfader(const Crossfader&) = delete;
+    Crossfader(Crossfader&&) = delete;
+    Crossfader& operator=(const Crossfader&) = delete;
+    Crossfader& operator=(Crossfader&&) = delete;
+
+    /*
+     * Set the fade. A duration of 0 turns crossfading off, it is
+     * clamped to `MAX_DURATION_S`. A running fade is not changed.
+     */
+    void setFade(Curve curve, double durationS);
+    inline Curve getCurve() const { return m_curve; }
+    inline double getDurationS() const { return m_durationS; }
+    inline bool isEnabled() const { return m_durationS > 0; }
+
+    /*
+     * Return the length of the fade in frames at `sampleRate`.
+     */
+    inline int64_t getDurationFrames(int sampleRate) const
+    {
+        return (int64_t)(m_durationS * sampleRate);
+    }
+
+    /*
+     * Parse a curve name ("linear", "equal-power" or "s-curve").
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    static int parseCurve(const std::string &name, Curve &output);
+    static const char* getCurveName(Curve curve);
+
+    // The tracks write to these during the fade, see `Music::setPcmBuffer()`
+    // Only valid after `start()`
+    inline RingBuffer<int16_t>* getOutgoingBuffer() { return m_outgoingBuffer.get(); }
+    inline RingBuffer<int16_t>* getIncomingBuffer() { return m_incomingBuffer.get(); }
+
+    /*
+     * Return the number of frames of the incoming track waiting to be mixed.
+     */
+    inline size_t getIncomingStagedFrames() const
+    {
+        return m_isActive ? m_incomingBuffer->getReadAvailable() / m_channels : 0;
+    }
+
+    /*
+     * Start a fade of `lengthFrames` frames and make the staging buffers
+     * big enough for the format.
+     */
+    void start(int64_t lengthFrames, int sampleRate, int channels);
+    inline bool isActive() const { return m_isActive; }
+
+    /*
+     * Mix the staged samples into `output`, as many as fit into it.
+     * Only mixes as far as both tracks are decoded, except if the
+     * outgoing track has no more samples (`isOutgoingEnded`): then
+     * it is mixed as silence.
+     *
+     * Returns the number of frames mixed.
+     */
+    size_t mix(RingBuffer<int16_t> &output, bool isOutgoingEnded);
+
+    /*
+     * Return whether the whole fade is mixed.
+     */
+    inline bool isFadeDone() const { return m_fadePosition >= m_fadeLength; }
+
+    /*
+     * End the fade: move the samples of the incoming track that are
+     * decoded ahead to `output` and drop the rest of the outgoing track.
+     *
+     * Returns false if `output` is full before every sample is moved,
+     * then the fade stays active and this has to be called again.
+     */
+    bool finish(RingBuffer<int16_t> &output);
+
+    /*
+     * End the fade and drop everything staged.
+     */
+    void cancel();
+};
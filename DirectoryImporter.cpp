@@ -0,0 +1,197 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "DirectoryImporter.h"
+#include "MetadataScanner.h"
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+DirectoryImporter::DirectoryImporter(BatchCallback batchCallback, FilterMode filterMode)
+    : m_batchCallback{std::move(batchCallback)}, m_filterMode{filterMode}
+{
+    m_thread = std::thread{&DirectoryImporter::threadLoop, this};
+}
+
+void DirectoryImporter::import(const std::vector<std::string> &paths)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_queueMutex};
+        for (const auto &path : paths)
+            m_queue.emplace_back(path);
+        // Set here, so the caller sees it as busy right after the call
+        m_isBusy = true;
+    }
+    m_queueCv.notify_one();
+}
+
+bool DirectoryImporter::hasAudioFileExtension(const fs::path &path)
+{
+    static const char *const extensions[]{
+        ".mp3", ".flac", ".ogg", ".oga", ".opus", ".spx", ".wav", ".aif",
+        ".aiff", ".m4a", ".aac", ".alac", ".wma", ".wv", ".ape", ".mpc",
+        ".tta", ".dsf", ".mka", ".mkv", ".webm", ".mp4",
+    };
+
+    std::string extension{path.extension().string()};
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](unsigned char c){ return std::tolower(c); });
+    return std::find_if(std::begin(extensions), std::end(extensions),
+            [&extension](const char *ext){ return extension == ext; }) != std::end(extensions);
+}
+
+bool DirectoryImporter::isAccepted(const fs::path &path) const
+{
+    if (hasAudioFileExtension(path))
+        return true;
+    if (m_filterMode == FILTERMODE_PROBE)
+    {
+        TrackMetadata metadata;
+        return MetadataScanner::probeFile(path.string(), metadata) == 0;
+    }
+    return false;
+}
+
+bool DirectoryImporter::isStopRequested()
+{
+    std::lock_guard<std::mutex> lock{m_queueMutex};
+    return m_isStopRequested;
+}
+
+void DirectoryImporter::importRoot(const fs::path &root)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<std::string> batch;
+    auto lastDeliveryTime{clock::now()};
+    auto deliver{[&](){
+        if (batch.empty())
+            return;
+        m_foundCount += batch.size();
+        m_batchCallback(std::move(batch));
+        batch.clear();
+        lastDeliveryTime = clock::now();
+    }};
+
+    std::error_code error;
+    if (!fs::is_directory(root, error))
+    {
+        if (fs::is_regular_file(root, error) && isAccepted(root))
+            batch.push_back(root.string());
+        deliver();
+        return;
+    }
+
+    // Depth-first walk with an explicit stack, so the entries of
+    // every directory can be sorted
+    std::vector<fs::path> dirStack{root};
+    std::vector<fs::path> files;
+    std::vector<fs::path> subdirs;
+    while (!dirStack.empty())
+    {
+        if (isStopRequested())
+            return;
+
+        const fs::path dir{std::move(dirStack.back())};
+        dirStack.pop_back();
+
+        files.clear();
+        subdirs.clear();
+        for (fs::directory_iterator it{dir, fs::directory_options::skip_permission_denied, error}, end;
+                !error && it != end; it.increment(error))
+        {
+            std::error_code statError;
+            const fs::file_status status{it->status(statError)};
+            if (statError)
+                continue;
+            // Don't follow symlinked directories, they can form loops
+            if (fs::is_directory(status) && !it->is_symlink(statError))
+                subdirs.push_back(it->path());
+            else if (fs::is_regular_file(status))
+                files.push_back(it->path());
+        }
+        if (error)
+        {
+            std::cerr << "Failed to read directory: " << dir << ": " << error.message() << '\n';
+            error.clear();
+        }
+
+        std::sort(files.begin(), files.end());
+        for (const auto &file : files)
+        {
+            if (!isAccepted(file))
+                continue;
+
+            batch.push_back(file.string());
+            if (batch.size() >= MAX_BATCH_SIZE
+                    || clock::now() - lastDeliveryTime >= std::chrono::milliseconds{MAX_BATCH_DELAY_MS})
+                deliver();
+        }
+
+        // Push them in reverse order, so they are popped in order
+        std::sort(subdirs.begin(), subdirs.end());
+        dirStack.insert(dirStack.end(), subdirs.rbegin(), subdirs.rend());
+    }
+
+    deliver();
+}
+
+void DirectoryImporter::threadLoop()
+{
+    while (true)
+    {
+        fs::path root;
+        {
+            std::unique_lock<std::mutex> lock{m_queueMutex};
+            if (m_queue.empty())
+                m_isBusy = false;
+            m_queueCv.wait(lock, [this](){ return m_isStopRequested || !m_queue.empty(); });
+            if (m_isStopRequested)
+                return;
+
+            root = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        importRoot(root);
+    }
+}
+
+DirectoryImporter::~DirectoryImporter()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_queueMutex};
+        m_isStopRequested = true;
+        m_queue.clear();
+    }
+    m_queueCv.notify_one();
+    m_thread.join();
+}
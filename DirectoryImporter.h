@@ -0,0 +1,129 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <filesystem>
+
+/*
+ * Finds the audio files in directory trees on a background thread.
+ *
+ * The found files are delivered in batches while the walk is running,
+ * so the playlist fills up incrementally even for huge trees.
+ * The entries of every directory are sorted by name, files first,
+ * so the tracks of an album stay in order.
+ */
+class DirectoryImporter final
+{
+public:
+    enum FilterMode
+    {
+        // Only accept the files with a known audio file extension
+        FILTERMODE_EXTENSION,
+        // Also open the files with an unknown extension with libav
+        // and accept them if they have an audio stream
+        FILTERMODE_PROBE,
+    };
+
+    /*
+     * Called with the next batch of file paths, on the import thread.
+     */
+    using BatchCallback = std::function<void(std::vector<std::string> &&paths)>;
+
+    // Maximum number of paths delivered at once
+    static constexpr size_t MAX_BATCH_SIZE{256};
+    // A partial batch is delivered after this time, so the first
+    // tracks show up quickly
+    static constexpr int MAX_BATCH_DELAY_MS{100};
+
+private:
+    BatchCallback m_batchCallback;
+    FilterMode m_filterMode{};
+
+    std::thread m_thread;
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCv;
+    // Directories and files waiting to be imported
+    std::deque<std::filesystem::path> m_queue;
+    bool m_isStopRequested{};
+
+    std::atomic<bool> m_isBusy{};
+    std::atomic<size_t> m_foundCount{};
+
+    void threadLoop();
+    /*
+     * Walk a directory tree (or take a single file) and deliver the
+     * accepted files.
+     */
+    void importRoot(const std::filesystem::path &root);
+    bool isAccepted(const std::filesystem::path &path) const;
+    bool isStopRequested();
+
+public:
+    explicit DirectoryImporter(BatchCallback batchCallback, FilterMode filterMode=FILTERMODE_EXTENSION);
+    DirectoryImporter(const DirectoryImporter&) = delete;
+    DirectoryImporter(DirectoryImporter&&) = delete;
+    DirectoryImporter& operator=(const DirectoryImporter&) = delete;
+    DirectoryImporter& operator=(DirectoryImporter&&) = delete;
+
+    /*
+     * Queue directories or files for importing.
+     * Directories are walked recursively, files are filtered the same way.
+     * Returns immediately.
+     */
+    void import(const std::vector<std::string> &paths);
+
+    /*
+     * Return whether there is an import in progress.
+     */
+    inline bool isBusy() const { return m_isBusy; }
+
+    /*
+     * Return the number of files found since the object was created.
+     */
+    inline size_t getFoundCount() const { return m_foundCount; }
+
+    /*
+     * Return whether the path has an extension of a common audio
+     * or video file format.
+     */
+    static bool hasAudioFileExtension(const std::filesystem::path &path);
+
+    /*
+     * Drop the queued imports, stop the current one and wait for the thread.
+     */
+    ~DirectoryImporter();
+};
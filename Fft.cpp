@@ -0,0 +1,201 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Fft.h"
+#include <cmath>
+#include <cassert>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+/*
+ * The butterflies of a radix-2 stage at `[start, start+h)`
+ * and `[start+h, start+2h)`, from `k` to `h`.
+ */
+inline void butterfliesScalar(
+        float *re, float *im, const float *twiddleRe, const float *twiddleIm,
+        size_t start, size_t h, size_t k)
+{
+    for (; k < h; ++k)
+    {
+        const size_t a{start + k};
+        const size_t b{a + h};
+        const float tr{re[b]*twiddleRe[k] - im[b]*twiddleIm[k]};
+        const float ti{re[b]*twiddleIm[k] + im[b]*twiddleRe[k]};
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+    }
+}
+
+} // namespace
+
+Fft::Fft(size_t size)
+    : m_size{size}
+{
+    assert(size >= 4 && (size & (size - 1)) == 0);
+
+    int bits{};
+    while (((size_t)1 << bits) < size)
+        ++bits;
+    m_bitReversed.resize(size);
+    for (size_t i{}; i < size; ++i)
+    {
+        uint32_t reversed{};
+        for (int j{}; j < bits; ++j)
+            reversed |= ((i >> j) & 1) << (bits - 1 - j);
+        m_bitReversed[i] = reversed;
+    }
+
+    m_twiddleRe.resize(size);
+    m_twiddleIm.resize(size);
+    for (size_t h{1}; h < size; h *= 2)
+    {
+        for (size_t k{}; k < h; ++k)
+        {
+            const double angle{-M_PI * k / h};
+            m_twiddleRe[h + k] = std::cos(angle);
+            m_twiddleIm[h + k] = std::sin(angle);
+        }
+    }
+}
+
+void Fft::permute(float *re, float *im) const
+{
+    for (size_t i{}; i < m_size; ++i)
+    {
+        const size_t j{m_bitReversed[i]};
+        if (i < j)
+        {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+}
+
+void Fft::transformRadix4(float *re, float *im) const
+{
+    // The first two stages at once: 4-point DFTs, the twiddles are 1 and -i
+    for (size_t i{}; i < m_size; i += 4)
+    {
+        const float r0{re[i] + re[i + 1]};
+        const float i0{im[i] + im[i + 1]};
+        const float r1{re[i] - re[i + 1]};
+        const float i1{im[i] - im[i + 1]};
+        const float r2{re[i + 2] + re[i + 3]};
+        const float i2{im[i + 2] + im[i + 3]};
+        const float r3{re[i + 2] - re[i + 3]};
+        const float i3{im[i + 2] - im[i + 3]};
+        re[i]     = r0 + r2;
+        im[i]     = i0 + i2;
+        re[i + 2] = r0 - r2;
+        im[i + 2] = i0 - i2;
+        re[i + 1] = r1 + i3;
+        im[i + 1] = i1 - r3;
+        re[i + 3] = r1 - i3;
+        im[i + 3] = i1 + r3;
+    }
+}
+
+void Fft::transform(float *re, float *im) const
+{
+    permute(re, im);
+    transformRadix4(re, im);
+
+    for (size_t h{4}; h < m_size; h *= 2)
+    {
+        const float *twiddleRe{m_twiddleRe.data() + h};
+        const float *twiddleIm{m_twiddleIm.data() + h};
+        for (size_t start{}; start < m_size; start += 2*h)
+        {
+            size_t k{};
+#if defined(__SSE2__)
+            for (; k + 4 <= h; k += 4)
+            {
+                float *reA{re + start + k};
+                float *imA{im + start + k};
+                float *reB{reA + h};
+                float *imB{imA + h};
+                const __m128 wr{_mm_loadu_ps(twiddleRe + k)};
+                const __m128 wi{_mm_loadu_ps(twiddleIm + k)};
+                const __m128 br{_mm_loadu_ps(reB)};
+                const __m128 bi{_mm_loadu_ps(imB)};
+                const __m128 tr{_mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi))};
+                const __m128 ti{_mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr))};
+                const __m128 ar{_mm_loadu_ps(reA)};
+                const __m128 ai{_mm_loadu_ps(imA)};
+                _mm_storeu_ps(reB, _mm_sub_ps(ar, tr));
+                _mm_storeu_ps(imB, _mm_sub_ps(ai, ti));
+                _mm_storeu_ps(reA, _mm_add_ps(ar, tr));
+                _mm_storeu_ps(imA, _mm_add_ps(ai, ti));
+            }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+            for (; k + 4 <= h; k += 4)
+            {
+                float *reA{re + start + k};
+                float *imA{im + start + k};
+                float *reB{reA + h};
+                float *imB{imA + h};
+                const float32x4_t wr{vld1q_f32(twiddleRe + k)};
+                const float32x4_t wi{vld1q_f32(twiddleIm + k)};
+                const float32x4_t br{vld1q_f32(reB)};
+                const float32x4_t bi{vld1q_f32(imB)};
+                const float32x4_t tr{vsubq_f32(vmulq_f32(br, wr), vmulq_f32(bi, wi))};
+                const float32x4_t ti{vaddq_f32(vmulq_f32(br, wi), vmulq_f32(bi, wr))};
+                const float32x4_t ar{vld1q_f32(reA)};
+                const float32x4_t ai{vld1q_f32(imA)};
+                vst1q_f32(reB, vsubq_f32(ar, tr));
+                vst1q_f32(imB, vsubq_f32(ai, ti));
+                vst1q_f32(reA, vaddq_f32(ar, tr));
+                vst1q_f32(imA, vaddq_f32(ai, ti));
+            }
+#endif
+            butterfliesScalar(re, im, twiddleRe, twiddleIm, start, h, k);
+        }
+    }
+}
+
+void Fft::transformScalar(float *re, float *im) const
+{
+    permute(re, im);
+    transformRadix4(re, im);
+
+    for (size_t h{4}; h < m_size; h *= 2)
+    {
+        for (size_t start{}; start < m_size; start += 2*h)
+            butterfliesScalar(re, im, m_twiddleRe.data() + h, m_twiddleIm.data() + h, start, h, 0);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * In-place complex FFT of a power of 2 size (at least 4), on split
+ * real and imaginary arrays.
+ *
+ * The first two radix-2 stages are done as one radix-4 pass, the rest
+ * are radix-2 stages whose butterflies are vectorized (SSE2 or NEON):
+ * with split arrays and a twiddle table per stage, every stage reads
+ * 4 consecutive butterflies at once.
+ */
+class Fft final
+{
+private:
+    size_t m_size{};
+    std::vector<uint32_t> m_bitReversed;
+    // The twiddles of the stage of butterfly distance `h` are at [h, 2h)
+    std::vector<float> m_twiddleRe;
+    std::vector<float> m_twiddleIm;
+
+    void permute(float *re, float *im) const;
+    void transformRadix4(float *re, float *im) const;
+
+public:
+    /*
+     * `size` must be a power of 2, at least 4.
+     */
+    explicit Fft(size_t size);
+
+    inline size_t getSize() const { return m_size; }
+
+    /*
+     * Transform `re` and `im` (`getSize()` elements each) in place.
+     */
+    void transform(float *re, float *im) const;
+
+    /*
+     * The same as `transform()` without the vector instructions,
+     * for comparison.
+     */
+    void transformScalar(float *re, float *im) const;
+};
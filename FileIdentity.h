@@ -0,0 +1,71 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <system_error>
+#include <filesystem>
+
+/*
+ * Identifies a version of a file by its modification time and size.
+ * Caches keyed by the path use it to notice that a file has changed.
+ */
+struct FileIdentity
+{
+    // Modification time in the units of `std::filesystem::file_time_type`
+    int64_t modificationTime{};
+    uint64_t size{};
+
+    /*
+     * Get the identity of the file at `path`.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    static int get(const std::string &path, FileIdentity &output)
+    {
+        std::error_code error;
+        const auto modificationTime{std::filesystem::last_write_time(path, error)};
+        if (error)
+            return 1;
+        const auto size{std::filesystem::file_size(path, error)};
+        if (error)
+            return 1;
+
+        output.modificationTime = modificationTime.time_since_epoch().count();
+        output.size = size;
+        return 0;
+    }
+
+    inline bool operator==(const FileIdentity &other) const
+    {
+        return modificationTime == other.modificationTime && size == other.size;
+    }
+    inline bool operator!=(const FileIdentity &other) const { return !(*this == other); }
+};
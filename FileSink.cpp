@@ -0,0 +1,168 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "FileSink.h"
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+// Writes the value as little endian, like WAV needs it
+template <typename T>
+static void appendLittleEndian(std::vector<uint8_t> &output, T value)
+{
+    for (size_t i{}; i < sizeof(T); ++i)
+        output.push_back((uint8_t)((uint64_t)value >> (i * 8)));
+}
+
+FileSink::FileSink(const std::string &path, FileFormat fileFormat)
+    : m_path{path}, m_fileFormat{fileFormat}
+{
+}
+
+std::string FileSink::getNextFilePath() const
+{
+    if (m_fileCount == 0)
+        return m_path;
+
+    // "out.wav" -> "out-2.wav"
+    const size_t slashI{m_path.find_last_of('/')};
+    size_t dotI{m_path.find_last_of('.')};
+    if (dotI == std::string::npos || (slashI != std::string::npos && dotI < slashI))
+        dotI = m_path.size();
+    return m_path.substr(0, dotI) + "-" + std::to_string(m_fileCount + 1) + m_path.substr(dotI);
+}
+
+int FileSink::writeWavHeader()
+{
+    // The sizes are 32-bit, a longer file is cut off in the header
+    const uint32_t dataSize{(uint32_t)std::min<uint64_t>(
+            m_dataSize, std::numeric_limits<uint32_t>::max() - 36)};
+    const uint16_t blockAlign{(uint16_t)(m_channelCount * sizeof(int16_t))};
+
+    std::vector<uint8_t> header{'R', 'I', 'F', 'F'};
+    appendLittleEndian<uint32_t>(header, 36 + dataSize);
+    header.insert(header.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    appendLittleEndian<uint32_t>(header, 16);                 // Size of the fmt chunk
+    appendLittleEndian<uint16_t>(header, 1);                  // PCM
+    appendLittleEndian<uint16_t>(header, m_channelCount);
+    appendLittleEndian<uint32_t>(header, m_sampleRate);
+    appendLittleEndian<uint32_t>(header, m_sampleRate * blockAlign); // Bytes per second
+    appendLittleEndian<uint16_t>(header, blockAlign);
+    appendLittleEndian<uint16_t>(header, 16);                 // Bits per sample
+    header.insert(header.end(), {'d', 'a', 't', 'a'});
+    appendLittleEndian<uint32_t>(header, dataSize);
+
+    if (std::fseek(m_file, 0, SEEK_SET)
+            || std::fwrite(header.data(), 1, header.size(), m_file) != header.size()
+            || std::fseek(m_file, 0, SEEK_END))
+    {
+        std::cerr << "Failed to write WAV header" << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int FileSink::open(int sampleRate, int channelCount)
+{
+    const std::string path{getNextFilePath()};
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file)
+    {
+        std::cerr << "Failed to open output file: " << path << '\n';
+        return 1;
+    }
+    ++m_fileCount;
+
+    m_sampleRate = sampleRate;
+    m_channelCount = channelCount;
+    m_dataSize = 0;
+    // Sizes are filled in by `drain()` and `close()`
+    if (m_fileFormat == FILEFORMAT_WAV && writeWavHeader())
+    {
+        close();
+        return 1;
+    }
+
+    std::cout << "Writing samples to " << path << '\n';
+    return 0;
+}
+
+int16_t* FileSink::beginWrite(size_t maxCount, size_t &count)
+{
+    if (!m_file)
+        return nullptr;
+
+    count = maxCount / m_channelCount * m_channelCount;
+    if (m_buffer.size() < count)
+        m_buffer.resize(count);
+    return m_buffer.data();
+}
+
+int FileSink::commitWrite(size_t count)
+{
+    if (!m_file)
+        return 1;
+
+    // WAV is little endian, like the machines we run on
+    if (std::fwrite(m_buffer.data(), sizeof(int16_t), count, m_file) != count)
+    {
+        std::cerr << "Failed to write output file" << '\n';
+        return 1;
+    }
+    m_dataSize += count * sizeof(int16_t);
+    return 0;
+}
+
+void FileSink::drain()
+{
+    if (!m_file)
+        return;
+
+    // Leave a valid file behind, even if we are killed later
+    if (m_fileFormat == FILEFORMAT_WAV)
+        writeWavHeader();
+    std::fflush(m_file);
+}
+
+void FileSink::close()
+{
+    if (m_file)
+    {
+        if (m_fileFormat == FILEFORMAT_WAV)
+            writeWavHeader();
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+    m_sampleRate = 0;
+    m_channelCount = 0;
+}
+
+FileSink::~FileSink()
+{
+    close();
+}
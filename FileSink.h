@@ -0,0 +1,86 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include "AudioSink.h"
+
+/*
+ * Writes the samples to a WAV file or a headerless (raw) file.
+ *
+ * A file has one sample rate and channel count, so when the sink is
+ * reopened with other parameters the next file is started, with a number
+ * before the extension ("out.wav", "out-2.wav", ...).
+ */
+class FileSink final : public AudioSink
+{
+public:
+    enum FileFormat
+    {
+        FILEFORMAT_WAV,
+        FILEFORMAT_RAW,
+    };
+
+private:
+    std::string m_path;
+    FileFormat m_fileFormat{};
+    std::FILE *m_file{};
+    int m_sampleRate{};
+    int m_channelCount{};
+    // Number of files opened, names the next one
+    int m_fileCount{};
+    // Bytes of samples written to the current file
+    uint64_t m_dataSize{};
+    std::vector<int16_t> m_buffer;
+
+    std::string getNextFilePath() const;
+    /*
+     * Write the WAV header at the beginning of the file
+     * with the current data size.
+     */
+    int writeWavHeader();
+
+public:
+    FileSink(const std::string &path, FileFormat fileFormat);
+
+    int open(int sampleRate, int channelCount) override;
+    int16_t* beginWrite(size_t maxCount, size_t &count) override;
+    int commitWrite(size_t count) override;
+    void drain() override;
+    void close() override;
+    inline const char* getName() const override
+    {
+        return m_fileFormat == FILEFORMAT_WAV ? "wav" : "raw";
+    }
+
+    ~FileSink();
+};
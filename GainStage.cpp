@@ -0,0 +1,194 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "GainStage.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+inline int16_t applyGain(int16_t sample, float gain)
+{
+    float scaled{sample * gain};
+    scaled = scaled < 32767.0f ? scaled : 32767.0f;
+    scaled = scaled > -32768.0f ? scaled : -32768.0f;
+    return (int16_t)lrintf(scaled);
+}
+
+/*
+ * Return the largest absolute value of the samples.
+ */
+int getPeak(const int16_t *samples, size_t count)
+{
+    size_t i{};
+    int peak{};
+#if defined(__SSE2__)
+    __m128i maxVec{_mm_setzero_si128()};
+    __m128i minVec{_mm_setzero_si128()};
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i vec{_mm_loadu_si128((const __m128i*)(samples + i))};
+        maxVec = _mm_max_epi16(maxVec, vec);
+        minVec = _mm_min_epi16(minVec, vec);
+    }
+    int16_t maxes[8];
+    int16_t mins[8];
+    _mm_storeu_si128((__m128i*)maxes, maxVec);
+    _mm_storeu_si128((__m128i*)mins, minVec);
+    for (int j{}; j < 8; ++j)
+        peak = std::max({peak, (int)maxes[j], -(int)mins[j]});
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    int16x8_t maxVec{vdupq_n_s16(0)};
+    int16x8_t minVec{vdupq_n_s16(0)};
+    for (; i + 8 <= count; i += 8)
+    {
+        const int16x8_t vec{vld1q_s16(samples + i)};
+        maxVec = vmaxq_s16(maxVec, vec);
+        minVec = vminq_s16(minVec, vec);
+    }
+    peak = std::max((int)vmaxvq_s16(maxVec), -(int)vminvq_s16(minVec));
+#endif
+    for (; i < count; ++i)
+        peak = std::max(peak, std::abs((int)samples[i]));
+    return peak;
+}
+
+/*
+ * Multiply `count` samples by a gain going linearly
+ * from `startGain` by `step` per sample.
+ */
+void applyGainRamp(int16_t *samples, size_t count, float startGain, float step)
+{
+    size_t i{};
+#if defined(__SSE2__)
+    // The gain of a sample is `startGain + step * index`, the same
+    // as in the scalar code
+    const __m128 startVec{_mm_set1_ps(startGain)};
+    const __m128 stepVec{_mm_set1_ps(step)};
+    __m128 indexLow{_mm_set_ps(3, 2, 1, 0)};
+    __m128 indexHigh{_mm_set_ps(7, 6, 5, 4)};
+    const __m128 eight{_mm_set1_ps(8)};
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i vec{_mm_loadu_si128((const __m128i*)(samples + i))};
+        // Sign-extend to 32 bits: put the sample to the high half and shift it back
+        const __m128 low{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(vec, vec), 16))};
+        const __m128 high{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(vec, vec), 16))};
+        const __m128 gainLow{_mm_add_ps(startVec, _mm_mul_ps(stepVec, indexLow))};
+        const __m128 gainHigh{_mm_add_ps(startVec, _mm_mul_ps(stepVec, indexHigh))};
+        // The pack saturates
+        _mm_storeu_si128((__m128i*)(samples + i), _mm_packs_epi32(
+                    _mm_cvtps_epi32(_mm_mul_ps(low, gainLow)),
+                    _mm_cvtps_epi32(_mm_mul_ps(high, gainHigh))));
+        indexLow = _mm_add_ps(indexLow, eight);
+        indexHigh = _mm_add_ps(indexHigh, eight);
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const float32x4_t startVec{vdupq_n_f32(startGain)};
+    const float indices[8]{0, 1, 2, 3, 4, 5, 6, 7};
+    float32x4_t indexLow{vld1q_f32(indices)};
+    float32x4_t indexHigh{vld1q_f32(indices + 4)};
+    const float32x4_t eight{vdupq_n_f32(8)};
+    for (; i + 8 <= count; i += 8)
+    {
+        const int16x8_t vec{vld1q_s16(samples + i)};
+        const float32x4_t low{vcvtq_f32_s32(vmovl_s16(vget_low_s16(vec)))};
+        const float32x4_t high{vcvtq_f32_s32(vmovl_s16(vget_high_s16(vec)))};
+        // Not fused, so the result is the same as the scalar code's
+        const float32x4_t gainLow{vaddq_f32(startVec, vmulq_n_f32(indexLow, step))};
+        const float32x4_t gainHigh{vaddq_f32(startVec, vmulq_n_f32(indexHigh, step))};
+        vst1q_s16(samples + i, vcombine_s16(
+                    vqmovn_s32(vcvtnq_s32_f32(vmulq_f32(low, gainLow))),
+                    vqmovn_s32(vcvtnq_s32_f32(vmulq_f32(high, gainHigh)))));
+        indexLow = vaddq_f32(indexLow, eight);
+        indexHigh = vaddq_f32(indexHigh, eight);
+    }
+#endif
+    for (; i < count; ++i)
+        samples[i] = applyGain(samples[i], startGain + step * (float)i);
+}
+
+} // namespace
+
+float GainStage::dbToLinear(double db)
+{
+    return (float)std::pow(10.0, db / 20.0);
+}
+
+void GainStage::setGain(float gain, int sampleRate)
+{
+    m_gain = gain;
+    m_currentGain = gain;
+    m_releaseCoeff = sampleRate > 0
+        ? (float)(1.0 - std::exp(-(double)BLOCK_FRAMES / (RELEASE_S * sampleRate))) : 1.0f;
+}
+
+void GainStage::process(int16_t *samples, size_t frames, int channels)
+{
+    if (!isEnabled() || channels <= 0)
+        return;
+
+    for (size_t frame{}; frame < frames; frame += BLOCK_FRAMES)
+    {
+        const size_t count{std::min(BLOCK_FRAMES, frames - frame) * channels};
+        int16_t *block{samples + frame * channels};
+
+        // The highest gain that doesn't clip this block
+        const int peak{getPeak(block, count)};
+        const float maxGain{peak > 0 ? 32767.0f / peak : m_gain};
+        const float targetGain{std::min(m_gain, maxGain)};
+
+        float startGain{m_currentGain};
+        float endGain;
+        if (targetGain <= m_currentGain)
+        {
+            // Attack: the whole block gets the gain that fits
+            startGain = targetGain;
+            endGain = targetGain;
+        }
+        else
+        {
+            // Release
+            endGain = std::min(targetGain,
+                    m_currentGain + (m_gain - m_currentGain) * m_releaseCoeff);
+            // Close enough, avoid creeping forever
+            if (m_gain - endGain < 1e-4f && targetGain == m_gain)
+                endGain = m_gain;
+        }
+
+        applyGainRamp(block, count, startGain, (endGain - startGain) / count);
+        m_currentGain = endGain;
+    }
+}
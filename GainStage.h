@@ -0,0 +1,88 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Applies a gain to the decoded samples of a track (ReplayGain), with a
+ * limiter that keeps the samples from clipping when the gain is positive.
+ *
+ * The samples are processed in short blocks. If the peak of a block
+ * would clip, the gain drops right away to the highest one that fits,
+ * and returns to the set gain slowly (release). Within a block the gain
+ * changes linearly, so there are no steps during the release.
+ *
+ * The multiplication and the saturation are vectorized with SSE2 or NEON.
+ */
+class GainStage final
+{
+public:
+    // Number of frames that get the same limiter decision
+    static constexpr size_t BLOCK_FRAMES{64};
+    // Time for the limiter to return to the set gain, in seconds
+    static constexpr double RELEASE_S{0.2};
+
+private:
+    float m_gain{1.0f};
+    // The gain at the end of the last block, below `m_gain` while limiting
+    float m_currentGain{1.0f};
+    // Part of the distance to `m_gain` the release covers in a block
+    float m_releaseCoeff{};
+
+public:
+    GainStage() {}
+    GainStage(const GainStage&) = delete;
+    GainStage(GainStage&&) = delete;
+    GainStage& operator=(const GainStage&) = delete;
+    GainStage& operator=(GainStage&&) = delete;
+
+    /*
+     * Set the gain (linear, 1 means no change) and the sample rate,
+     * and reset the limiter.
+     */
+    void setGain(float gain, int sampleRate);
+    inline float getGain() const { return m_gain; }
+
+    /*
+     * Return whether `process()` changes anything.
+     */
+    inline bool isEnabled() const { return m_gain != 1.0f; }
+
+    /*
+     * Apply the gain to interleaved samples in place.
+     */
+    void process(int16_t *samples, size_t frames, int channels);
+
+    /*
+     * Convert a gain in dB to a linear factor.
+     */
+    static float dbToLinear(double db);
+};
@@ -0,0 +1,171 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LibavSink.h"
+#include <algorithm>
+#include <iostream>
+
+LibavSink::LibavSink(const std::string &formatName)
+    : m_formatName{formatName}
+{
+}
+
+int LibavSink::open(int sampleRate, int channelCount)
+{
+    // Get the output format of the audio device
+    m_outputFormat = av_guess_format(m_formatName.c_str(), nullptr, nullptr);
+    if (!m_outputFormat)
+    {
+        std::cerr << "Failed to get format of output device" << '\n';
+        return 1;
+    }
+
+    m_outputFormatContext = avformat_alloc_context();
+    if (!m_outputFormatContext)
+    {
+        std::cerr << "Failed to create output format context" << '\n';
+        return 1;
+    }
+    // Tell the format context which output device to use
+    m_outputFormatContext->oformat = m_outputFormat;
+
+    // Create a stream where the output will be written to
+    m_outputStream = avformat_new_stream(m_outputFormatContext, nullptr);
+    if (!m_outputStream)
+    {
+        std::cerr << "Failed to create output stream" << '\n';
+        close();
+        return 1;
+    }
+    // Configure the parameters of the output stream
+    m_outputStream->codecpar->codec_id       = AV_CODEC_ID_PCM_S16LE;
+    m_outputStream->codecpar->codec_type     = AVMEDIA_TYPE_AUDIO;
+    m_outputStream->codecpar->format         = AV_SAMPLE_FMT_S16;
+    m_outputStream->codecpar->bit_rate       = (int64_t)sampleRate * channelCount * 16;
+    m_outputStream->codecpar->sample_rate    = sampleRate;
+    m_outputStream->codecpar->channels       = channelCount;
+    m_outputStream->codecpar->channel_layout =
+        av_get_default_channel_layout(channelCount);
+
+    // Tell the device the parameters
+    if (avformat_write_header(m_outputFormatContext, nullptr) < 0)
+    {
+        std::cerr << "Failed to write stream header to output device" << '\n';
+        close();
+        return 1;
+    }
+
+    m_sampleRate = sampleRate;
+    m_channelCount = channelCount;
+    m_framesWritten = 0;
+    return 0;
+}
+
+int16_t* LibavSink::beginWrite(size_t maxCount, size_t &count)
+{
+    if (!m_outputFormatContext || !m_channelCount)
+        return nullptr;
+
+    count = maxCount / m_channelCount * m_channelCount;
+    m_bufferPool.releasePacket(m_pendingPacket);
+    m_pendingPacket = m_bufferPool.acquirePacket();
+    if (!m_pendingPacket || !(m_pendingPacket->buf = m_bufferPool.acquireBlock(count * sizeof(int16_t))))
+    {
+        std::cerr << "Failed to allocate output packet" << '\n';
+        m_bufferPool.releasePacket(m_pendingPacket);
+        m_pendingPacket = nullptr;
+        return nullptr;
+    }
+    m_pendingPacket->data = m_pendingPacket->buf->data;
+    return (int16_t*)m_pendingPacket->data;
+}
+
+int LibavSink::commitWrite(size_t count)
+{
+    if (!m_pendingPacket)
+        return 1;
+
+    m_pendingPacket->size = count * sizeof(int16_t);
+    const int result{av_write_frame(m_outputFormatContext, m_pendingPacket)};
+    // Gives the block back to the pool too
+    m_bufferPool.releasePacket(m_pendingPacket);
+    m_pendingPacket = nullptr;
+    if (result < 0)
+    {
+        std::cerr << "Failed to write packet to output device" << '\n';
+        return 1;
+    }
+    m_framesWritten += count / m_channelCount;
+    return 0;
+}
+
+int64_t LibavSink::getDelayFrames()
+{
+    if (!m_outputFormatContext)
+        return 0;
+
+    // The timestamp of the sample being played, in the time base of the stream
+    int64_t playedDts{};
+    int64_t wallTime{};
+    if (av_get_output_timestamp(m_outputFormatContext, 0, &playedDts, &wallTime) < 0)
+        return 0;
+
+    const int64_t playedFrames{av_rescale_q(
+            playedDts, m_outputStream->time_base, AVRational{1, m_sampleRate})};
+    return std::max<int64_t>(0, m_framesWritten - playedFrames);
+}
+
+void LibavSink::drain()
+{
+    if (m_outputFormatContext)
+        av_write_frame(m_outputFormatContext, nullptr);
+}
+
+void LibavSink::close()
+{
+    m_bufferPool.releasePacket(m_pendingPacket);
+    m_pendingPacket = nullptr;
+
+    if (m_outputFormatContext)
+    {
+        if (m_channelCount)
+            av_write_frame(m_outputFormatContext, nullptr); // Flush the buffer
+        avformat_free_context(m_outputFormatContext);
+    }
+
+    m_outputFormat        = nullptr;
+    m_outputFormatContext = nullptr;
+    m_outputStream        = nullptr;
+    m_sampleRate          = 0;
+    m_channelCount        = 0;
+}
+
+LibavSink::~LibavSink()
+{
+    close();
+}
@@ -0,0 +1,79 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "AudioSink.h"
+#include "BufferPool.h"
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavdevice/avdevice.h>
+}
+
+/*
+ * Plays the samples with a libavdevice output format, like "alsa" or "pulse".
+ * The samples are put right into a pooled packet that is written with
+ * `av_write_frame()`.
+ */
+class LibavSink final : public AudioSink
+{
+private:
+    // Name of the libavdevice output format
+    std::string       m_formatName;
+
+    AVOutputFormat    *m_outputFormat{};
+    AVFormatContext   *m_outputFormatContext{};
+    AVStream          *m_outputStream{};
+    int               m_sampleRate{};
+    int               m_channelCount{};
+    // Number of sample frames written since the device was opened
+    int64_t           m_framesWritten{};
+
+    // Recycles the packets written to the device
+    BufferPool        m_bufferPool;
+    // The packet returned by the last `beginWrite()`
+    AVPacket          *m_pendingPacket{};
+
+public:
+    LibavSink(const std::string &formatName);
+
+    int open(int sampleRate, int channelCount) override;
+    int16_t* beginWrite(size_t maxCount, size_t &count) override;
+    int commitWrite(size_t count) override;
+    int64_t getDelayFrames() override;
+    void drain() override;
+    void close() override;
+    inline const char* getName() const override { return "libav"; }
+
+    inline size_t getPoolAllocationCount() const { return m_bufferPool.getAllocationCount(); }
+
+    ~LibavSink();
+};
@@ -0,0 +1,338 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LibraryIndex.h"
+#include "sys-specific.h"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <filesystem>
+
+uint64_t LibraryIndex::hashPath(const std::string &path)
+{
+    // FNV-1a
+    uint64_t hash{0xcbf29ce484222325};
+    for (unsigned char c : path)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+int LibraryIndex::load(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    m_path = path;
+    m_file.close();
+    m_fileEntries = nullptr;
+    m_fileEntryCount = 0;
+    m_stringTable = nullptr;
+    m_stringTableSize = 0;
+
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+    {
+        std::cout << "No library index yet, starting with an empty one" << '\n';
+        return 0;
+    }
+
+    if (m_file.open(path))
+    {
+        std::cerr << "Failed to open library index: " << path << '\n';
+        return 1;
+    }
+
+    const uint8_t *data{m_file.getData()};
+    const size_t size{m_file.getSize()};
+    if (size < sizeof(FileHeader))
+    {
+        std::cerr << "Library index is too small, ignoring it" << '\n';
+        m_file.close();
+        return 1;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC))
+            || header.version != FILE_VERSION
+            || sizeof(FileHeader) + (uint64_t)header.entryCount * sizeof(FileEntry)
+                > header.stringTableOffset
+            || header.stringTableOffset + header.stringTableSize > size)
+    {
+        std::cerr << "Library index is invalid or has an old version, ignoring it" << '\n';
+        m_file.close();
+        return 1;
+    }
+
+    m_fileEntries = (const FileEntry*)(data + sizeof(FileHeader));
+    m_fileEntryCount = header.entryCount;
+    m_stringTable = (const char*)(data + header.stringTableOffset);
+    m_stringTableSize = header.stringTableSize;
+
+    std::cout << "Loaded library index with " << m_fileEntryCount << " entries" << '\n';
+    return 0;
+}
+
+std::string LibraryIndex::getString(StringRef ref) const
+{
+    if ((uint64_t)ref.offset + ref.length > m_stringTableSize)
+        return "";
+    return std::string{m_stringTable + ref.offset, ref.length};
+}
+
+const LibraryIndex::FileEntry* LibraryIndex::findFileEntry(const std::string &path) const
+{
+    const uint64_t hash{hashPath(path)};
+    const FileEntry *end{m_fileEntries + m_fileEntryCount};
+    const FileEntry *it{std::lower_bound(
+            m_fileEntries, end, hash,
+            [](const FileEntry &entry, uint64_t value){ return entry.pathHash < value; })};
+
+    // There may be more paths with the same hash
+    for (; it != end && it->pathHash == hash; ++it)
+    {
+        if (it->path.length == path.size()
+                && (uint64_t)it->path.offset + it->path.length <= m_stringTableSize
+                && std::memcmp(m_stringTable + it->path.offset, path.data(), path.size()) == 0)
+            return it;
+    }
+    return nullptr;
+}
+
+LibraryIndex::Entry LibraryIndex::toEntry(const FileEntry &fileEntry) const
+{
+    Entry entry;
+    entry.identity.modificationTime        = fileEntry.modificationTime;
+    entry.identity.size                    = fileEntry.fileSize;
+    entry.metadata.title                   = getString(fileEntry.title);
+    entry.metadata.artist                  = getString(fileEntry.artist);
+    entry.metadata.album                   = getString(fileEntry.album);
+    entry.metadata.codecName               = getString(fileEntry.codecName);
+    entry.metadata.durationMs              = fileEntry.durationMs;
+    entry.metadata.bitRate                 = fileEntry.bitRate;
+    entry.metadata.sampleRate              = fileEntry.sampleRate;
+    entry.metadata.channelCount            = fileEntry.channelCount;
+    entry.metadata.audioStreamIndex        = fileEntry.audioStreamIndex;
+    entry.metadata.loudness.trackGainDb    = fileEntry.trackGainDb;
+    entry.metadata.loudness.trackPeak      = fileEntry.trackPeak;
+    entry.metadata.loudness.albumGainDb    = fileEntry.albumGainDb;
+    entry.metadata.loudness.albumPeak      = fileEntry.albumPeak;
+    entry.metadata.loudness.integratedLufs = fileEntry.integratedLufs;
+    entry.metadata.loudness.truePeak       = fileEntry.truePeak;
+    return entry;
+}
+
+std::optional<LibraryIndex::Entry> LibraryIndex::findEntry(const std::string &path) const
+{
+    const auto changed{m_changedEntries.find(path)};
+    if (changed != m_changedEntries.end())
+        return changed->second;
+
+    const FileEntry *fileEntry{findFileEntry(path)};
+    if (fileEntry)
+        return toEntry(*fileEntry);
+
+    return std::nullopt;
+}
+
+std::optional<TrackMetadata> LibraryIndex::find(const std::string &path) const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    const auto entry{findEntry(path)};
+    if (!entry)
+        return std::nullopt;
+    return entry->metadata;
+}
+
+std::optional<TrackMetadata> LibraryIndex::findIfUpToDate(const std::string &path) const
+{
+    FileIdentity identity;
+    if (FileIdentity::get(path, identity))
+        return std::nullopt;
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    const auto entry{findEntry(path)};
+    if (!entry || entry->identity != identity)
+        return std::nullopt;
+    return entry->metadata;
+}
+
+void LibraryIndex::update(
+        const std::string &path,
+        const FileIdentity &identity,
+        const TrackMetadata &metadata)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    Entry entry{identity, metadata};
+    // The scanner and the player don't measure the loudness,
+    // don't lose the analyzer's result
+    if (!metadata.loudness.isMeasured())
+    {
+        const auto old{findEntry(path)};
+        if (old && old->identity == identity && old->metadata.loudness.isMeasured())
+        {
+            entry.metadata.loudness.integratedLufs = old->metadata.loudness.integratedLufs;
+            entry.metadata.loudness.truePeak = old->metadata.loudness.truePeak;
+        }
+    }
+    m_changedEntries[path] = std::move(entry);
+}
+
+size_t LibraryIndex::getEntryCount() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    size_t count{m_fileEntryCount};
+    for (const auto &changed : m_changedEntries)
+    {
+        if (!findFileEntry(changed.first))
+            ++count;
+    }
+    return count;
+}
+
+int LibraryIndex::save()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (m_path.empty())
+        return 1;
+    if (m_changedEntries.empty())
+        return 0;
+
+    std::vector<FileEntry> entries;
+    entries.reserve(m_fileEntryCount + m_changedEntries.size());
+    std::string stringTable;
+    // Tags repeat a lot (artist, album, codec), store each string once
+    std::unordered_map<std::string, StringRef> storedStrings;
+
+    auto addString{[&](const std::string &str) -> StringRef {
+        const auto found{storedStrings.find(str)};
+        if (found != storedStrings.end())
+            return found->second;
+        const StringRef ref{(uint32_t)stringTable.size(), (uint32_t)str.size()};
+        stringTable += str;
+        storedStrings.emplace(str, ref);
+        return ref;
+    }};
+    auto addEntry{[&](const std::string &path, const Entry &entry){
+        FileEntry fileEntry{};
+        fileEntry.pathHash          = hashPath(path);
+        fileEntry.path              = addString(path);
+        fileEntry.modificationTime  = entry.identity.modificationTime;
+        fileEntry.fileSize          = entry.identity.size;
+        fileEntry.durationMs        = entry.metadata.durationMs;
+        fileEntry.bitRate           = entry.metadata.bitRate;
+        fileEntry.sampleRate        = entry.metadata.sampleRate;
+        fileEntry.channelCount      = entry.metadata.channelCount;
+        fileEntry.audioStreamIndex  = entry.metadata.audioStreamIndex;
+        fileEntry.title             = addString(entry.metadata.title);
+        fileEntry.artist            = addString(entry.metadata.artist);
+        fileEntry.album             = addString(entry.metadata.album);
+        fileEntry.codecName         = addString(entry.metadata.codecName);
+        fileEntry.trackGainDb       = entry.metadata.loudness.trackGainDb;
+        fileEntry.trackPeak         = entry.metadata.loudness.trackPeak;
+        fileEntry.albumGainDb       = entry.metadata.loudness.albumGainDb;
+        fileEntry.albumPeak         = entry.metadata.loudness.albumPeak;
+        fileEntry.integratedLufs    = entry.metadata.loudness.integratedLufs;
+        fileEntry.truePeak          = entry.metadata.loudness.truePeak;
+        entries.push_back(fileEntry);
+    }};
+
+    for (size_t i{}; i < m_fileEntryCount; ++i)
+    {
+        const std::string path{getString(m_fileEntries[i].path)};
+        // Changed entries are added below
+        if (m_changedEntries.find(path) == m_changedEntries.end())
+            addEntry(path, toEntry(m_fileEntries[i]));
+    }
+    for (const auto &changed : m_changedEntries)
+        addEntry(changed.first, changed.second);
+
+    std::sort(entries.begin(), entries.end(),
+            [](const FileEntry &a, const FileEntry &b){ return a.pathHash < b.pathHash; });
+
+    FileHeader header{};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.entryCount = entries.size();
+    header.stringTableOffset = sizeof(FileHeader) + entries.size() * sizeof(FileEntry);
+    header.stringTableSize = stringTable.size();
+
+    // Write to a temporary file and rename it, so a crash can't leave
+    // a half-written index behind
+    const std::string tempPath{m_path + ".tmp"};
+    {
+        std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)entries.data(), entries.size() * sizeof(FileEntry));
+        file.write(stringTable.data(), stringTable.size());
+        if (!file)
+        {
+            std::cerr << "Failed to write library index: " << tempPath << '\n';
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, m_path, error);
+    if (error)
+    {
+        std::cerr << "Failed to replace library index: " << error.message() << '\n';
+        return 1;
+    }
+
+    // Map the new file, the changes are in it now
+    m_changedEntries.clear();
+    m_file.close();
+    m_fileEntries = nullptr;
+    m_fileEntryCount = 0;
+    if (m_file.open(m_path) == 0)
+    {
+        m_fileEntries = (const FileEntry*)(m_file.getData() + sizeof(FileHeader));
+        m_fileEntryCount = header.entryCount;
+        m_stringTable = (const char*)(m_file.getData() + header.stringTableOffset);
+        m_stringTableSize = header.stringTableSize;
+    }
+
+    std::cout << "Saved library index with " << entries.size() << " entries" << '\n';
+    return 0;
+}
+
+std::string LibraryIndex::getDefaultPath()
+{
+    const std::string cacheDir{SysSpecific::getCacheDir()};
+    return cacheDir.empty() ? "" : cacheDir + "/library.idx";
+}
@@ -0,0 +1,225 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <cstdint>
+#include <cmath>
+#include "MappedFile.h"
+#include "FileIdentity.h"
+
+/*
+ * Loudness of a track. The gains are in dB, the peaks are linear
+ * (1.0 is full scale). NAN if not known.
+ */
+struct LoudnessInfo
+{
+    // From the ReplayGain (or Opus R128) tags of the file
+    float trackGainDb{NAN};
+    float trackPeak{NAN};
+    float albumGainDb{NAN};
+    float albumPeak{NAN};
+    // Measured by `LoudnessAnalyzer`, -HUGE_VALF for silence
+    float integratedLufs{NAN};
+    float truePeak{NAN};
+
+    inline bool isMeasured() const { return !std::isnan(integratedLufs); }
+};
+
+/*
+ * Metadata of a track that is shown without opening the file.
+ */
+struct TrackMetadata
+{
+    std::string title;
+    std::string artist;
+    std::string album;
+    std::string codecName;
+    int64_t durationMs{};
+    int64_t bitRate{};
+    int sampleRate{};
+    int channelCount{};
+    int audioStreamIndex{-1};
+    LoudnessInfo loudness;
+};
+
+/*
+ * A persistent index of track metadata, keyed by the file path.
+ * Every entry stores the identity (modification time and size) of the
+ * file it was made from, so outdated entries can be detected.
+ *
+ * The file is memory-mapped and searched in place, loading only validates
+ * the header, so it takes the same time for any number of tracks.
+ * New and changed entries are kept in memory until `save()`.
+ *
+ * File layout (native byte order, it is a local cache):
+ *   FileHeader
+ *   FileEntry * entryCount, sorted by path hash
+ *   string table, referenced by offset and length from the entries
+ *
+ * Every function is thread safe.
+ */
+class LibraryIndex final
+{
+private:
+    struct StringRef
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint64_t stringTableOffset;
+        uint64_t stringTableSize;
+    };
+
+    struct FileEntry
+    {
+        uint64_t pathHash;
+        StringRef path;
+        int64_t modificationTime;
+        uint64_t fileSize;
+        int64_t durationMs;
+        int64_t bitRate;
+        int32_t sampleRate;
+        int16_t channelCount;
+        int16_t audioStreamIndex;
+        StringRef title;
+        StringRef artist;
+        StringRef album;
+        StringRef codecName;
+        float trackGainDb;
+        float trackPeak;
+        float albumGainDb;
+        float albumPeak;
+        float integratedLufs;
+        float truePeak;
+    };
+
+    struct Entry
+    {
+        FileIdentity identity;
+        TrackMetadata metadata;
+    };
+
+    static constexpr char FILE_MAGIC[8]{'L', 'M', 'L', 'I', 'D', 'X', 0, 0};
+    static constexpr uint32_t FILE_VERSION{2};
+
+    mutable std::mutex m_mutex;
+    std::string m_path;
+
+    MappedFile m_file;
+    // Point into `m_file`
+    const FileEntry *m_fileEntries{};
+    size_t m_fileEntryCount{};
+    const char *m_stringTable{};
+    size_t m_stringTableSize{};
+
+    // Entries added or changed since the last save, they hide the ones in the file
+    std::unordered_map<std::string, Entry> m_changedEntries;
+
+    /*
+     * Find the entry of `path` in the mapped file.
+     * Returns nullptr if there is none.
+     */
+    const FileEntry* findFileEntry(const std::string &path) const;
+    std::string getString(StringRef ref) const;
+    Entry toEntry(const FileEntry &fileEntry) const;
+
+    /*
+     * Find the entry of `path`. `m_mutex` must be held.
+     */
+    std::optional<Entry> findEntry(const std::string &path) const;
+
+public:
+    LibraryIndex() {}
+    LibraryIndex(const LibraryIndex&) = delete;
+    LibraryIndex(LibraryIndex&&) = delete;
+    LibraryIndex& operator=(const LibraryIndex&) = delete;
+    LibraryIndex& operator=(LibraryIndex&&) = delete;
+
+    /*
+     * Map the index file at `path`. `save()` writes there too.
+     * A missing file is not an error, the index is empty then.
+     *
+     * Returns 0 if succeeded, nonzero if the file is invalid.
+     */
+    int load(const std::string &path);
+
+    /*
+     * Write the index to the file it was loaded from and map the new file.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int save();
+
+    /*
+     * Return the stored metadata of the file without accessing the file,
+     * so it may be outdated.
+     */
+    std::optional<TrackMetadata> find(const std::string &path) const;
+
+    /*
+     * Return the stored metadata of the file if it was
+     * made from the current version of the file.
+     */
+    std::optional<TrackMetadata> findIfUpToDate(const std::string &path) const;
+
+    /*
+     * Add or replace the entry of the file.
+     * If `metadata` has no measured loudness, the measurement of the
+     * old entry is kept if it was made from the same version of the file.
+     */
+    void update(
+            const std::string &path,
+            const FileIdentity &identity,
+            const TrackMetadata &metadata);
+
+    /*
+     * Return the number of files in the index.
+     */
+    size_t getEntryCount() const;
+
+    /*
+     * Return the path of the index in the cache directory.
+     */
+    static std::string getDefaultPath();
+
+    /*
+     * FNV-1a hash of a path. Also names the per-file caches.
+     */
+    static uint64_t hashPath(const std::string &path);
+};
@@ -0,0 +1,179 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LoudnessAnalyzer.h"
+#include "LoudnessMeter.h"
+#include "AudioFileDecoder.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+}
+
+LoudnessAnalyzer::LoudnessAnalyzer(LibraryIndex *libraryIndex)
+    : m_libraryIndex{libraryIndex}
+{
+}
+
+void LoudnessAnalyzer::start(unsigned threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    m_isStopRequested = false;
+    m_isCancelRequested = false;
+    for (unsigned i{}; i < threadCount; ++i)
+        m_workers.emplace_back(&LoudnessAnalyzer::workerLoop, this);
+}
+
+void LoudnessAnalyzer::enqueue(const std::vector<std::string> &paths)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_queueMutex};
+        m_queue.insert(m_queue.end(), paths.begin(), paths.end());
+    }
+    m_queueCv.notify_all();
+}
+
+static float s_getChannelWeight(uint64_t channel)
+{
+    switch (channel)
+    {
+    case AV_CH_LOW_FREQUENCY:
+        return LoudnessMeter::WEIGHT_LFE;
+
+    case AV_CH_BACK_LEFT:
+    case AV_CH_BACK_RIGHT:
+    case AV_CH_SIDE_LEFT:
+    case AV_CH_SIDE_RIGHT:
+        return LoudnessMeter::WEIGHT_SURROUND;
+
+    default:
+        return LoudnessMeter::WEIGHT_NORMAL;
+    }
+}
+
+int LoudnessAnalyzer::analyzeFile(
+        const std::string &path,
+        TrackMetadata &output,
+        const std::atomic<bool> *isCancelled)
+{
+    AudioFileDecoder decoder;
+    if (decoder.open(path))
+        return 1;
+
+    LoudnessMeter meter{decoder.getSampleRate(), decoder.getChannelCount()};
+    for (int i{}; i < decoder.getChannelCount(); ++i)
+    {
+        meter.setChannelWeight(i, s_getChannelWeight(
+                    av_channel_layout_extract_channel(decoder.getChannelLayout(), i)));
+    }
+
+    if (decoder.decode([&meter](const float *samples, size_t frames){
+                meter.addFrames(samples, frames);
+            }, isCancelled))
+        return 1;
+
+    output = decoder.readMetadata();
+    output.loudness.integratedLufs = (float)meter.getIntegratedLoudness();
+    output.loudness.truePeak = (float)meter.getTruePeak();
+    return 0;
+}
+
+void LoudnessAnalyzer::workerLoop()
+{
+#ifdef __linux__
+    // Only use the time nothing else wants
+    sched_param param{};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param))
+        std::cerr << "Failed to lower the priority of a loudness analyzer thread" << '\n';
+#endif
+
+    while (true)
+    {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock{m_queueMutex};
+            m_queueCv.wait(lock, [this](){ return m_isStopRequested || !m_queue.empty(); });
+            if (m_isStopRequested)
+                break;
+            path = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        // Measured already or the file has a tag to use
+        const std::optional<TrackMetadata> indexed{m_libraryIndex->findIfUpToDate(path)};
+        if (indexed && (indexed->loudness.isMeasured()
+                    || !std::isnan(indexed->loudness.trackGainDb)))
+            continue;
+
+        FileIdentity identity;
+        if (FileIdentity::get(path, identity))
+            continue;
+
+        TrackMetadata metadata;
+        if (analyzeFile(path, metadata, &m_isCancelRequested))
+        {
+            if (!m_isCancelRequested)
+                std::cerr << "Failed to analyze the loudness of " << path << '\n';
+            continue;
+        }
+
+        m_libraryIndex->update(path, identity, metadata);
+        ++m_analyzedCount;
+    }
+}
+
+void LoudnessAnalyzer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_queueMutex};
+        m_isStopRequested = true;
+        m_queue.clear();
+    }
+    m_isCancelRequested = true;
+    m_queueCv.notify_all();
+
+    for (auto &worker : m_workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+    m_workers.clear();
+}
+
+LoudnessAnalyzer::~LoudnessAnalyzer()
+{
+    stop();
+}
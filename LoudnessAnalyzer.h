@@ -0,0 +1,114 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "LibraryIndex.h"
+
+/*
+ * Measures the loudness of tracks (see `LoudnessMeter`) on a pool of
+ * worker threads and stores the results in the library index, where the
+ * playlist finds them to calculate the ReplayGain.
+ *
+ * The workers run with the lowest scheduling priority (`SCHED_IDLE` on
+ * Linux), so they only use the CPU time the player and the rest of the
+ * system leave unused. Every worker decodes its own file.
+ *
+ * Files that have an up-to-date measurement or a ReplayGain tag are skipped.
+ */
+class LoudnessAnalyzer final
+{
+private:
+    LibraryIndex *m_libraryIndex{};
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCv;
+    std::deque<std::string> m_queue;
+    // Guarded by `m_queueMutex`
+    bool m_isStopRequested{};
+    std::atomic<bool> m_isCancelRequested{};
+
+    std::atomic<size_t> m_analyzedCount{};
+
+    void workerLoop();
+
+public:
+    /*
+     * `libraryIndex` receives the results, it must not be nullptr.
+     */
+    LoudnessAnalyzer(LibraryIndex *libraryIndex);
+    LoudnessAnalyzer(const LoudnessAnalyzer&) = delete;
+    LoudnessAnalyzer(LoudnessAnalyzer&&) = delete;
+    LoudnessAnalyzer& operator=(const LoudnessAnalyzer&) = delete;
+    LoudnessAnalyzer& operator=(LoudnessAnalyzer&&) = delete;
+
+    /*
+     * Start `threadCount` workers, one per CPU core if it is 0.
+     * They wait for files when the queue is empty.
+     */
+    void start(unsigned threadCount=0);
+
+    /*
+     * Queue files for analysis. Thread safe.
+     */
+    void enqueue(const std::vector<std::string> &paths);
+
+    /*
+     * Stop the workers as soon as possible and wait for them.
+     * The file being analyzed is dropped.
+     */
+    void stop();
+
+    /*
+     * Return the number of files measured since the start.
+     */
+    inline size_t getAnalyzedCount() const { return m_analyzedCount; }
+
+    /*
+     * Decode the file and measure its loudness. `output` gets the metadata
+     * of the file with the measurement. Stops early if `isCancelled`
+     * becomes true.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    static int analyzeFile(
+            const std::string &path,
+            TrackMetadata &output,
+            const std::atomic<bool> *isCancelled=nullptr);
+
+    ~LoudnessAnalyzer();
+};
@@ -0,0 +1,197 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LoudnessMeter.h"
+#include <cmath>
+#include <algorithm>
+
+LoudnessMeter::LoudnessMeter(int sampleRate, int channels)
+    : m_sampleRate{sampleRate}, m_channels{channels}
+{
+    m_channelWeights.assign(channels, WEIGHT_NORMAL);
+    m_shelfStates.resize(channels);
+    m_highPassStates.resize(channels);
+
+    // The K-weighting filters of BS.1770 are given for 48 kHz, these
+    // are the analog prototypes they come from, so any rate works
+    {
+        const double f0{1681.974450955533};
+        const double gainDb{3.999843853973347};
+        const double q{0.7071752369554196};
+        const double k{std::tan(M_PI * f0 / sampleRate)};
+        const double vh{std::pow(10.0, gainDb / 20.0)};
+        const double vb{std::pow(vh, 0.4996667741545416)};
+        const double a0{1.0 + k / q + k * k};
+        m_shelfFilter.b0 = (vh + vb * k / q + k * k) / a0;
+        m_shelfFilter.b1 = 2.0 * (k * k - vh) / a0;
+        m_shelfFilter.b2 = (vh - vb * k / q + k * k) / a0;
+        m_shelfFilter.a1 = 2.0 * (k * k - 1.0) / a0;
+        m_shelfFilter.a2 = (1.0 - k / q + k * k) / a0;
+    }
+    {
+        const double f0{38.13547087602444};
+        const double q{0.5003270373238773};
+        const double k{std::tan(M_PI * f0 / sampleRate)};
+        const double a0{1.0 + k / q + k * k};
+        m_highPassFilter.b0 = 1.0;
+        m_highPassFilter.b1 = -2.0;
+        m_highPassFilter.b2 = 1.0;
+        m_highPassFilter.a1 = 2.0 * (k * k - 1.0) / a0;
+        m_highPassFilter.a2 = (1.0 - k / q + k * k) / a0;
+    }
+
+    m_subBlockFrames = std::max<size_t>(1, std::lround(sampleRate / 10.0));
+
+    // Oversample to at least 192 kHz
+    m_oversampling = sampleRate < 96000 ? 4 : (sampleRate < 192000 ? 2 : 1);
+    if (m_oversampling > 1)
+    {
+        // Windowed sinc, cut off at the original Nyquist frequency
+        const int length{TRUE_PEAK_TAPS * m_oversampling};
+        const double center{(length - 1) / 2.0};
+        std::vector<double> prototype(length);
+        for (int i{}; i < length; ++i)
+        {
+            const double x{(i - center) / m_oversampling};
+            const double sinc{x == 0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x)};
+            const double window{0.5 - 0.5 * std::cos(2.0 * M_PI * (i + 0.5) / length)};
+            prototype[i] = sinc * window;
+        }
+
+        // Split it to phases, every phase passes DC with unity gain
+        m_interpolationCoeffs.resize(length);
+        for (int phase{}; phase < m_oversampling; ++phase)
+        {
+            double sum{};
+            for (int tap{}; tap < TRUE_PEAK_TAPS; ++tap)
+                sum += prototype[tap * m_oversampling + phase];
+            for (int tap{}; tap < TRUE_PEAK_TAPS; ++tap)
+                m_interpolationCoeffs[phase * TRUE_PEAK_TAPS + tap]
+                    = (float)(prototype[tap * m_oversampling + phase] / sum);
+        }
+        m_peakHistory.resize(channels * TRUE_PEAK_TAPS);
+    }
+}
+
+void LoudnessMeter::addFrames(const float *samples, size_t frames)
+{
+    const Biquad &shelf{m_shelfFilter};
+    const Biquad &highPass{m_highPassFilter};
+
+    for (size_t frame{}; frame < frames; ++frame)
+    {
+        for (int ch{}; ch < m_channels; ++ch)
+        {
+            const float sample{samples[frame * m_channels + ch]};
+            m_truePeak = std::max(m_truePeak, std::abs(sample));
+
+            // The two stages of the K-weighting
+            BiquadState &shelfState{m_shelfStates[ch]};
+            const double shelfOut{shelf.b0 * sample + shelfState.z1};
+            shelfState.z1 = shelf.b1 * sample - shelf.a1 * shelfOut + shelfState.z2;
+            shelfState.z2 = shelf.b2 * sample - shelf.a2 * shelfOut;
+
+            BiquadState &highPassState{m_highPassStates[ch]};
+            const double weighted{highPass.b0 * shelfOut + highPassState.z1};
+            highPassState.z1 = highPass.b1 * shelfOut - highPass.a1 * weighted + highPassState.z2;
+            highPassState.z2 = highPass.b2 * shelfOut - highPass.a2 * weighted;
+
+            m_subBlockSum += m_channelWeights[ch] * weighted * weighted;
+
+            if (m_oversampling > 1)
+            {
+                float *history{m_peakHistory.data() + ch * TRUE_PEAK_TAPS};
+                std::copy_backward(history, history + TRUE_PEAK_TAPS - 1, history + TRUE_PEAK_TAPS);
+                history[0] = sample;
+
+                for (int phase{}; phase < m_oversampling; ++phase)
+                {
+                    const float *coeffs{m_interpolationCoeffs.data() + phase * TRUE_PEAK_TAPS};
+                    float interpolated{};
+                    for (int tap{}; tap < TRUE_PEAK_TAPS; ++tap)
+                        interpolated += coeffs[tap] * history[tap];
+                    m_truePeak = std::max(m_truePeak, std::abs(interpolated));
+                }
+            }
+        }
+
+        if (++m_subBlockFramesDone == m_subBlockFrames)
+            processSubBlockEnd();
+    }
+}
+
+void LoudnessMeter::processSubBlockEnd()
+{
+    m_lastSubBlocks[m_subBlockCount % 4] = m_subBlockSum;
+    ++m_subBlockCount;
+    m_subBlockSum = 0;
+    m_subBlockFramesDone = 0;
+
+    // A new 400 ms block every 100 ms
+    if (m_subBlockCount >= 4)
+    {
+        const double sum{m_lastSubBlocks[0] + m_lastSubBlocks[1]
+            + m_lastSubBlocks[2] + m_lastSubBlocks[3]};
+        m_blockEnergies.push_back(sum / (4.0 * m_subBlockFrames));
+    }
+}
+
+double LoudnessMeter::getIntegratedLoudness() const
+{
+    // Loudness = -0.691 + 10 * log10(energy)
+    const double absoluteGate{std::pow(10.0, (-70.0 + 0.691) / 10.0)};
+
+    double sum{};
+    size_t count{};
+    for (double energy : m_blockEnergies)
+    {
+        if (energy > absoluteGate)
+        {
+            sum += energy;
+            ++count;
+        }
+    }
+    if (count == 0)
+        return -HUGE_VAL;
+
+    // 10 LU below the mean of the blocks above the absolute gate
+    const double gate{std::max(absoluteGate, sum / count / 10.0)};
+    sum = 0;
+    count = 0;
+    for (double energy : m_blockEnergies)
+    {
+        if (energy > gate)
+        {
+            sum += energy;
+            ++count;
+        }
+    }
+    if (count == 0)
+        return -HUGE_VAL;
+    return -0.691 + 10.0 * std::log10(sum / count);
+}
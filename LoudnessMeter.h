@@ -0,0 +1,132 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Measures the integrated loudness and the true peak of a signal
+ * as described in EBU R128 and ITU-R BS.1770-4.
+ *
+ * The samples are K-weighted (a high shelf and a high-pass biquad), the
+ * mean square of every 400 ms block (overlapping by 75%) is weighted by
+ * channel and summed. The integrated loudness is the mean of the blocks
+ * above the absolute gate (-70 LUFS) and the relative gate (10 LU below
+ * the mean of the blocks above the absolute gate).
+ *
+ * The true peak is the largest absolute value of the signal oversampled
+ * to at least 192 kHz with a polyphase interpolation filter.
+ */
+class LoudnessMeter final
+{
+public:
+    // The weight of a channel, see `setChannelWeight()`
+    static constexpr float WEIGHT_NORMAL{1.0f};
+    static constexpr float WEIGHT_SURROUND{1.41f};
+    static constexpr float WEIGHT_LFE{0.0f};
+
+private:
+    struct Biquad
+    {
+        double b0{}, b1{}, b2{}, a1{}, a2{};
+    };
+    // State of a biquad for a channel (direct form II)
+    struct BiquadState
+    {
+        double z1{}, z2{};
+    };
+
+    int m_sampleRate{};
+    int m_channels{};
+    std::vector<float> m_channelWeights;
+
+    Biquad m_shelfFilter;
+    Biquad m_highPassFilter;
+    std::vector<BiquadState> m_shelfStates;
+    std::vector<BiquadState> m_highPassStates;
+
+    // Number of frames in a 100 ms sub-block
+    size_t m_subBlockFrames{};
+    size_t m_subBlockFramesDone{};
+    // Weighted sum of squares of the current sub-block
+    double m_subBlockSum{};
+    // The last four sub-blocks, a block is their sum
+    double m_lastSubBlocks[4]{};
+    size_t m_subBlockCount{};
+    // Mean square of every 400 ms block
+    std::vector<double> m_blockEnergies;
+
+    // Oversampling factor of the true peak measurement
+    int m_oversampling{};
+    // Coefficients of the interpolation filter, phase by phase
+    std::vector<float> m_interpolationCoeffs;
+    // The last `TRUE_PEAK_TAPS` samples of every channel, newest first
+    std::vector<float> m_peakHistory;
+    float m_truePeak{};
+
+    void processSubBlockEnd();
+
+public:
+    // Taps of every phase of the interpolation filter
+    static constexpr int TRUE_PEAK_TAPS{12};
+
+    /*
+     * Prepare to measure a signal of `channels` channels. Every channel
+     * has the normal weight.
+     */
+    LoudnessMeter(int sampleRate, int channels);
+    LoudnessMeter(const LoudnessMeter&) = delete;
+    LoudnessMeter(LoudnessMeter&&) = delete;
+    LoudnessMeter& operator=(const LoudnessMeter&) = delete;
+    LoudnessMeter& operator=(LoudnessMeter&&) = delete;
+
+    /*
+     * Set the weight of a channel, 1.41 for the surround channels and
+     * 0 for the LFE.
+     */
+    inline void setChannelWeight(int channel, float weight) { m_channelWeights[channel] = weight; }
+
+    /*
+     * Measure interleaved samples, full scale is 1.0.
+     */
+    void addFrames(const float *samples, size_t frames);
+
+    /*
+     * Return the integrated loudness in LUFS, -HUGE_VAL if everything
+     * measured so far is below the absolute gate (silence).
+     */
+    double getIntegratedLoudness() const;
+
+    /*
+     * Return the true peak, 1.0 is full scale.
+     */
+    inline float getTruePeak() const { return m_truePeak; }
+};
@@ -36,13 +36,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <filesystem>
 #include <sstream>
 #include <iomanip>
+#include <cctype>
+#include <algorithm>
 #include <FL/Enumerations.H>
 #include <FL/Fl_PNG_Image.H>
 #include <FL/fl_ask.H>
 #include <FL/Fl_File_Chooser.H>
 
-MainWindow::MainWindow(int w, int h, const char *title, Playlist *playlistPtr)
-    : Fl_Double_Window(w, h, title), m_playlistPtr{playlistPtr}
+// Height of the spectrum panel, taken from the track info
+static constexpr int SPECTRUM_VIEW_H{100};
+
+MainWindow::MainWindow(int w, int h, const char *title, PlaybackEngine *enginePtr, bool isSpectrumShown)
+    : Fl_Double_Window(w, h, title),
+    m_enginePtr{enginePtr}, m_playlistPtr{enginePtr->getPlaylist()}, m_title{title}
 {
     color(FL_BLACK);
     begin();
@@ -59,9 +65,8 @@ MainWindow::MainWindow(int w, int h, const char *title, Playlist *playlistPtr)
     m_trackInfoW->set_output();
     m_trackInfoW->end();
 
-    m_playlistW = new Fl_Select_Browser{
+    m_playlistW = new PlaylistView{
             m_trackInfoW->w(), 0, w-m_trackInfoW->w(), m_trackInfoW->h()};
-    m_playlistW->end();
     m_playlistW->textcolor(TEXT_COLOR);
     m_playlistW->color(BACKGROUND_COLOR);
     m_playlistW->selection_color(FL_GRAY);
@@ -71,6 +76,13 @@ MainWindow::MainWindow(int w, int h, const char *title, Playlist *playlistPtr)
         m_playlistW->array()[i]->color2(BUTTON_COLOR);
     }
     m_playlistW->callback(&s_playlistWidget_cb, this);
+    m_playlistW->setRowTextGetter(
+            [this](size_t firstRow, size_t rowCount, std::vector<std::string> &output){
+                auto lock{m_playlistPtr->lockTrackList()};
+                const size_t endRow{std::min(firstRow+rowCount, m_playlistPtr->getNumOfTracks())};
+                for (size_t i{firstRow}; i < endRow; ++i)
+                    output.push_back(getPlaylistRowText(i));
+            });
 
     //-------------------------------------------------------------------------
 
@@ -112,6 +124,14 @@ MainWindow::MainWindow(int w, int h, const char *title, Playlist *playlistPtr)
     m_shufflePlaylistBtn->color(BUTTON_COLOR);
     m_shufflePlaylistBtn->callback(&s_shufflePlaylistBtn_cb, this);
 
+    m_importDirBtn = new Fl_Button{
+            m_playlistBtnGrp->x()+80, m_playlistBtnGrp->y(), 20, 20};
+    m_importDirBtn->copy_label("@fileopen");
+    m_importDirBtn->copy_tooltip("Add directory to playlist...");
+    m_importDirBtn->labelcolor(FL_YELLOW);
+    m_importDirBtn->color(BUTTON_COLOR);
+    m_importDirBtn->callback(&s_importDirBtn_cb, this);
+
     m_playlistBtnGrp->end();
 
     //-------------------------------------------------------------------------
@@ -171,7 +191,7 @@ MainWindow::MainWindow(int w, int h, const char *title, Playlist *playlistPtr)
     m_timeLabel->textcolor(FL_GREEN);
     m_timeLabelBuffer->text("00:00:00/00:00:00");
 
-    m_progressBar = new Fl_Hor_Nice_Slider{
+    m_progressBar = new WaveformSlider{
             m_ctrlBtnGrp->w()+10, m_trackInfoW->h()+m_playlistBtnGrp->h()+35,
             w-m_ctrlBtnGrp->w()-20, 20};
     m_progressBar->color(BUTTON_COLOR);
@@ -181,11 +201,52 @@ MainWindow::MainWindow(int w, int h, const char *title, Playlist *playlistPtr)
 
     //-------------------------------------------------------------------------
 
+    //--------------------------- Spectrum analyzer ---------------------------
+
+    if (isSpectrumShown)
+    {
+        m_pcmTap = std::make_unique<PcmTap>();
+        m_spectrumAnalyzer = std::make_unique<SpectrumAnalyzer>(
+                m_pcmTap.get(), [this](){ queueSpectrumRedraw(); });
+
+        // Below the track info, which gets shorter
+        m_trackInfoW->resize(m_trackInfoW->x(), m_trackInfoW->y(),
+                m_trackInfoW->w(), m_trackInfoW->h()-SPECTRUM_VIEW_H);
+        m_spectrumW = new SpectrumView{
+                0, m_trackInfoW->h(), m_trackInfoW->w(), SPECTRUM_VIEW_H,
+                m_spectrumAnalyzer.get()};
+        m_spectrumW->color(BACKGROUND_COLOR);
+        m_spectrumW->color2(FL_GREEN);
+        m_spectrumW->selection_color(FL_YELLOW);
+    }
+
+    //-------------------------------------------------------------------------
+
     end();
 
+    if (m_spectrumAnalyzer)
+    {
+        m_playlistPtr->getAudioOutput()->setPcmTap(m_pcmTap.get());
+        m_spectrumAnalyzer->start();
+    }
+
     m_playPauseBtn->take_focus();
 
-    Fl::add_idle(s_tickMusic, this);
+    m_importer = std::make_unique<DirectoryImporter>(
+            [enginePtr](std::vector<std::string> &&paths){
+                enginePtr->post([paths{std::move(paths)}](Playlist &playlist){
+                    const bool wasEmpty{playlist.getNumOfTracks() == 0};
+                    playlist.addNewTracks(paths);
+                    if (wasEmpty)
+                        playlist.startPlaying();
+                });
+            });
+
+    m_waveformLoader = std::make_unique<WaveformLoader>([this](){ queueGuiUpdate(); });
+
+    // Update the GUI when the engine publishes a change, the first
+    // update shows the initial state
+    m_enginePtr->setStateChangeCallback([this](){ queueGuiUpdate(); });
     Fl::add_timeout(0, s_updateGui, this);
 
     auto icon{std::make_unique<Fl_PNG_Image>("img/icon.png")};
@@ -197,16 +258,6 @@ MainWindow::MainWindow(int w, int h, const char *title, Playlist *playlistPtr)
     resizable(m_playlistW);
 }
 
-void MainWindow::tickMusic()
-{
-    if (!m_playlistPtr->hasEnded())
-        m_playlistPtr->tickCurrentTrack();
-
-    // If not playing, don't hog the CPU
-    if (!m_playlistPtr->isPlaying())
-        SysSpecific::wait(0.1);
-}
-
 static std::string timeToString(int64_t timeInSeconds)
 {
     std::stringstream ss;
@@ -218,105 +269,246 @@ static std::string timeToString(int64_t timeInSeconds)
     return ss.str();
 }
 
-void MainWindow::updateGui()
+std::string MainWindow::getPlaylistRowText(size_t index) const
+{
+    const auto metadata{m_playlistPtr->getTrackMetadataAt(index)};
+    // Known from the library index, no need to open the file
+    if (metadata && !metadata->title.empty())
+    {
+        std::string text;
+        if (!metadata->artist.empty())
+            text += metadata->artist + " - ";
+        text += metadata->title;
+        text += " [" + timeToString(metadata->durationMs / 1000) + "]";
+        return text;
+    }
+
+    const std::string trackFilepath{m_playlistPtr->getTrackFilepathAt(index)};
+    std::string text{trackFilepath.substr(trackFilepath.find_last_of('/')+1)};
+    if (metadata)
+        text += " [" + timeToString(metadata->durationMs / 1000) + "]";
+    return text;
+}
+
+void MainWindow::updatePlaylistView()
 {
-    if (m_playlistPtr->isPlaylistChangedSinceLastTime())
+    // Don't lock the playlist if it didn't change
+    if (m_enginePtr->getPlaylistSequence() != m_playlistSequence)
     {
-        m_playlistW->clear();
+        auto lock{m_playlistPtr->lockTrackList()};
 
-        for (size_t i{}; i < m_playlistPtr->getNumOfTracks(); ++i)
+        // The rows are pulled by the widget when it draws the visible ones,
+        // only tell it which rows changed
+        m_playlistChanges.clear();
+        if (m_playlistPtr->getJournal().readSince(m_playlistSequence, m_playlistChanges)
+                == PlaylistJournal::READRESULT_RESYNC)
         {
-            const std::string trackFilepath{
-                m_playlistPtr->getTrackFilepathAt(i)};
-            const std::string trackFilename{
-                trackFilepath.substr(trackFilepath.find_last_of('/')+1)};
+            m_playlistW->setRowCount(m_playlistPtr->getNumOfTracks());
+        }
+        else
+        {
+            for (const auto &change : m_playlistChanges)
+            {
+                switch (change.type)
+                {
+                case PlaylistChange::TYPE_INSERT:
+                    m_playlistW->rowsInserted(change.index, change.count);
+                    break;
+                case PlaylistChange::TYPE_REMOVE:
+                    m_playlistW->rowsRemoved(change.index, change.count);
+                    break;
+                case PlaylistChange::TYPE_MOVE:
+                    m_playlistW->rowsChanged(
+                            std::min(change.index, change.toIndex),
+                            std::max(change.index, change.toIndex));
+                    break;
+                case PlaylistChange::TYPE_PERMUTE:
+                    m_playlistW->setRowCount(change.count);
+                    break;
+                case PlaylistChange::TYPE_CURRENT_INDEX:
+                    break;
+                }
+            }
+        }
+        m_playlistSequence = m_playlistPtr->getJournal().getLatestSequence();
+    }
+
+    m_playlistW->setCurrentRow(m_enginePtr->getCurrentTrackIndex());
+}
 
-            m_playlistW->add(trackFilename.c_str());
+void MainWindow::updateWaveform(bool isTrackChanged)
+{
+    if (isTrackChanged)
+    {
+        std::string path;
+        {
+            auto lock{m_playlistPtr->lockTrackList()};
+            if (m_shownTrackInfo && !m_playlistPtr->hasEnded())
+                path = m_playlistPtr->getCurrentTrackName();
+        }
+        // Reopening the same track keeps the waveform
+        if (path != m_waveformPath)
+        {
+            m_waveformPath = path;
+            m_progressBar->setWaveform(nullptr);
+            if (path.empty())
+                m_waveformLoader->cancel();
+            else
+                m_waveformLoader->request(path);
         }
     }
-    if (!m_playlistW->selected(m_playlistPtr->getCurrentTrackIndex()+1))
-        m_playlistW->select(m_playlistPtr->getCurrentTrackIndex()+1);
 
-    auto currentTrack{m_playlistPtr->getCurrentTrack()};
+    // The loader wakes us up when it's done
+    std::string loadedPath;
+    auto waveform{m_waveformLoader->takeResult(loadedPath)};
+    if (waveform && loadedPath == m_waveformPath)
+        m_progressBar->setWaveform(std::move(waveform));
+}
+
+void MainWindow::updateGui()
+{
+    // Changes after this point wake us up again
+    m_isUpdateQueued = false;
+
+    updatePlaylistView();
 
-    m_timeLabelBuffer->text((
-             timeToString(currentTrack->getCurrentTimestampS()) +
-             "/" +
-             timeToString(currentTrack->getDurationS())).c_str());
+    // Only touch the widgets whose value changed, so they are not redrawn
+    const int64_t timestampS{m_enginePtr->getCurrentTimestampS()};
+    const int64_t durationS{m_enginePtr->getDurationS()};
+    if (timestampS != m_shownTimestampS || durationS != m_shownDurationS)
+    {
+        m_timeLabelBuffer->text((
+                 timeToString(timestampS) +
+                 "/" +
+                 timeToString(durationS)).c_str());
+
+        m_progressBar->maximum(durationS);
+        m_progressBar->value(timestampS);
 
-    m_progressBar->maximum(currentTrack->getDurationS());
-    m_progressBar->value(currentTrack->getCurrentTimestampS());
+        m_shownTimestampS = timestampS;
+        m_shownDurationS = durationS;
+    }
 
-    std::string trackInfoBuffer;
-    trackInfoBuffer += currentTrack->getFileInfo();
-    trackInfoBuffer += "Aud. stream:\n";
-    trackInfoBuffer += currentTrack->getAudioStreamInfo();
+    auto trackInfo{m_enginePtr->getTrackInfo()};
+    const bool isTrackChanged{trackInfo != m_shownTrackInfo};
+    if (isTrackChanged)
+    {
+        std::string trackInfoBuffer;
+        trackInfoBuffer += trackInfo ? trackInfo->fileInfo : "N/A\n";
+        trackInfoBuffer += "Aud. stream:\n";
+        trackInfoBuffer += trackInfo ? trackInfo->audioStreamInfo : "    N/A\n";
         m_trackInfoBuffer->text(trackInfoBuffer.c_str());
 
+        m_shownTrackInfo = std::move(trackInfo);
+    }
+
+    updateWaveform(isTrackChanged);
+
+    // Show the progress of the import in the title
+    if (m_importer->isBusy())
+    {
+        copy_label((m_title + " - Importing... ("
+                    + std::to_string(m_importer->getFoundCount()) + " files found)").c_str());
+        m_wasImporting = true;
+        // The importer doesn't notify us, check it again later
+        if (!Fl::has_timeout(s_updateGui, this))
+            Fl::add_timeout(0.5, s_updateGui, this);
+    }
+    else if (m_wasImporting)
+    {
+        copy_label(m_title.c_str());
+        m_wasImporting = false;
+    }
+
     // Update the stop button
-    if (m_stopBtn->active() && !m_playlistPtr->isPlaying())
+    if (m_stopBtn->active() && !m_enginePtr->isPlaying())
         m_stopBtn->deactivate();
-    else if (!m_stopBtn->active() && m_playlistPtr->isPlaying())
+    else if (!m_stopBtn->active() && m_enginePtr->isPlaying())
         m_stopBtn->activate();
+}
+
+void MainWindow::queueGuiUpdate()
+{
+    // Many changes may come before the GUI thread wakes up,
+    // they are handled by a single update
+    if (!m_isUpdateQueued.exchange(true))
+        Fl::awake(s_updateGui, this);
+}
 
-    Fl::repeat_timeout(0.5, s_updateGui, this);
+void MainWindow::redrawSpectrum()
+{
+    // Frames after this point queue a new redraw
+    m_isSpectrumRedrawQueued = false;
+    m_spectrumW->redraw();
+}
+
+void MainWindow::queueSpectrumRedraw()
+{
+    if (!m_isSpectrumRedrawQueued.exchange(true))
+        Fl::awake(s_redrawSpectrum, this);
 }
 
 //--------------------- Play control button callbacks -------------------------
 
 void MainWindow::playPauseButton_cb()
 {
-    if (m_playlistPtr->isPlaying())
+    if (m_enginePtr->isPlaying())
     {
-        m_playlistPtr->pauseCurrentTrack();
+        m_enginePtr->post([](Playlist &playlist){
+            playlist.pauseCurrentTrack();
+        });
 
         setPlayPauseButtonToPlay();
     }
     else
     {
-        m_playlistPtr->unpauseCurrentTrack();
+        m_enginePtr->post([](Playlist &playlist){
+            playlist.unpauseCurrentTrack();
+        });
         setPlayPauseButtonToPause();
     }
-    updateGui();
 }
 
 void MainWindow::prevTrackButton_cb()
 {
-    m_playlistPtr->jumpToPrevTrack();
+    m_enginePtr->post([](Playlist &playlist){
+        playlist.jumpToPrevTrack();
+    }, true);
     setPlayPauseButtonToPause();
-    updateGui();
 }
 
 void MainWindow::nextTrackButton_cb()
 {
-    m_playlistPtr->jumpToNextTrack();
+    m_enginePtr->post([](Playlist &playlist){
+        playlist.jumpToNextTrack();
+    }, true);
     setPlayPauseButtonToPause();
-    updateGui();
 }
 
 void MainWindow::stopButton_cb()
 {
-    m_playlistPtr->getCurrentTrack()->seekToS(0);
-    m_playlistPtr->tickCurrentTrack();
-    m_playlistPtr->pauseCurrentTrack();
+    m_enginePtr->post([](Playlist &playlist){
+        playlist.seekCurrentTrackToS(0);
+        playlist.pauseCurrentTrack();
+    }, true);
     setPlayPauseButtonToPlay();
-    updateGui();
 }
 
 //-----------------------------------------------------------------------------
 
 void MainWindow::playlistWidget_cb()
 {
-    int selectedLine{m_playlistW->value()};
-    if (selectedLine == 0) // If no line selected, don't change track
+    const size_t selectedRow{m_playlistW->getClickedRow()};
+    if (selectedRow == PlaylistView::NO_ROW) // If no row clicked, don't change track
         return;
 
-    m_playlistPtr->openTrackAtIndex(selectedLine-1);
+    m_enginePtr->post([selectedRow](Playlist &playlist){
+        playlist.openTrackAtIndex(selectedRow);
+    }, true);
 
-    // Hack: We first select line 1, so the next selection triggers the blue selection
-    m_playlistW->select(1);
-    // Select the track that could be opened
-    m_playlistW->select(m_playlistPtr->getCurrentTrackIndex() + 1);
+    // Highlight the clicked track, `updateGui()` moves the highlight
+    // if the track couldn't be opened
+    m_playlistW->setCurrentRow(selectedRow);
 
     // When clicking on a track, we start playing,
     // so update the play/pause button
@@ -325,25 +517,10 @@ void MainWindow::playlistWidget_cb()
 
 void MainWindow::progressBar_cb()
 {
-    m_playlistPtr->getCurrentTrack()->seekToS(m_progressBar->value());
-
-    // We tick the track to update the internal state, so
-    // updateGui() gets the actual timestamp, not the old one
-    if (!m_playlistPtr->isPlaying())
-    {
-        // Cannot tick if paused, so unpause
-        m_playlistPtr->unpauseCurrentTrack();
-        m_playlistPtr->tickCurrentTrack();
-        // Pause it, it was the original state
-        m_playlistPtr->pauseCurrentTrack();
-    }
-    else
-    {
-        m_playlistPtr->tickCurrentTrack();
-    }
-
-    // Update the `remaining time widget` and the progressbar
-    updateGui();
+    const double timestamp{m_progressBar->value()};
+    m_enginePtr->post([timestamp](Playlist &playlist){
+        playlist.seekCurrentTrackToS(timestamp);
+    }, true);
 }
 
 //--------------------- Playlist control button callbacks ---------------------
@@ -353,40 +530,99 @@ void MainWindow::addToPlaylistBtn_cb()
     auto filepath = fl_file_chooser("Select a file...", "", "*");
     if (filepath)
     {
-        m_playlistPtr->addNewTrack(filepath);
+        m_enginePtr->post([path=std::string{filepath}](Playlist &playlist){
+            playlist.addNewTrack(path);
 
-        // Open the newly added track
-        m_playlistPtr->openTrackAtIndex(m_playlistPtr->getNumOfTracks() - 1);
-
-        updateGui();
+            // Open the newly added track
+            playlist.openTrackAtIndex(playlist.getNumOfTracks() - 1);
+        }, true);
     }
 }
 
 void MainWindow::removeFromPlaylistBtn_cb()
 {
-    m_playlistPtr->removeTrack(m_playlistPtr->getCurrentTrackIndex());
-
-    updateGui();
+    m_enginePtr->post([](Playlist &playlist){
+        playlist.removeTrack(playlist.getCurrentTrackIndex());
+    }, true);
 }
 
 void MainWindow::clearPlaylistBtn_cb()
 {
-    m_playlistPtr->removeAllTracks();
-
-    updateGui();
+    m_enginePtr->post([](Playlist &playlist){
+        playlist.removeAllTracks();
+    }, true);
 }
 
 void MainWindow::shufflePlaylistBtn_cb()
 {
-    m_playlistPtr->shuffle();
+    m_enginePtr->post([](Playlist &playlist){
+        playlist.shuffle();
+    }, true);
+}
 
-    updateGui();
+void MainWindow::importDirBtn_cb()
+{
+    auto dirpath = fl_dir_chooser("Select a directory...", "");
+    if (dirpath)
+        m_importer->import({dirpath});
 }
 
 //-----------------------------------------------------------------------------
 
+void MainWindow::handleDroppedPaths(const std::string &text)
+{
+    std::vector<std::string> paths;
+    std::istringstream ss{text};
+    std::string line;
+    while (std::getline(ss, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+
+        // Some file managers drop URIs, decode them to paths
+        if (line.rfind("file://", 0) == 0)
+        {
+            std::string path;
+            for (size_t i{7}; i < line.size(); ++i)
+            {
+                if (line[i] == '%' && i+2 < line.size()
+                        && std::isxdigit((unsigned char)line[i+1])
+                        && std::isxdigit((unsigned char)line[i+2]))
+                {
+                    path += (char)std::stoi(line.substr(i+1, 2), nullptr, 16);
+                    i += 2;
+                }
+                else
+                {
+                    path += line[i];
+                }
+            }
+            line = std::move(path);
+        }
+        paths.push_back(std::move(line));
+    }
+
+    if (!paths.empty())
+        m_importer->import(paths);
+}
+
 int MainWindow::handle(int event)
 {
+    switch (event)
+    {
+    // Accept files dropped onto the window
+    case FL_DND_ENTER:
+    case FL_DND_DRAG:
+    case FL_DND_RELEASE:
+    case FL_DND_LEAVE:
+        return 1;
+    case FL_PASTE:
+        handleDroppedPaths({Fl::event_text(), (size_t)Fl::event_length()});
+        return 1;
+    }
+
     switch (Fl::event_key())
     {
     case FL_Escape:
@@ -419,5 +655,14 @@ void MainWindow::showAboutDialog()
 
 MainWindow::~MainWindow()
 {
+    // Stop the import before the engine goes away
+    m_importer.reset();
+    m_waveformLoader.reset();
+    if (m_spectrumAnalyzer)
+    {
+        m_playlistPtr->getAudioOutput()->setPcmTap(nullptr);
+        m_spectrumAnalyzer.reset();
+    }
+    m_enginePtr->setStateChangeCallback(nullptr);
 }
 
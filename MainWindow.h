@@ -29,15 +29,25 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
 #include <FL/Fl_Double_Window.H>
 #include <FL/Fl_Group.H>
-#include <FL/Fl_Select_Browser.H>
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Text_Buffer.H>
 #include <FL/Fl_Text_Display.H>
-#include <FL/Fl_Hor_Nice_Slider.H>
 #include "Playlist.h"
+#include "PlaybackEngine.h"
+#include "DirectoryImporter.h"
 #include "AboutWindow.h"
+#include "PlaylistView.h"
+#include "WaveformSlider.h"
+#include "WaveformLoader.h"
+#include "SpectrumView.h"
+#include "SpectrumAnalyzer.h"
+#include "PcmTap.h"
 
 /*
  *
@@ -48,13 +58,14 @@ private:
     Fl_Text_Buffer *m_trackInfoBuffer{};
     Fl_Text_Display *m_trackInfoW{};
 
-    Fl_Select_Browser *m_playlistW{};
+    PlaylistView *m_playlistW{};
 
     Fl_Group *m_playlistBtnGrp{};
     Fl_Button *m_addToPlaylistBtn{};
     Fl_Button *m_removeFromPlaylistBtn{};
     Fl_Button *m_clearPlaylistBtn{};
     Fl_Button *m_shufflePlaylistBtn{};
+    Fl_Button *m_importDirBtn{};
 
     Fl_Group  *m_ctrlBtnGrp{};
     Fl_Button *m_playPauseBtn{};
@@ -64,19 +75,84 @@ private:
 
     Fl_Text_Buffer *m_timeLabelBuffer{};
     Fl_Text_Display *m_timeLabel{};
-    Fl_Hor_Nice_Slider *m_progressBar{};
+    WaveformSlider *m_progressBar{};
 
+    PlaybackEngine *m_enginePtr{};
+    // Only read its track list while holding `lockTrackList()`,
+    // change it with `m_enginePtr->post()`
     Playlist *m_playlistPtr{};
 
+    // Sequence number of the last playlist change shown
+    uint64_t m_playlistSequence{};
+    // Reused buffer for reading the playlist changes
+    std::vector<PlaylistChange> m_playlistChanges;
+
     bool m_isAboutWindowShown{};
+    // The window title without the import status
+    std::string m_title;
+
+    // Adds the tracks of directories to the playlist in the background
+    std::unique_ptr<DirectoryImporter> m_importer;
+    bool m_wasImporting{};
+
+    // Gets the waveforms shown on the progress bar
+    std::unique_ptr<WaveformLoader> m_waveformLoader;
+    // Path of the track whose waveform is shown or being loaded
+    std::string m_waveformPath;
+
+    // The optional spectrum panel, nullptr if not shown
+    SpectrumView *m_spectrumW{};
+    // Gets the samples written to the output for the analyzer
+    std::unique_ptr<PcmTap> m_pcmTap;
+    std::unique_ptr<SpectrumAnalyzer> m_spectrumAnalyzer;
+    // Set when a redraw is requested with `Fl::awake()`, but not run yet
+    std::atomic<bool> m_isSpectrumRedrawQueued{};
 
     //-------------------------------------------------------------------------
 
-    static void s_tickMusic(void *t) { static_cast<MainWindow*>(t)->tickMusic(); }
-    void tickMusic();
+    // Values shown by the widgets, to only update the changed ones
+    int64_t m_shownTimestampS{-1};
+    int64_t m_shownDurationS{-1};
+    std::shared_ptr<const TrackInfo> m_shownTrackInfo;
+    // Set when an update is requested with `Fl::awake()`, but not run yet
+    std::atomic<bool> m_isUpdateQueued{};
 
     static void s_updateGui(void *t) { static_cast<MainWindow*>(t)->updateGui(); }
+    /*
+     * Show the state published by the engine.
+     * Run when the engine notifies a change, not periodically.
+     */
     void updateGui();
+    /*
+     * Feed the playlist changes to the playlist widget.
+     */
+    void updatePlaylistView();
+    /*
+     * Request the waveform of the current track if it changed,
+     * and show the waveform if it's ready.
+     */
+    void updateWaveform(bool isTrackChanged);
+    /*
+     * Request `updateGui()` on the GUI thread.
+     * Can be called from any thread.
+     */
+    void queueGuiUpdate();
+
+    static void s_redrawSpectrum(void *t) { static_cast<MainWindow*>(t)->redrawSpectrum(); }
+    void redrawSpectrum();
+    /*
+     * Request a redraw of the spectrum panel, frames that come before
+     * the GUI thread gets to it are dropped. Can be called from any thread.
+     */
+    void queueSpectrumRedraw();
+
+    /*
+     * Return the text shown in the playlist for a track.
+     * Uses the tags from the library index if there are any.
+     * The playlist must be locked.
+     * Only called for the visible rows.
+     */
+    std::string getPlaylistRowText(size_t index) const;
 
     inline void setPlayPauseButtonToPlay()
     {
@@ -155,12 +231,29 @@ private:
     }
     void shufflePlaylistBtn_cb();
 
+    static void s_importDirBtn_cb(Fl_Widget*, void *t)
+    {
+        static_cast<MainWindow*>(t)->importDirBtn_cb();
+    }
+    void importDirBtn_cb();
+
+    //-------------------------------------------------------------------------
+
+    /*
+     * Add the files or directories dropped onto the window.
+     * `text` is the pasted text, one path or file URI per line.
+     */
+    void handleDroppedPaths(const std::string &text);
+
     //-------------------------------------------------------------------------
 
     void showAboutDialog();
 
 public:
-    MainWindow(int w, int h, const char *title, Playlist *playlistPtr);
+    /*
+     * `isSpectrumShown` adds the spectrum analyzer panel below the track info.
+     */
+    MainWindow(int w, int h, const char *title, PlaybackEngine *enginePtr, bool isSpectrumShown=false);
     MainWindow(const MainWindow &other) = delete;
     MainWindow(MainWindow &&other) = delete;
     MainWindow& operator=(const MainWindow &other) = delete;
@@ -0,0 +1,118 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "MappedFile.h"
+#include <fstream>
+#include <iostream>
+
+#if defined(__linux__) || defined(__linux) || defined(__unix__) || defined(__unix)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define MAPPEDFILE_USE_MMAP
+#endif
+
+int MappedFile::open(const std::string &path, bool isFallbackAllowed)
+{
+    close();
+
+#ifdef MAPPEDFILE_USE_MMAP
+    const int fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0)
+        return 1;
+
+    struct stat fileStat{};
+    // Only regular files can be mapped, use the fallback for the others
+    if (fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+    {
+        if (fileStat.st_size == 0)
+        {
+            ::close(fd);
+            m_isOpen = true;
+            return 0;
+        }
+
+        void *data{mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            std::cerr << "Failed to map file: " << path << '\n';
+            return 1;
+        }
+
+        m_data = (const uint8_t*)data;
+        m_size = fileStat.st_size;
+        m_isMapped = true;
+        m_isOpen = true;
+        return 0;
+    }
+    ::close(fd);
+#endif
+
+    if (!isFallbackAllowed)
+        return 1;
+
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+        return 1;
+    m_fallbackBuffer.assign(
+            std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+    m_data = m_fallbackBuffer.data();
+    m_size = m_fallbackBuffer.size();
+    m_isOpen = true;
+    return 0;
+}
+
+void MappedFile::close()
+{
+#ifdef MAPPEDFILE_USE_MMAP
+    if (m_isMapped)
+        munmap((void*)m_data, m_size);
+#endif
+
+    m_fallbackBuffer.clear();
+    m_fallbackBuffer.shrink_to_fit();
+    m_data = nullptr;
+    m_size = 0;
+    m_isMapped = false;
+    m_isOpen = false;
+}
+
+void MappedFile::adviseSequential()
+{
+#ifdef MAPPEDFILE_USE_MMAP
+    if (m_isMapped)
+        madvise((void*)m_data, m_size, MADV_SEQUENTIAL);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,84 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * A read-only view of a whole file.
+ * The file is memory-mapped where the platform supports it,
+ * otherwise it is read into memory.
+ */
+class MappedFile final
+{
+private:
+    const uint8_t *m_data{};
+    size_t m_size{};
+    bool m_isOpen{};
+    bool m_isMapped{};
+    // Holds the contents when the file couldn't be mapped
+    std::vector<uint8_t> m_fallbackBuffer;
+
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    /*
+     * Map the file at `path`. Closes the previously mapped file.
+     * If `isFallbackAllowed` is false, files that can't be mapped
+     * (pipes, devices, etc.) are not read into memory, but fail.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int open(const std::string &path, bool isFallbackAllowed=true);
+
+    /*
+     * Unmap the file.
+     */
+    void close();
+
+    /*
+     * Tell the OS that the mapping will be read from the beginning to the end,
+     * so it reads ahead aggressively.
+     */
+    void adviseSequential();
+
+    inline bool isOpen() const { return m_isOpen; }
+    inline const uint8_t* getData() const { return m_data; }
+    inline size_t getSize() const { return m_size; }
+    inline bool isMapped() const { return m_isMapped; }
+
+    ~MappedFile();
+};
@@ -0,0 +1,195 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "MappedInput.h"
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+extern "C"
+{
+#include <libavutil/mem.h>
+#include <libavutil/error.h>
+}
+
+namespace
+{
+
+// Size of the buffer libav reads into
+constexpr int IO_BUFFER_SIZE = 32 * 1024;
+
+}
+
+/*
+ * Return whether the file is on a local file system.
+ * Reading the mapping of a file that was shortened raises `SIGBUS`,
+ * that is much more likely on network and FUSE file systems (changed by
+ * another machine, connection lost), so those are read with syscalls.
+ */
+static bool s_isOnLocalFileSystem(const std::string &path)
+{
+#ifdef __linux__
+    struct statfs fsStat{};
+    if (statfs(path.c_str(), &fsStat))
+        return false;
+
+    switch ((unsigned long)fsStat.f_type)
+    {
+    case 0x6969:     // NFS
+    case 0x517b:     // SMB
+    case 0xfe534d42: // SMB2
+    case 0xff534d42: // CIFS
+    case 0x65735546: // FUSE (sshfs, rclone, etc.)
+    case 0x01021997: // 9P
+    case 0x00c36400: // Ceph
+    case 0x5346414f: // AFS
+    case 0x6b414653: // kAFS
+    case 0x47504653: // GPFS
+    case 0x0bd00bd0: // Lustre
+    case 0x013111a8: // IBRIX
+    case 0xaad7aaea: // PanFS
+    case 0x564c:     // NCP
+    case 0x73757245: // Coda
+        return false;
+    default:
+        return true;
+    }
+#else
+    // Can't tell, don't risk it
+    (void)path;
+    return false;
+#endif
+}
+
+int MappedInput::s_read(void *opaque, uint8_t *buffer, int bufferSize)
+{
+    MappedInput *input{(MappedInput*)opaque};
+
+    const int64_t remaining{(int64_t)input->m_file.getSize() - input->m_position};
+    if (remaining <= 0)
+        return AVERROR_EOF;
+
+    const int toRead{(int)std::min<int64_t>(bufferSize, remaining)};
+    std::memcpy(buffer, input->m_file.getData() + input->m_position, toRead);
+    input->m_position += toRead;
+    return toRead;
+}
+
+int64_t MappedInput::s_seek(void *opaque, int64_t offset, int whence)
+{
+    MappedInput *input{(MappedInput*)opaque};
+    const int64_t size{(int64_t)input->m_file.getSize()};
+
+    // The flag only tells that seeking is preferred over reading,
+    // seeking is free here anyway
+    whence &= ~AVSEEK_FORCE;
+
+    int64_t position{};
+    switch (whence)
+    {
+    case AVSEEK_SIZE:
+        return size;
+    case SEEK_SET:
+        position = offset;
+        break;
+    case SEEK_CUR:
+        position = input->m_position + offset;
+        break;
+    case SEEK_END:
+        position = size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    // Seeking past the end is allowed, the next read returns EOF
+    if (position < 0)
+        return AVERROR(EINVAL);
+    input->m_position = position;
+    return position;
+}
+
+int MappedInput::open(const std::string &path)
+{
+    close();
+
+    if (!s_isOnLocalFileSystem(path))
+        return 1;
+
+    // Empty files aren't mapped either, let libav report them
+    if (m_file.open(path, false) || !m_file.isMapped())
+    {
+        m_file.close();
+        return 1;
+    }
+    m_file.adviseSequential();
+
+    uint8_t *buffer{(uint8_t*)av_malloc(IO_BUFFER_SIZE)};
+    if (!buffer)
+    {
+        m_file.close();
+        return 1;
+    }
+    m_ioContext = avio_alloc_context(
+            buffer, IO_BUFFER_SIZE, 0, this, s_read, nullptr, s_seek);
+    if (!m_ioContext)
+    {
+        av_free(buffer);
+        m_file.close();
+        return 1;
+    }
+    m_position = 0;
+    return 0;
+}
+
+void MappedInput::attach(AVFormatContext *formatContext)
+{
+    formatContext->pb = m_ioContext;
+    // Tell libav not to close `m_ioContext`, we own it
+    formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+}
+
+void MappedInput::close()
+{
+    if (m_ioContext)
+    {
+        // libav may have replaced the buffer, free the current one
+        av_freep(&m_ioContext->buffer);
+        avio_context_free(&m_ioContext);
+    }
+    m_file.close();
+    m_position = 0;
+}
+
+MappedInput::~MappedInput()
+{
+    close();
+}
@@ -0,0 +1,88 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "MappedFile.h"
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+/*
+ * A libav I/O context that reads a local file through a memory mapping.
+ *
+ * The default file protocol of libav does a `read()` call for every
+ * buffer refill and an `lseek()` for every seek. This serves both from
+ * the mapping, so the kernel's readahead is the only I/O.
+ * Only regular files on local file systems are supported, the caller
+ * should let libav open pipes, special files and files on network shares.
+ */
+class MappedInput final
+{
+private:
+    MappedFile m_file;
+    AVIOContext *m_ioContext{};
+    // Read position in the mapping
+    int64_t m_position{};
+
+    static int s_read(void *opaque, uint8_t *buffer, int bufferSize);
+    static int64_t s_seek(void *opaque, int64_t offset, int whence);
+
+public:
+    MappedInput() {}
+    MappedInput(const MappedInput&) = delete;
+    MappedInput(MappedInput&&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+    MappedInput& operator=(MappedInput&&) = delete;
+
+    /*
+     * Map the file and create the I/O context. Closes the previous file.
+     *
+     * Returns 0 if succeeded, nonzero if the file can't or shouldn't be mapped.
+     */
+    int open(const std::string &path);
+
+    /*
+     * Let `formatContext` read through this. Call before `avformat_open_input()`.
+     * The I/O context must stay open until the format context is closed.
+     */
+    void attach(AVFormatContext *formatContext);
+
+    /*
+     * Free the I/O context and unmap the file.
+     * Call after closing the format context that used it.
+     */
+    void close();
+
+    inline bool isOpen() const { return m_ioContext; }
+
+    ~MappedInput();
+};
@@ -0,0 +1,170 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "MetadataScanner.h"
+#include "Music.h"
+#include <iostream>
+#include <utility>
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+MetadataScanner::MetadataScanner(
+        std::vector<std::string> paths,
+        LibraryIndex *libraryIndex,
+        ResultCallback resultCallback)
+    : m_paths{std::move(paths)}, m_libraryIndex{libraryIndex},
+    m_resultCallback{std::move(resultCallback)}
+{
+    m_results.resize(m_paths.size());
+}
+
+int MetadataScanner::probeFile(const std::string &path, TrackMetadata &output)
+{
+    AVFormatContext *formatContext{};
+    if (avformat_open_input(&formatContext, path.c_str(), nullptr, nullptr))
+        return 1;
+
+    if (avformat_find_stream_info(formatContext, nullptr) < 0)
+    {
+        avformat_close_input(&formatContext);
+        return 1;
+    }
+
+    const int audioStreamI{av_find_best_stream(
+            formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0)};
+    // No audio stream or no decoder for it
+    if (audioStreamI < 0
+            || !avcodec_find_decoder(formatContext->streams[audioStreamI]->codecpar->codec_id))
+    {
+        avformat_close_input(&formatContext);
+        return 1;
+    }
+
+    output = Music::readMetadata(formatContext, audioStreamI);
+    avformat_close_input(&formatContext);
+    return 0;
+}
+
+void MetadataScanner::start(unsigned threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    m_isCancelRequested = false;
+    m_workersRunning = threadCount;
+    for (unsigned i{}; i < threadCount; ++i)
+        m_workers.emplace_back(&MetadataScanner::workerLoop, this);
+}
+
+void MetadataScanner::workerLoop()
+{
+    while (!m_isCancelRequested)
+    {
+        const size_t pathI{m_nextPathI++};
+        if (pathI >= m_paths.size())
+            break;
+
+        Result result;
+        result.path = m_paths[pathI];
+
+        // Don't open the file if the index knows it already
+        std::optional<TrackMetadata> indexed;
+        if (m_libraryIndex)
+            indexed = m_libraryIndex->findIfUpToDate(result.path);
+
+        if (indexed)
+        {
+            result.isAudioFile = true;
+            result.metadata = std::move(*indexed);
+        }
+        else
+        {
+            FileIdentity identity;
+            result.isAudioFile = probeFile(result.path, result.metadata) == 0;
+            if (result.isAudioFile && m_libraryIndex
+                    && FileIdentity::get(result.path, identity) == 0)
+                m_libraryIndex->update(result.path, identity, result.metadata);
+        }
+
+        ++m_scannedCount;
+        storeResult(pathI, std::move(result));
+    }
+
+    // The last worker delivers the last, partial batch
+    std::lock_guard<std::mutex> lock{m_deliveryMutex};
+    if (--m_workersRunning == 0 && !m_pendingBatch.empty() && !m_isCancelRequested)
+    {
+        m_resultCallback(std::move(m_pendingBatch));
+        m_pendingBatch.clear();
+    }
+}
+
+void MetadataScanner::storeResult(size_t pathI, Result &&result)
+{
+    std::lock_guard<std::mutex> lock{m_deliveryMutex};
+
+    m_results[pathI] = std::move(result);
+
+    // Move the results that are now in order to the batch
+    while (m_nextResultToDeliverI < m_results.size()
+            && m_results[m_nextResultToDeliverI])
+    {
+        m_pendingBatch.push_back(std::move(*m_results[m_nextResultToDeliverI]));
+        m_results[m_nextResultToDeliverI].reset();
+        ++m_nextResultToDeliverI;
+
+        if (m_pendingBatch.size() >= RESULT_BATCH_SIZE && !m_isCancelRequested)
+        {
+            m_resultCallback(std::move(m_pendingBatch));
+            m_pendingBatch.clear();
+        }
+    }
+}
+
+void MetadataScanner::wait()
+{
+    for (auto &worker : m_workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+    m_workers.clear();
+}
+
+void MetadataScanner::cancel()
+{
+    m_isCancelRequested = true;
+    wait();
+}
+
+MetadataScanner::~MetadataScanner()
+{
+    cancel();
+}
@@ -0,0 +1,134 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <functional>
+#include "LibraryIndex.h"
+
+/*
+ * Reads the metadata of many files on a pool of worker threads.
+ *
+ * Every worker opens its own libav format context for the file it probes,
+ * so they don't share any libav state. Files that have an up-to-date entry
+ * in the library index are not opened at all.
+ *
+ * The results are delivered in the order of the input paths, in batches,
+ * while the scan is still running.
+ */
+class MetadataScanner final
+{
+public:
+    struct Result
+    {
+        std::string path;
+        // False if the file couldn't be opened or has no audio stream
+        bool isAudioFile{};
+        TrackMetadata metadata;
+    };
+
+    /*
+     * Called with the next batch of results, in the order of the input.
+     * Called on a worker thread, never on more threads at once.
+     */
+    using ResultCallback = std::function<void(std::vector<Result> &&batch)>;
+
+    // Number of results delivered at once (except the last batch)
+    static constexpr size_t RESULT_BATCH_SIZE{64};
+
+private:
+    std::vector<std::string> m_paths;
+    LibraryIndex *m_libraryIndex{};
+    ResultCallback m_resultCallback;
+
+    std::vector<std::thread> m_workers;
+    // Index of the next path a worker takes
+    std::atomic<size_t> m_nextPathI{};
+    std::atomic<size_t> m_scannedCount{};
+    std::atomic<size_t> m_workersRunning{};
+    std::atomic<bool> m_isCancelRequested{};
+
+    // Guards the delivery, keeps the results in order
+    std::mutex m_deliveryMutex;
+    std::vector<std::optional<Result>> m_results;
+    size_t m_nextResultToDeliverI{};
+    std::vector<Result> m_pendingBatch;
+
+    void workerLoop();
+    void storeResult(size_t pathI, Result &&result);
+
+public:
+    /*
+     * `libraryIndex` can be nullptr, then every file is opened.
+     * It is also updated with the probed files.
+     */
+    MetadataScanner(
+            std::vector<std::string> paths,
+            LibraryIndex *libraryIndex,
+            ResultCallback resultCallback);
+    MetadataScanner(const MetadataScanner&) = delete;
+    MetadataScanner(MetadataScanner&&) = delete;
+    MetadataScanner& operator=(const MetadataScanner&) = delete;
+    MetadataScanner& operator=(MetadataScanner&&) = delete;
+
+    /*
+     * Start scanning with `threadCount` threads.
+     * If `threadCount` is 0, one thread is started per CPU core.
+     */
+    void start(unsigned threadCount=0);
+
+    /*
+     * Wait for the scan to finish.
+     */
+    void wait();
+
+    /*
+     * Stop the workers as soon as they finish the current file and wait
+     * for them. The remaining results are not delivered.
+     */
+    void cancel();
+
+    inline size_t getTotalCount() const { return m_paths.size(); }
+    inline size_t getScannedCount() const { return m_scannedCount; }
+    inline bool isFinished() const { return m_workersRunning == 0; }
+
+    /*
+     * Open the file and read its metadata.
+     *
+     * Returns 0 if succeeded, nonzero if it is not a playable audio file.
+     */
+    static int probeFile(const std::string &path, TrackMetadata &output);
+
+    ~MetadataScanner();
+};
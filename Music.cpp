@@ -27,10 +27,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "Music.h"
+#include "StageTiming.h"
 
 #include <iostream>
 #include <cassert>
 #include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 
 Music::Music()
 {
@@ -45,12 +50,27 @@ void Music::reset()
     m_codecParams         = nullptr;
     m_codec               = nullptr;
     m_codecContext        = nullptr;
-    m_outputFormat        = nullptr;
-    m_outputFormatContext = nullptr;
-    m_outputStream        = nullptr;
     m_resampleContext     = nullptr;
+    m_convertKernel       = nullptr;
     m_currentPacket       = nullptr;
+    m_frame               = nullptr;
     m_audioStreamI        = 0;
+    m_decodeState         = DECODESTATE_READING;
+    m_lastPts             = 0;
+    m_outputSampleRate    = 0;
+    m_outputChannels      = 0;
+    m_trailingPaddingSamples = 0;
+    m_outputBatch.clear();
+    m_output              = nullptr;
+    m_trackInfo.reset();
+    m_filePath.clear();
+    m_isRecordingSeekIndex = false;
+    m_seekTargetPts       = AV_NOPTS_VALUE;
+    m_seekLandingPts      = AV_NOPTS_VALUE;
+    m_samplesToSkip       = 0;
+    m_gainedSampleCount   = 0;
+    m_outputFramePosition = 0;
+    m_gainStage.setGain(1.0f, 0);
 
     std::cout << "Music reset" << '\n';
 }
@@ -111,62 +131,42 @@ static std::string getStreamInfo(
     return output.str();
 }
 
-int Music::openAudioDevice(const std::string &audioDevName)
+int Music::attachOutput(AudioOutput *output)
 {
-    // Get the output format of the audio device
-    m_outputFormat = av_guess_format(audioDevName.c_str(), nullptr, nullptr);
-    if (!m_outputFormat)
-    {
-        std::cerr << "Failed to get format of output device" << '\n';
-        return 1;
-    }
-
-    m_outputFormatContext = avformat_alloc_context();
-    if (!m_outputFormatContext)
-    {
-        std::cerr << "Failed to create output format context" << '\n';
-        return 1;
-    }
-    // Tell the format context which output device to use
-    m_outputFormatContext->oformat = m_outputFormat;
-
-    // Create a stream where the output will be written to
-    m_outputStream = avformat_new_stream(m_outputFormatContext, nullptr);
-    if (!m_outputStream)
-    {
-        std::cerr << "Failed to create output stream" << '\n';
-        return 1;
-    }
-    // Configure the parameters of the output stream
-    m_outputStream->codecpar->codec_id       = AV_CODEC_ID_PCM_S16LE;
-    m_outputStream->codecpar->codec_type     = AVMEDIA_TYPE_AUDIO;
-    m_outputStream->codecpar->format         = AV_SAMPLE_FMT_S16;
-    m_outputStream->codecpar->bit_rate       = m_codecContext->bit_rate;
-    m_outputStream->codecpar->sample_rate    = m_codecContext->sample_rate;
-    m_outputStream->codecpar->channels       = m_codecContext->channels;
-    m_outputStream->codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
-
-    // Tell the device the parameters
-    if (avformat_write_header(m_outputFormatContext, nullptr) < 0)
-    {
-        std::cerr << "Failed to write stream header to output device" << '\n';
-        return 1;
-    }
-
-    return 0;
+    m_output = output;
+    return m_output->configure(m_outputSampleRate, m_outputChannels);
 }
 
 int Music::initResampleContext()
 {
+    const int64_t inChannelLayout{m_codecContext->channel_layout
+        ? (int64_t)m_codecContext->channel_layout
+        : av_get_default_channel_layout(m_codecContext->channels)};
+
+    // Only the sample format changes, libswresample is not needed
+    if (m_codecContext->sample_rate == m_outputSampleRate
+            && m_codecContext->channels == m_outputChannels
+            && inChannelLayout == av_get_default_channel_layout(m_outputChannels))
+    {
+        m_convertKernel = SampleConvert::findKernel(
+                (AVSampleFormat)m_codecContext->sample_fmt, m_outputChannels);
+        if (m_convertKernel)
+        {
+            std::cout << "Converting samples with the "
+                << SampleConvert::getInstructionSetName() << " kernels" << '\n';
+            return 0;
+        }
+    }
+
     m_resampleContext =
             swr_alloc_set_opts(
                     nullptr,
-                    m_outputStream->codecpar->channel_layout,         // Out channel layout
-                    (AVSampleFormat)m_outputStream->codecpar->format, // Out sample format
-                    m_outputStream->codecpar->sample_rate,            // Out sample rate
-                    AV_CH_LAYOUT_STEREO,                              // In channel layout
-                    (AVSampleFormat)m_codecContext->sample_fmt,       // In format
-                    m_codecContext->sample_rate,                      // In sample rate
+                    av_get_default_channel_layout(m_outputChannels), // Out channel layout
+                    AV_SAMPLE_FMT_S16,                               // Out sample format
+                    m_outputSampleRate,                              // Out sample rate
+                    inChannelLayout,                                 // In channel layout
+                    (AVSampleFormat)m_codecContext->sample_fmt,      // In format
+                    m_codecContext->sample_rate,                     // In sample rate
                     0,
                     nullptr);
     if (!m_resampleContext)
@@ -184,9 +184,7 @@ int Music::initResampleContext()
     return 0;
 }
 
-Music::OpenError Music::open(
-        const std::string &filePath,
-        const std::string &audioDevName)
+Music::OpenError Music::openInput(const std::string &filePath)
 {
     std::cout << std::string(30, '-') << " begin " << std::string(30, '-') << '\n';
     std::cout << "Opening file: " << filePath << '\n';
@@ -201,6 +199,11 @@ Music::OpenError Music::open(
         return OPENERROR_ALLOC;
     }
 
+    // Read regular files through a memory mapping,
+    // let libav handle the others (pipes, devices, etc.)
+    if (m_mappedInput.open(filePath) == 0)
+        m_mappedInput.attach(m_formatContext);
+
     // Open the file as input to the format context
     if (avformat_open_input(
             &m_formatContext,
@@ -284,16 +287,68 @@ Music::OpenError Music::open(
         return OPENERROR_FILE;
     }
 
-    if (openAudioDevice(audioDevName))
+    // The device gets the sample rate and channel count of the track,
+    // only the sample format is converted
+    m_outputSampleRate = m_codecContext->sample_rate;
+    m_outputChannels   = m_codecContext->channels;
+    // Encoder padding at the end of the stream, it is cut off
+    m_trailingPaddingSamples = std::max(0, m_codecParams->trailing_padding);
+
+    if (initResampleContext())
     {
         m_state = STATE_ERROR;
-        return OPENERROR_OUTPUT;
+        return OPENERROR_OTHER;
     }
 
-    if (initResampleContext())
+    m_currentPacket = m_bufferPool.acquirePacket();
+    m_frame = m_bufferPool.acquireFrame();
+    if (!m_currentPacket || !m_frame)
     {
+        std::cerr << "Failed to allocate packet or frame" << '\n';
         m_state = STATE_ERROR;
-        return OPENERROR_OTHER;
+        return OPENERROR_ALLOC;
+    }
+
+    m_filePath = filePath;
+    // Use the seek index made last time, or record one while playing
+    const AVRational timeBase{m_formatContext->streams[m_audioStreamI]->time_base};
+    m_seekIndex.reset(m_audioStreamI, timeBase);
+    m_isRecordingSeekIndex = false;
+    if (SeekIndex::isUsefulFor(m_formatContext))
+    {
+        FileIdentity identity;
+        const bool isCached{FileIdentity::get(filePath, identity) == 0
+            && SeekIndex::loadFromCache(filePath, identity, m_seekIndex) == 0
+            && m_seekIndex.getStreamIndex() == m_audioStreamI};
+        if (!isCached)
+        {
+            m_seekIndex.reset(m_audioStreamI, timeBase);
+            m_isRecordingSeekIndex = true;
+        }
+    }
+
+    // Build the description once, the GUI shows it without touching libav
+    m_trackInfo = std::make_shared<const TrackInfo>(TrackInfo{
+            ::getFileInfo(m_formatContext),
+            getStreamInfo(m_codecParams, m_codec, m_codecContext)});
+
+    // The input is open, but there is no output yet
+    m_state = STATE_PAUSED;
+    return OPENERROR_OK;
+}
+
+Music::OpenError Music::open(
+        const std::string &filePath,
+        AudioOutput *output)
+{
+    const OpenError error{openInput(filePath)};
+    if (error)
+        return error;
+
+    if (attachOutput(output))
+    {
+        m_state = STATE_ERROR;
+        return OPENERROR_OUTPUT;
     }
 
     std::cout << "Successfully opened file and found audio stream" << '\n';
@@ -303,6 +358,23 @@ Music::OpenError Music::open(
     return OPENERROR_OK;
 }
 
+Music::OpenError Music::preload(const std::string &filePath)
+{
+    const OpenError error{openInput(filePath)};
+    if (error)
+        return error;
+
+    // Decode the beginning of the track, so it is ready to be played
+    // the moment the previous track ends
+    while (m_decodeState == DECODESTATE_READING
+            && m_outputBatch.size() < (size_t)m_outputSampleRate * m_outputChannels / 4)
+        decodeNextPacket();
+
+    std::cout << "Preloaded file, " << m_outputBatch.size() / m_outputChannels
+        << " samples decoded" << '\n';
+    return OPENERROR_OK;
+}
+
 void Music::unPause()
 {
     if (m_state == STATE_ERROR)
@@ -356,58 +428,239 @@ void Music::pause()
     m_state = STATE_PAUSED;
 }
 
-static AVPacket *resampleFrame(
-        AVFrame *frame,
-        AVCodecContext *codecContext,
-        SwrContext *resampleContext,
-        AVStream *outputStream)
+int Music::resampleFrame(const AVFrame *frame)
 {
-    uint8_t *resampledBuffer{};
-    long outSamples{av_rescale_rnd(
+    const int channels{m_outputChannels};
+
+    if (m_convertKernel)
+    {
+        // Nothing is buffered without resampling, there is nothing to drain
+        if (!frame || frame->nb_samples <= 0)
+            return 0;
+
+        const size_t batchSize{m_outputBatch.size()};
+        m_outputBatch.resize(batchSize + (size_t)frame->nb_samples * channels);
+        TIME_STAGE(StageTiming::STAGE_CONVERT);
+        m_convertKernel(
+                frame->extended_data, m_outputBatch.data() + batchSize,
+                frame->nb_samples, channels);
+        return 0;
+    }
+
+    // When draining the resampler there is no input frame
+    const int inSamples{frame ? frame->nb_samples : 0};
+
+    const int outSamples{(int)av_rescale_rnd(
             swr_get_delay(
-                    resampleContext,
-                    frame->sample_rate) + frame->nb_samples,
-            codecContext->sample_rate,
-            outputStream->codecpar->sample_rate,
+                    m_resampleContext,
+                    m_codecContext->sample_rate) + inSamples,
+            m_outputSampleRate,
+            m_codecContext->sample_rate,
             AV_ROUND_UP)};
-    // Allocate buffer for converted data
-    av_samples_alloc(
-            &resampledBuffer,
-            nullptr,
-            outputStream->codecpar->channels,
-            outSamples,
-            (AVSampleFormat)outputStream->codecpar->format,
-            0);
+    if (outSamples <= 0)
+        return 0;
+
+    // Append the converted samples to the end of the batch
+    const size_t batchSize{m_outputBatch.size()};
+    m_outputBatch.resize(batchSize + (size_t)outSamples * channels);
+    uint8_t *outBuffer{(uint8_t*)(m_outputBatch.data() + batchSize)};
+
     // Do the conversion from the input format to the output format
-    swr_convert(
-            resampleContext,                       // Resample context
-            &resampledBuffer,                      // Output buffer
-            outSamples,                            // Number of samples to output
-            (const uint8_t**)frame->extended_data, // Input buffer
-            frame->nb_samples);                    // Number of input samples
-
-    // We need the buffer size to create a packet from the buffer
-    int resampledBufferSize{av_samples_get_buffer_size(
-            nullptr,
-            outputStream->codecpar->channels,
-            outSamples,
-            (AVSampleFormat)outputStream->codecpar->format,
-            0)};
-    if (resampledBufferSize < 0)
+    const int convertedSamples{TIMED_STAGE(StageTiming::STAGE_RESAMPLE, swr_convert(
+            m_resampleContext,                                    // Resample context
+            &outBuffer,                                           // Output buffer
+            outSamples,                                           // Number of samples to output
+            frame ? (const uint8_t**)frame->extended_data : nullptr, // Input buffer
+            inSamples))};                                         // Number of input samples
+    if (convertedSamples < 0)
+    {
+        std::cerr << "Failed to resample frame" << '\n';
+        m_outputBatch.resize(batchSize);
+        return 1;
+    }
+
+    // Only keep what was actually converted
+    m_outputBatch.resize(batchSize + (size_t)convertedSamples * channels);
+    return 0;
+}
+
+int Music::receiveFrames()
+{
+    while (true)
+    {
+        const int result{TIMED_STAGE(StageTiming::STAGE_RECEIVE_FRAME,
+                avcodec_receive_frame(m_codecContext, m_frame))};
+        // The decoder needs a new packet
+        if (result == AVERROR(EAGAIN))
+            return 0;
+        // The decoder is fully drained
+        if (result == AVERROR_EOF)
+            return AVERROR_EOF;
+        if (result < 0)
+        {
+            std::cerr << "Failed to receive frame from codec" << '\n';
+            return result;
+        }
+
+        resampleFrame(m_frame);
+        av_frame_unref(m_frame);
+    }
+}
+
+bool Music::writeOutputBatch()
+{
+    // Throw away the samples between the seeked packet and the seek target
+    if (m_samplesToSkip > 0)
+    {
+        const size_t skipped{std::min(
+                m_samplesToSkip * m_outputChannels, m_outputBatch.size())};
+        m_outputBatch.erase(m_outputBatch.begin(), m_outputBatch.begin() + skipped);
+        m_samplesToSkip -= skipped / m_outputChannels;
+        m_gainedSampleCount -= std::min(m_gainedSampleCount, skipped);
+    }
+
+    // Keep back the samples that may be encoder padding,
+    // they are only known to be real audio if more samples follow
+    const size_t heldBack{m_decodeState == DECODESTATE_DRAINED
+        ? 0 : (size_t)m_trailingPaddingSamples * m_outputChannels};
+    if (m_outputBatch.size() <= heldBack)
+        return true;
+    const size_t count{m_outputBatch.size() - heldBack};
+
+    // Only the new samples, the gain stage has state
+    if (m_gainStage.isEnabled() && count > m_gainedSampleCount)
+    {
+        TIME_STAGE(StageTiming::STAGE_GAIN);
+        m_gainStage.process(m_outputBatch.data() + m_gainedSampleCount,
+                (count - m_gainedSampleCount) / m_outputChannels, m_outputChannels);
+    }
+    m_gainedSampleCount = std::max(m_gainedSampleCount, count);
+
+    size_t written{count};
+    if (m_pcmBuffer)
+    {
+        // Let the output stage write it to the device
+        written = pushToPcmBuffer(m_outputBatch.data(), count);
+    }
+    else
     {
-        std::cerr << "Failed to get buffer size" << '\n';
-        return nullptr;
+        // Write the data to the output device
+        m_output->write(m_outputBatch.data(), count);
     }
+    m_outputFramePosition += written / m_outputChannels;
+    m_outputBatch.erase(m_outputBatch.begin(), m_outputBatch.begin() + written);
+    m_gainedSampleCount -= written;
+    return written == count;
+}
 
-    AVPacket *resampledPacket{av_packet_alloc()};
-    // Create a packet from the buffer, so we can later send it to the device
-    if (av_packet_from_data(resampledPacket, resampledBuffer, resampledBufferSize))
+void Music::decodeNextPacket()
+{
+    if (m_decodeState == DECODESTATE_READING)
     {
-        std::cerr << "Failed to create packet from buffer" << '\n';
-        return nullptr;
+        av_packet_unref(m_currentPacket);
+
+        const int readResult{TIMED_STAGE(StageTiming::STAGE_READ_PACKET,
+                av_read_frame(m_formatContext, m_currentPacket))};
+        if (readResult < 0)
+        {
+            if (readResult != AVERROR_EOF)
+                std::cerr << "Failed to read packet, treating it as end of stream" << '\n';
+            std::cout << "End of stream, draining decoder" << '\n';
+
+            // Every packet was seen, the index can be used next time
+            if (m_isRecordingSeekIndex && readResult == AVERROR_EOF)
+            {
+                m_seekIndex.markComplete();
+                FileIdentity identity;
+                if (FileIdentity::get(m_filePath, identity) == 0
+                        && m_seekIndex.saveToCache(m_filePath, identity) == 0)
+                    std::cout << "Saved seek index with "
+                        << m_seekIndex.getEntryCount() << " entries" << '\n';
+            }
+            m_isRecordingSeekIndex = false;
+
+            // Enter draining mode, the decoder gives back the buffered frames
+            avcodec_send_packet(m_codecContext, nullptr);
+            m_decodeState = DECODESTATE_DRAINING;
+        }
+        else
+        {
+            // Skip the packets of the other streams
+            if (m_currentPacket->stream_index != m_audioStreamI)
+                return;
+
+            // First packet after a seek, find out how much to throw away
+            if (m_seekTargetPts != AV_NOPTS_VALUE)
+            {
+                const int64_t landingPts{m_currentPacket->pts != AV_NOPTS_VALUE
+                    ? m_currentPacket->pts : m_seekLandingPts};
+                if (landingPts != AV_NOPTS_VALUE && m_seekTargetPts > landingPts)
+                    m_samplesToSkip = av_rescale_q(
+                            m_seekTargetPts - landingPts,
+                            m_formatContext->streams[m_audioStreamI]->time_base,
+                            AVRational{1, m_outputSampleRate});
+                // Landed after the target, playback starts there
+                else if (landingPts != AV_NOPTS_VALUE)
+                    m_outputFramePosition = av_rescale_q(
+                            landingPts,
+                            m_formatContext->streams[m_audioStreamI]->time_base,
+                            AVRational{1, m_outputSampleRate});
+                m_lastPts = landingPts != AV_NOPTS_VALUE ? landingPts : m_lastPts;
+                m_seekTargetPts = AV_NOPTS_VALUE;
+            }
+
+            // After a byte seek some demuxers don't know the timestamps,
+            // count the time from the packet durations then
+            if (m_currentPacket->pts != AV_NOPTS_VALUE)
+                m_lastPts = m_currentPacket->pts;
+            else if (m_currentPacket->duration > 0)
+                m_lastPts += m_currentPacket->duration;
+
+            if (m_isRecordingSeekIndex)
+                m_seekIndex.addPacket(m_currentPacket->pts, m_currentPacket->pos);
+
+            int sendResult{TIMED_STAGE(StageTiming::STAGE_SEND_PACKET,
+                    avcodec_send_packet(m_codecContext, m_currentPacket))};
+            if (sendResult == AVERROR(EAGAIN))
+            {
+                // The decoder is full, take out its frames and try again
+                receiveFrames();
+                sendResult = TIMED_STAGE(StageTiming::STAGE_SEND_PACKET,
+                        avcodec_send_packet(m_codecContext, m_currentPacket));
+            }
+            if (sendResult == AVERROR_INVALIDDATA)
+            {
+                std::cerr << "Invalid packet, skipping" << '\n';
+            }
+            else if (sendResult < 0)
+            {
+                std::cerr << "Failed to send packet to codec" << '\n';
+                return; // Maybe next time
+            }
+
+            // Decode every frame the packet contains, so they
+            // can be written to the output at once
+            if (receiveFrames() == AVERROR_EOF)
+                m_decodeState = DECODESTATE_DRAINING;
+        }
     }
 
-    return resampledPacket;
+    if (m_decodeState == DECODESTATE_DRAINING)
+    {
+        // Take out every frame that is still in the decoder
+        receiveFrames();
+        // Take out the samples that are still in the resampler
+        resampleFrame(nullptr);
+
+        // Cut off the encoder padding, so the next track
+        // continues right after the last real sample
+        // (the decoder already skips the padding at the beginning)
+        const size_t padding{(size_t)m_trailingPaddingSamples * m_outputChannels};
+        m_outputBatch.resize(
+                m_outputBatch.size() > padding ? m_outputBatch.size() - padding : 0);
+
+        m_decodeState = DECODESTATE_DRAINED;
+    }
 }
 
 void Music::tick()
@@ -438,94 +691,206 @@ void Music::tick()
         return;
     }
 
-    AVFrame *frame{av_frame_alloc()};
-    av_packet_free(&m_currentPacket);
-    m_currentPacket = av_packet_alloc();
+    TIME_STAGE(StageTiming::STAGE_TICK);
+    // Only decode more when the last batch is out, so the batch doesn't
+    // grow while the PCM buffer is full
+    if (!writeOutputBatch())
+        return;
+    if (m_decodeState != DECODESTATE_DRAINED)
+        decodeNextPacket();
+    if (!writeOutputBatch())
+        return;
 
-    // Read a frame
-    // FIXME: End of stream detection is buggy
-    if (av_read_frame(m_formatContext, m_currentPacket) < 0)
+    if (m_decodeState == DECODESTATE_DRAINED)
     {
-        // End of stream
-
+        // When there is a PCM buffer, the output stage is still playing,
+        // it can't be flushed yet
+        if (!m_pcmBuffer)
+            m_output->flush();
         std::cout << "End of stream" << '\n';
-        av_write_frame(m_outputFormatContext, nullptr); // Flush the buffer
-        av_frame_free(&frame);
         m_state = STATE_END;
-        return;
     }
+}
 
-    // Send the packet to the codec
-    if (avcodec_send_packet(m_codecContext, m_currentPacket))
-    {
-        std::cerr << "Failed to send packet to codec" << '\n';
-        av_frame_free(&frame);
-        return; // Maybe next time
-    }
+size_t Music::pushToPcmBuffer(const int16_t *samples, size_t count)
+{
+    TIME_STAGE(StageTiming::STAGE_PCM_PUSH);
+    const size_t channels{(size_t)m_outputChannels};
+    const size_t toWrite{std::min(count, m_pcmBuffer->getWriteAvailable()) / channels * channels};
+    if (toWrite == 0)
+        return 0;
+    return m_pcmBuffer->write(samples, toWrite);
+}
 
-    // Get decoded output data from codecfree
-    // TODO: Handle error depending on the return code
-    if (avcodec_receive_frame(m_codecContext, frame))
-    {
-        std::cerr << "Failed to receive frame from codec" << '\n';
-        av_frame_free(&frame);
-        return; // Maybe next time
-    }
+std::string Music::getFileInfo() const
+{
+    return m_trackInfo ? m_trackInfo->fileInfo : "N/A\n";
+}
+
+std::string Music::getAudioStreamInfo() const
+{
+    return m_trackInfo ? m_trackInfo->audioStreamInfo : "    N/A\n";
+}
 
-    auto resampledFrame{resampleFrame(
-            frame,
-            m_codecContext,
-            m_resampleContext,
-            m_outputStream)};
-    if (resampledFrame)
+static std::string getTag(const AVFormatContext *formatContext, int streamI, const char *key)
+{
+    // Some containers (like Ogg) store the tags in the stream, not in the file
+    const AVDictionaryEntry *tag{av_dict_get(formatContext->metadata, key, nullptr, 0)};
+    if (!tag && streamI >= 0)
+        tag = av_dict_get(formatContext->streams[streamI]->metadata, key, nullptr, 0);
+    return tag ? tag->value : "";
+}
+
+/*
+ * Parse a ReplayGain tag, like "-6.48 dB" or "0.988553".
+ * Returns NAN if the tag is missing or invalid.
+ */
+static float parseReplayGainTag(const std::string &value)
+{
+    if (value.empty())
+        return NAN;
+    char *end{};
+    const float number{std::strtof(value.c_str(), &end)};
+    return end == value.c_str() ? NAN : number;
+}
+
+/*
+ * Parse an Opus R128 gain tag (Q7.8 fixed point, relative to -23 LUFS)
+ * to a ReplayGain gain (relative to -18 LUFS).
+ * Returns NAN if the tag is missing or invalid.
+ */
+static float parseR128GainTag(const std::string &value)
+{
+    if (value.empty())
+        return NAN;
+    char *end{};
+    const long number{std::strtol(value.c_str(), &end, 10)};
+    return *end ? NAN : number / 256.0f + 5.0f;
+}
+
+static LoudnessInfo readLoudnessTags(const AVFormatContext *formatContext, int audioStreamI)
+{
+    LoudnessInfo loudness;
+    loudness.trackGainDb = parseReplayGainTag(getTag(formatContext, audioStreamI, "REPLAYGAIN_TRACK_GAIN"));
+    loudness.trackPeak   = parseReplayGainTag(getTag(formatContext, audioStreamI, "REPLAYGAIN_TRACK_PEAK"));
+    loudness.albumGainDb = parseReplayGainTag(getTag(formatContext, audioStreamI, "REPLAYGAIN_ALBUM_GAIN"));
+    loudness.albumPeak   = parseReplayGainTag(getTag(formatContext, audioStreamI, "REPLAYGAIN_ALBUM_PEAK"));
+    if (std::isnan(loudness.trackGainDb))
+        loudness.trackGainDb = parseR128GainTag(getTag(formatContext, audioStreamI, "R128_TRACK_GAIN"));
+    if (std::isnan(loudness.albumGainDb))
+        loudness.albumGainDb = parseR128GainTag(getTag(formatContext, audioStreamI, "R128_ALBUM_GAIN"));
+    return loudness;
+}
+
+TrackMetadata Music::readMetadata(const AVFormatContext *formatContext, int audioStreamI)
+{
+    TrackMetadata metadata;
+    if (!formatContext)
+        return metadata;
+
+    metadata.title              = getTag(formatContext, audioStreamI, "title");
+    metadata.artist             = getTag(formatContext, audioStreamI, "artist");
+    metadata.album              = getTag(formatContext, audioStreamI, "album");
+    metadata.durationMs         = formatContext->duration / (AV_TIME_BASE / 1000);
+    metadata.bitRate            = formatContext->bit_rate;
+    metadata.audioStreamIndex   = audioStreamI;
+    metadata.loudness           = readLoudnessTags(formatContext, audioStreamI);
+
+    if (audioStreamI >= 0)
     {
-        // Write the data to the output device
-        if (av_write_frame(m_outputFormatContext, resampledFrame) < 0)
-        {
-            std::cerr << "Failed to write packet to output device" << '\n';
-        }
-        av_packet_free(&resampledFrame);
+        const AVCodecParameters *codecParams{
+            formatContext->streams[audioStreamI]->codecpar};
+        metadata.codecName      = avcodec_get_name(codecParams->codec_id);
+        metadata.sampleRate     = codecParams->sample_rate;
+        metadata.channelCount   = codecParams->channels;
     }
-    av_frame_free(&frame);
+    return metadata;
 }
 
-std::string Music::getFileInfo() const
+TrackMetadata Music::getMetadata() const
 {
-    return ::getFileInfo(m_formatContext);
+    if (!m_codecContext)
+        return TrackMetadata{};
+    return readMetadata(m_formatContext, m_audioStreamI);
 }
 
-std::string Music::getAudioStreamInfo() const
+int Music::seekToS(double timestamp)
 {
-    return getStreamInfo(m_codecParams, m_codec, m_codecContext);
+    if (!m_formatContext)
+        return 1;
+
+    const AVRational timeBase{m_formatContext->streams[m_audioStreamI]->time_base};
+    const int64_t targetPts{(int64_t)(std::max(0.0, timestamp) / av_q2d(timeBase))};
+
+    // The table is only valid if the track was not seeked while recording it
+    m_isRecordingSeekIndex = false;
+
+    const SeekIndex::Entry *entry{m_seekIndex.isComplete()
+        ? m_seekIndex.findEntryBefore(targetPts) : nullptr};
+    int result;
+    if (entry)
+    {
+        // Jump right to the packet before the target
+        result = av_seek_frame(m_formatContext, m_audioStreamI, entry->pos, AVSEEK_FLAG_BYTE);
+        m_seekLandingPts = entry->pts;
+    }
+    else
+    {
+        // Let libav find a packet at or before the target
+        result = av_seek_frame(m_formatContext, m_audioStreamI, targetPts, AVSEEK_FLAG_BACKWARD);
+        m_seekLandingPts = AV_NOPTS_VALUE;
+    }
+    if (result < 0)
+    {
+        std::cerr << "Failed to seek to " << timestamp << "s" << '\n';
+        return 1;
+    }
+    m_seekTargetPts = targetPts;
+    m_samplesToSkip = 0;
+    // The skipping makes the next written frame the target
+    m_outputFramePosition = av_rescale_q(
+            targetPts, timeBase, AVRational{1, m_outputSampleRate});
+
+    // Throw away the frames decoded before the seek
+    if (m_codecContext)
+        avcodec_flush_buffers(m_codecContext);
+    // and the samples the resampler holds back for its filter, they would
+    // come out before the target. Initializing it again empties it.
+    if (m_resampleContext && swr_init(m_resampleContext))
+        std::cerr << "Failed to reset resample context after seek" << '\n';
+    m_outputBatch.clear();
+    m_gainedSampleCount = 0;
+    m_decodeState = DECODESTATE_READING;
+
+    // A track that was played to the end continues from the new position
+    if (m_state == STATE_END)
+        m_state = STATE_PLAYING;
+    return 0;
 }
 
-void Music::seekToS(double timestamp)
+void Music::setSeekIndex(SeekIndex &&index)
 {
-    // FIXME: Maybe this is broken when used with MP3.
-    // (weird timestamps, see: `getCurrentTimestampS()`)
-    av_seek_frame(
-            m_formatContext,
-            m_audioStreamI,
-            //          VVVVVVV - AV_TIME_BASE
-            //                    VV - ???
-            timestamp * 1000000 / 21, // Timestamp
-            AVSEEK_FLAG_FRAME);
+    if (!index.isComplete() || index.getStreamIndex() != m_audioStreamI)
+        return;
+
+    m_seekIndex = std::move(index);
+    m_isRecordingSeekIndex = false;
 }
 
 void Music::closeAndReset()
 {
     if (m_state != STATE_UNINITIALIZED)
     {
-        if (m_outputFormatContext)
-            av_write_frame(m_outputFormatContext, nullptr); // Flush the buffer
-
         avcodec_free_context(&m_codecContext);
-        avformat_free_context(m_outputFormatContext);
         avformat_close_input(&m_formatContext);
-        av_packet_free(&m_currentPacket);
+        m_mappedInput.close();
+        m_bufferPool.releasePacket(m_currentPacket);
+        m_bufferPool.releaseFrame(m_frame);
         swr_free(&m_resampleContext);
 
         std::cout << "File closed" << '\n';
+        std::cout << "Buffer pool allocations so far: "
+            << m_bufferPool.getAllocationCount() << '\n';
 
         reset();
     }
@@ -29,17 +29,38 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include <string>
+#include <vector>
+#include <memory>
+#include "RingBuffer.h"
+#include "BufferPool.h"
+#include "AudioOutput.h"
+#include "LibraryIndex.h"
+#include "SeekIndex.h"
+#include "SampleConvert.h"
+#include "GainStage.h"
+#include "MappedInput.h"
 extern "C"
 {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libavdevice/avdevice.h>
 #include <libswresample/swresample.h>
 }
 
+/*
+ * Description of an open track for the GUI.
+ * Built once when the track is opened, never changed after that,
+ * so it can be shared with other threads.
+ */
+struct TrackInfo
+{
+    std::string fileInfo;
+    std::string audioStreamInfo;
+};
+
 /*
  * Represents a music file in the memory with all of its states like format,
- * codec, output device, output stream, output format, output context.
+ * codec and resample context. The decoded samples are fed to an `AudioOutput`
+ * (or to the PCM buffer of the output stage) that is not owned by the object.
  */
 class Music final
 {
@@ -75,36 +96,146 @@ public:
     };
 
 private:
+    enum DecodeState
+    {
+        // Reading packets and sending them to the decoder
+        DECODESTATE_READING,
+        // End of input, taking out the frames buffered in the decoder
+        DECODESTATE_DRAINING,
+        // Everything is decoded, only `m_outputBatch` may contain samples
+        DECODESTATE_DRAINED,
+    };
+
     State             m_state{};
+    DecodeState       m_decodeState{};
     AVFormatContext   *m_formatContext{};
+    // Reads local files for `m_formatContext`
+    MappedInput       m_mappedInput;
     AVCodecParameters *m_codecParams{};
     AVCodec           *m_codec{};
     AVCodecContext    *m_codecContext{};
-    AVOutputFormat    *m_outputFormat{};
-    AVFormatContext   *m_outputFormatContext{};
-    AVStream          *m_outputStream{};
     SwrContext        *m_resampleContext{};
+    // Used instead of `m_resampleContext` if only the sample format
+    // has to be converted
+    SampleConvert::Kernel m_convertKernel{};
     AVPacket          *m_currentPacket{};
+    AVFrame           *m_frame{};
     int               m_audioStreamI{};
+    // PTS of the last packet read from the audio stream
+    int64_t           m_lastPts{};
+    // Sample rate and channel count written to the output
+    int               m_outputSampleRate{};
+    int               m_outputChannels{};
+    // Number of padding samples the encoder put to the end of the stream
+    int               m_trailingPaddingSamples{};
+
+    // Path of the open file
+    std::string       m_filePath;
+    // Packet positions for seeking, see `SeekIndex`
+    SeekIndex         m_seekIndex;
+    // True while the track is played from the beginning without a seek,
+    // so every packet is added to `m_seekIndex`
+    bool              m_isRecordingSeekIndex{};
+    // Target of the last seek, AV_NOPTS_VALUE when the first packet
+    // after the seek was already read
+    int64_t           m_seekTargetPts{AV_NOPTS_VALUE};
+    // Where the seek landed if the packets have no timestamp
+    int64_t           m_seekLandingPts{AV_NOPTS_VALUE};
+    // Number of sample frames to throw away to reach the seek target
+    size_t            m_samplesToSkip{};
+    // Index of the next sample frame written to the output, counted
+    // from the beginning of the track
+    int64_t           m_outputFramePosition{};
+
+    // Built by `openInput()`, nullptr if no file is open
+    std::shared_ptr<const TrackInfo> m_trackInfo;
+
+    // Recycles the frames and packets of the playback loop
+    BufferPool        m_bufferPool;
+
+    // ReplayGain, applied to the samples when they are written
+    GainStage         m_gainStage;
+
+    // The resampled samples of every frame decoded in the current tick,
+    // written to the output at once
+    std::vector<int16_t> m_outputBatch;
+    // Number of samples at the beginning of `m_outputBatch` that the gain
+    // is applied to already, but didn't fit into the PCM buffer
+    size_t            m_gainedSampleCount{};
+
+    // The output the track is played on, not owned
+    AudioOutput       *m_output{};
+    // If set, `tick()` puts the resampled samples here instead of
+    // writing them to the output. The output stage drains it.
+    RingBuffer<int16_t> *m_pcmBuffer{};
 
 private:
     /*
-     * Open an audio device with the passed name.
-     * Should only be called by `open()`.
+     * Open the file, find a valid audio stream, find a codec, print some
+     * info and call `initResampleContext()`. Doesn't touch the output.
+     * Should only be called by `open()` and `preload()`.
      *
-     * Returns 0 if succeeded, nonzero otherwise.
+     * Sets the state to `STATE_PAUSED` if succeeded.
+     * Returns an `OpenError` value.
      */
-    int openAudioDevice(const std::string &audioDevName);
+    OpenError openInput(const std::string &filePath);
 
     /*
-     * Initializes the resample context using the device
+     * Initializes the resample context using the output
      * properties and the input properties.
-     * Should only be called by `open()`.
+     * If the sample rate and the channel layout don't change, a conversion
+     * kernel is picked instead and no resample context is created.
+     * Should only be called by `openInput()`.
      *
      * Returns 0 if succeeded, nonzero otherwise.
      */
     int initResampleContext();
 
+    /*
+     * Resample `frame` and append the result to `m_outputBatch`.
+     * If `frame` is nullptr, the samples buffered in the resampler
+     * are taken out.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int resampleFrame(const AVFrame *frame);
+
+    /*
+     * Receive every frame the decoder can give without a new packet
+     * and resample them into the batch.
+     *
+     * Returns 0 if the decoder needs more input, AVERROR_EOF if
+     * it is fully drained or a negative error code.
+     */
+    int receiveFrames();
+
+    /*
+     * Write `m_outputBatch` to the PCM buffer or the output and remove the
+     * written samples from it. Until the end of the stream, the samples
+     * that may be encoder padding are kept back.
+     * The samples that don't fit into the PCM buffer stay in the batch.
+     *
+     * Returns true if everything that could be written is written.
+     */
+    bool writeOutputBatch();
+
+    /*
+     * Read a packet and decode every frame it contains to `m_outputBatch`.
+     * At the end of the input drain the decoder and the resampler and
+     * cut off the encoder padding.
+     */
+    void decodeNextPacket();
+
+    /*
+     * Put as many of the interleaved samples to `m_pcmBuffer` as fit.
+     * Doesn't wait, the engine ticks the track again when the output stage
+     * made room. Only whole sample frames are published, so the reader
+     * never sees half of a frame.
+     *
+     * Returns the number of samples written.
+     */
+    size_t pushToPcmBuffer(const int16_t *samples, size_t count);
+
 public:
     Music();
     Music(const Music&) = delete;
@@ -115,24 +246,79 @@ public:
     /*
      * Open a file with the specified path,
      * find a valid audio stream, find a codec,
-     * print some info, call `openAudioDevice()`
-     * and call `initResampleContext()`.
+     * print some info, call `initResampleContext()`
+     * and call `attachOutput()`.
      *
      * Returns an `OpenError` value.
      */
     OpenError open(
             const std::string &filePath,
-            const std::string &audioDevName);
+            AudioOutput *output);
+
+    /*
+     * Open the file like `open()`, but without opening the output,
+     * and decode the beginning of it.
+     * The object stays paused. Call `attachOutput()` and `unPause()` to
+     * start playing it.
+     *
+     * Can be called on another thread, as long as nobody else uses the object.
+     *
+     * Returns an `OpenError` value.
+     */
+    OpenError preload(const std::string &filePath);
+
+    /*
+     * Set the output the track is played on and configure it for the
+     * sample rate and channel count of the track. The device is only
+     * reopened if they differ from the current ones.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int attachOutput(AudioOutput *output);
 
     /*
-     * Check if the object is in a usable state, read a frame from the input
-     * file, decode it, resample it and write it to the output device.
+     * Return whether the track can be played on `output`
+     * without reopening the device.
+     */
+    inline bool canPlayWithoutReconfiguring(const AudioOutput &output) const
+    {
+        return output.isConfiguredFor(m_outputSampleRate, m_outputChannels);
+    }
+
+    inline int getOutputSampleRate() const { return m_outputSampleRate; }
+    inline int getOutputChannelCount() const { return m_outputChannels; }
+
+    /*
+     * Check if the object is in a usable state, read a packet from the input
+     * file, decode every frame it contains, resample them and write them
+     * to the output at once.
+     * At the end of the input the decoder is drained, so the end of the
+     * track is not lost.
      *
      * Should be called repeatedly until the music
      * ends (`hasEnded()` returns true).
      */
     void tick();
 
+    /*
+     * Set the gain applied to the samples (linear, 1 means no change).
+     * Reset to 1 when the track is closed.
+     */
+    inline void setGain(float gain) { m_gainStage.setGain(gain, m_outputSampleRate); }
+    inline float getGain() const { return m_gainStage.getGain(); }
+
+    /*
+     * Set the buffer where `tick()` puts the decoded samples.
+     * Pass nullptr to write directly to the output.
+     */
+    inline void setPcmBuffer(RingBuffer<int16_t> *buffer) { m_pcmBuffer = buffer; }
+
+    /*
+     * Return the number of allocations done by the buffer pool.
+     * Stays the same while playing, after the first few ticks.
+     */
+    inline size_t getPoolAllocationCount() const { return m_bufferPool.getAllocationCount(); }
+
     /*
      * Check if the object is in a usable state.
      * If yes, set `m_state` to `STATE_PLAYING`.
@@ -145,7 +331,8 @@ public:
     void pause();
 
     /*
-     * Close the input file, the output device, free stuff and call `reset()`.
+     * Close the input file, free stuff and call `reset()`.
+     * The output is left open for the next track.
      */
     void closeAndReset();
     /*
@@ -155,8 +342,31 @@ public:
 
     /*
      * Seek to the specified second.
+     * If there is a complete seek index, jump to the packet before the
+     * target by its byte position. The samples before the target are
+     * decoded and thrown away, so playback starts right at the target.
+     * A track at its end continues playing from the target.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int seekToS(double timestamp);
+
+    /*
+     * Return whether a seek index should be built for the track
+     * by scanning the file.
+     */
+    inline bool needsSeekIndex() const
+    {
+        return m_formatContext && !m_seekIndex.isComplete()
+            && SeekIndex::isUsefulFor(m_formatContext);
+    }
+    /*
+     * Use a seek index built by `SeekIndex::scan()`.
+     * Ignored if it is for another stream.
      */
-    void seekToS(double timestamp);
+    void setSeekIndex(SeekIndex &&index);
+    inline const std::string& getFilePath() const { return m_filePath; }
+    inline int getAudioStreamIndex() const { return m_audioStreamI; }
 
     inline State getState() const { return m_state; }
     inline bool hasEnded() const { return m_state == STATE_END; }
@@ -166,18 +376,56 @@ public:
     {
         return m_formatContext ? m_formatContext->duration / AV_TIME_BASE : 0;
     }
+    /*
+     * Return the duration in output sample frames, 0 if it is not known.
+     */
+    inline int64_t getDurationFrames() const
+    {
+        return m_formatContext && m_formatContext->duration > 0
+            ? av_rescale(m_formatContext->duration, m_outputSampleRate, AV_TIME_BASE) : 0;
+    }
+    /*
+     * Return the position of the decoder. It is ahead of what is heard,
+     * use `getOutputFramePosition()` to tell the playback position.
+     */
     inline int64_t getCurrentTimestampS() const
     {
-        // FIXME: MP3 timestamps are weird
-        return m_currentPacket ?
-            m_currentPacket->pts * av_q2d(m_outputStream->time_base) : 0;
+        return m_formatContext ?
+            m_lastPts * av_q2d(m_formatContext->streams[m_audioStreamI]->time_base) : 0;
     }
+    /*
+     * Return the number of sample frames written to the output (or the
+     * PCM buffer) since the beginning of the track, including the
+     * frames skipped by seeking.
+     */
+    inline int64_t getOutputFramePosition() const { return m_outputFramePosition; }
+
+    /*
+     * Return the description of the open track, nullptr if there is none.
+     * The returned object doesn't change, even if the track is closed.
+     */
+    inline std::shared_ptr<const TrackInfo> getTrackInfo() const { return m_trackInfo; }
 
     std::string getFileInfo() const;
     std::string getAudioStreamInfo() const;
 
     /*
-     * Close the file, the output device and free everything.
+     * Return the tags and stream properties of the open file,
+     * for the library index.
+     */
+    TrackMetadata getMetadata() const;
+
+    /*
+     * Return the tags and stream properties of a format context
+     * that has its stream info found.
+     * Pass -1 as `audioStreamI` if there is no audio stream.
+     */
+    static TrackMetadata readMetadata(
+            const AVFormatContext *formatContext,
+            int audioStreamI);
+
+    /*
+     * Close the file and free everything.
      */
     ~Music();
 };
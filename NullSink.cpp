@@ -0,0 +1,87 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "NullSink.h"
+#include <thread>
+
+NullSink::NullSink(double speed)
+    : m_speed{speed}
+{
+}
+
+int NullSink::open(int sampleRate, int channelCount)
+{
+    m_sampleRate = sampleRate;
+    m_channelCount = channelCount;
+    m_framesSinceStart = 0;
+    m_startTime = Clock::now();
+    return 0;
+}
+
+int16_t* NullSink::beginWrite(size_t maxCount, size_t &count)
+{
+    if (!m_channelCount)
+        return nullptr;
+
+    count = maxCount / m_channelCount * m_channelCount;
+    if (m_buffer.size() < count)
+        m_buffer.resize(count);
+    return m_buffer.data();
+}
+
+int NullSink::commitWrite(size_t count)
+{
+    if (!m_channelCount)
+        return 1;
+
+    m_framesSinceStart += count / m_channelCount;
+    if (m_speed <= 0)
+        return 0;
+
+    // Sleep until the samples would be played
+    const auto playTime{m_startTime + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>{m_framesSinceStart / (m_sampleRate * m_speed)})};
+    const auto now{Clock::now()};
+    if (playTime > now)
+    {
+        std::this_thread::sleep_until(playTime);
+    }
+    else
+    {
+        // Nothing was written for a while (paused), that was not an underrun
+        m_startTime = now;
+        m_framesSinceStart = 0;
+    }
+    return 0;
+}
+
+void NullSink::close()
+{
+    m_sampleRate = 0;
+    m_channelCount = 0;
+}
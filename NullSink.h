@@ -0,0 +1,67 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "AudioSink.h"
+
+/*
+ * Throws the samples away. For running and measuring the player
+ * on machines without a sound card.
+ *
+ * The samples are taken at `speed` times the real time, so the player
+ * behaves like with a device, or as fast as possible if `speed` is 0.
+ */
+class NullSink final : public AudioSink
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double m_speed{};
+    int m_sampleRate{};
+    int m_channelCount{};
+    // The samples go here and are never read
+    std::vector<int16_t> m_buffer;
+
+    // When the first sample was taken since opening, or since the sink
+    // fell behind
+    Clock::time_point m_startTime;
+    int64_t m_framesSinceStart{};
+
+public:
+    NullSink(double speed);
+
+    int open(int sampleRate, int channelCount) override;
+    int16_t* beginWrite(size_t maxCount, size_t &count) override;
+    int commitWrite(size_t count) override;
+    void close() override;
+    inline const char* getName() const override { return "null"; }
+};
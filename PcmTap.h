@@ -0,0 +1,152 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+/*
+ * Keeps the last `CAPACITY_FRAMES` frames written to the output,
+ * for the visualizations.
+ *
+ * The writer (the output thread) never waits and never allocates:
+ * it overwrites the oldest frames whether they were read or not.
+ * The reader copies the latest frames and finds out afterwards if the
+ * writer overwrote them meanwhile (like a seqlock), in which case it
+ * drops the copy and tries again later.
+ *
+ * Only the first two channels are kept, mono is stored as two
+ * identical channels.
+ */
+class PcmTap final
+{
+public:
+    // About 170 ms at 48 kHz
+    static constexpr size_t CAPACITY_FRAMES{1 << 13};
+    static constexpr int CHANNELS{2};
+
+private:
+    static constexpr size_t MASK{CAPACITY_FRAMES - 1};
+
+    // Both channels of a frame in one atomic, so a frame is never torn
+    std::unique_ptr<std::atomic<uint32_t>[]> m_frames{
+        new std::atomic<uint32_t>[CAPACITY_FRAMES]{}};
+    // The writer announces the frames it's going to overwrite here...
+    alignas(64) std::atomic<uint64_t> m_reservedFrame{};
+    // ...and publishes them here when they are written
+    alignas(64) std::atomic<uint64_t> m_writtenFrame{};
+    std::atomic<int> m_sampleRate{};
+
+    static inline uint32_t packFrame(int16_t left, int16_t right)
+    {
+        return (uint32_t)(uint16_t)left | (uint32_t)(uint16_t)right << 16;
+    }
+
+public:
+    PcmTap() {}
+    PcmTap(const PcmTap&) = delete;
+    PcmTap(PcmTap&&) = delete;
+    PcmTap& operator=(const PcmTap&) = delete;
+    PcmTap& operator=(PcmTap&&) = delete;
+
+    /*
+     * Writer only.
+     * Store interleaved frames, only the last `CAPACITY_FRAMES` are kept.
+     */
+    void write(const int16_t *samples, size_t frames, int channels, int sampleRate)
+    {
+        if (channels <= 0)
+            return;
+        if (frames > CAPACITY_FRAMES)
+        {
+            samples += (frames - CAPACITY_FRAMES) * channels;
+            frames = CAPACITY_FRAMES;
+        }
+
+        const uint64_t start{m_writtenFrame.load(std::memory_order_relaxed)};
+        m_reservedFrame.store(start + frames, std::memory_order_relaxed);
+        // The reservation must be visible before any of the new frames
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const int rightI{channels > 1 ? 1 : 0};
+        for (size_t i{}; i < frames; ++i)
+        {
+            m_frames[(start + i) & MASK].store(
+                    packFrame(samples[i*channels], samples[i*channels + rightI]),
+                    std::memory_order_relaxed);
+        }
+
+        m_sampleRate.store(sampleRate, std::memory_order_relaxed);
+        m_writtenFrame.store(start + frames, std::memory_order_release);
+    }
+
+    /*
+     * Reader only.
+     * Copy the last `frames` frames (at most `CAPACITY_FRAMES`) to `output`
+     * as interleaved stereo. Fewer frames are copied if fewer were written.
+     * `endFrameOut` gets the number of frames written before the last one
+     * copied, `sampleRateOut` their sample rate.
+     *
+     * Returns the number of frames copied, 0 if the writer overwrote
+     * them while copying.
+     */
+    size_t read(int16_t *output, size_t frames, uint64_t &endFrameOut, int &sampleRateOut) const
+    {
+        const uint64_t end{m_writtenFrame.load(std::memory_order_acquire)};
+        frames = std::min<uint64_t>({frames, CAPACITY_FRAMES, end});
+        const uint64_t start{end - frames};
+        sampleRateOut = m_sampleRate.load(std::memory_order_relaxed);
+
+        for (size_t i{}; i < frames; ++i)
+        {
+            const uint32_t frame{m_frames[(start + i) & MASK].load(std::memory_order_relaxed)};
+            output[i*2] = (int16_t)(frame & 0xffff);
+            output[i*2 + 1] = (int16_t)(frame >> 16);
+        }
+
+        // Check if the writer got to the copied frames
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_reservedFrame.load(std::memory_order_relaxed) - start > CAPACITY_FRAMES)
+            return 0;
+
+        endFrameOut = end;
+        return frames;
+    }
+
+    /*
+     * Return the number of frames written since the creation.
+     */
+    inline uint64_t getWrittenFrameCount() const
+    {
+        return m_writtenFrame.load(std::memory_order_acquire);
+    }
+};
@@ -0,0 +1,138 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Ties a position in the PCM buffer to a position in a track.
+ * The samples written to the buffer from `ringPosition` on are the
+ * frames of the track from `trackFrame` on.
+ */
+struct ClockAnchor
+{
+    size_t ringPosition{};
+    int64_t trackFrame{};
+    int sampleRate{};
+    int channels{};
+};
+
+/*
+ * The position of the sample that is heard right now.
+ *
+ * Readers don't lock: the fields are protected by a sequence counter
+ * (seqlock), a reader retries if a write happened while it was reading.
+ * Between two updates the position is extrapolated with the
+ * steady clock, so it has sub-millisecond resolution.
+ */
+class PlaybackClock final
+{
+public:
+    // Don't extrapolate further than this from the last update,
+    // so the clock stops if the output stalls
+    static constexpr int64_t MAX_EXTRAPOLATION_NS{200'000'000};
+
+private:
+    // Serializes the writers, the readers don't use it
+    std::mutex m_writeMutex;
+    // Odd while a write is in progress
+    std::atomic<uint32_t> m_sequence{};
+    std::atomic<int64_t> m_frame{};
+    std::atomic<int> m_sampleRate{};
+    std::atomic<int64_t> m_updateTimeNs{};
+    std::atomic<bool> m_isRunning{};
+
+    static inline int64_t getNowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    /*
+     * Set the frame heard now. If `isRunning` is false, the position
+     * is not extrapolated (paused, seeked).
+     */
+    void update(int64_t frame, int sampleRate, bool isRunning)
+    {
+        std::lock_guard<std::mutex> lock{m_writeMutex};
+
+        const uint32_t sequence{m_sequence.load(std::memory_order_relaxed)};
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_frame.store(frame, std::memory_order_relaxed);
+        m_sampleRate.store(sampleRate, std::memory_order_relaxed);
+        m_updateTimeNs.store(getNowNs(), std::memory_order_relaxed);
+        m_isRunning.store(isRunning, std::memory_order_relaxed);
+
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /*
+     * Return the position in seconds. Can be called from any thread.
+     */
+    double getPositionS() const
+    {
+        int64_t frame;
+        int sampleRate;
+        int64_t updateTimeNs;
+        bool isRunning;
+        while (true)
+        {
+            const uint32_t sequence{m_sequence.load(std::memory_order_acquire)};
+            if (sequence & 1)
+                continue;
+
+            frame        = m_frame.load(std::memory_order_relaxed);
+            sampleRate   = m_sampleRate.load(std::memory_order_relaxed);
+            updateTimeNs = m_updateTimeNs.load(std::memory_order_relaxed);
+            isRunning    = m_isRunning.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_sequence.load(std::memory_order_relaxed) == sequence)
+                break;
+        }
+
+        if (sampleRate <= 0)
+            return 0;
+
+        double positionS{(double)frame / sampleRate};
+        if (isRunning)
+        {
+            const int64_t elapsedNs{getNowNs() - updateTimeNs};
+            positionS += (double)std::min(std::max<int64_t>(elapsedNs, 0), MAX_EXTRAPOLATION_NS) / 1e9;
+        }
+        return positionS;
+    }
+};
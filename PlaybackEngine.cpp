@@ -0,0 +1,379 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "PlaybackEngine.h"
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+PlaybackEngine::PlaybackEngine(Playlist *playlist, PowerProfile powerProfile)
+    : m_playlist{playlist},
+    m_pcmBuffer{powerProfile == POWERPROFILE_LOW_POWER
+        ? LOW_POWER_PCM_BUFFER_SIZE : NORMAL_PCM_BUFFER_SIZE}
+{
+    const size_t capacity{m_pcmBuffer.getCapacity()};
+    if (powerProfile == POWERPROFILE_LOW_POWER)
+    {
+        // Long bursts: fill almost all of it, wake up when most of it is played
+        m_highWatermark = capacity / 8 * 7;
+        m_lowWatermark  = capacity / 8;
+    }
+    else
+    {
+        // Leave room for the largest packets, refill often
+        m_highWatermark = capacity / 4 * 3;
+        m_lowWatermark  = capacity / 2;
+    }
+
+    m_playlist->setPcmBuffer(&m_pcmBuffer);
+}
+
+void PlaybackEngine::start()
+{
+    publishState();
+
+    m_isDecodeStopRequested = false;
+    m_isOutputStopRequested = false;
+    m_decodeThread = std::thread{&PlaybackEngine::decodeLoop, this};
+    m_outputThread = std::thread{&PlaybackEngine::outputLoop, this};
+}
+
+void PlaybackEngine::stop()
+{
+    // Stop the producer first, it may be waiting for the output thread
+    m_isDecodeStopRequested = true;
+    wakeDecodeThread();
+    if (m_decodeThread.joinable())
+        m_decodeThread.join();
+
+    m_isOutputStopRequested = true;
+    wakeOutputThread();
+    if (m_outputThread.joinable())
+        m_outputThread.join();
+}
+
+void PlaybackEngine::post(Command command, bool isFlushNeeded)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_commandMutex};
+        if (isFlushNeeded)
+        {
+            m_commands.push_back([this, command](Playlist &playlist){
+                // The mix of a crossfade is thrown away with the rest
+                playlist.cancelCrossfade();
+                command(playlist);
+                flushAfterCommand(playlist);
+            });
+        }
+        else
+        {
+            m_commands.push_back(std::move(command));
+        }
+    }
+    wakeDecodeThread();
+}
+
+void PlaybackEngine::postFlushIf(FlushingCommand command)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_commandMutex};
+        m_commands.push_back([this, command{std::move(command)}](Playlist &playlist){
+            if (!command(playlist))
+                return;
+            playlist.cancelCrossfade();
+            flushAfterCommand(playlist);
+        });
+    }
+    wakeDecodeThread();
+}
+
+void PlaybackEngine::flushAfterCommand(Playlist &playlist)
+{
+    // Show the new position right away, without waiting
+    // for its samples to reach the device
+    const Music *track{playlist.getCurrentTrack()};
+    m_clock.update(track->getOutputFramePosition(), track->getOutputSampleRate(), false);
+    if (track->getOutputSampleRate())
+        m_notifiedPositionS = track->getOutputFramePosition() / track->getOutputSampleRate();
+    notifyStateChange();
+    m_flushPosition = m_pcmBuffer.getWritePosition();
+    m_isFlushRequested = true;
+    wakeOutputThread();
+}
+
+void PlaybackEngine::wakeDecodeThread()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_wakeMutex};
+        m_isDecodeWakeRequested = true;
+    }
+    m_decodeWakeCv.notify_one();
+}
+
+void PlaybackEngine::wakeOutputThread()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_wakeMutex};
+        m_isOutputWakeRequested = true;
+    }
+    m_outputWakeCv.notify_one();
+}
+
+void PlaybackEngine::waitForDecodeWakeup()
+{
+    std::unique_lock<std::mutex> lock{m_wakeMutex};
+    m_decodeWakeCv.wait(lock, [this](){ return m_isDecodeWakeRequested; });
+    m_isDecodeWakeRequested = false;
+}
+
+void PlaybackEngine::waitForOutputWakeup()
+{
+    std::unique_lock<std::mutex> lock{m_wakeMutex};
+    m_outputWakeCv.wait(lock, [this](){ return m_isOutputWakeRequested; });
+    m_isOutputWakeRequested = false;
+}
+
+void PlaybackEngine::runCommands()
+{
+    std::deque<Command> commands;
+    {
+        std::lock_guard<std::mutex> lock{m_commandMutex};
+        commands.swap(m_commands);
+    }
+
+    if (commands.empty())
+        return;
+
+    const size_t writePositionBefore{m_pcmBuffer.getWritePosition()};
+    for (auto &command : commands)
+        command(*m_playlist);
+    recordClockAnchor(writePositionBefore);
+    publishState();
+}
+
+void PlaybackEngine::publishState()
+{
+    Music *track{m_playlist->getCurrentTrack()};
+    const Music::State state{track->getState()};
+    const int64_t durationS{track->getDurationS()};
+    const size_t trackIndex{(size_t)m_playlist->getCurrentTrackIndex()};
+    const uint64_t playlistSequence{m_playlist->getJournal().getLatestSequence()};
+    auto trackInfo{track->getTrackInfo()};
+
+    // Only this thread writes them, so there is no race between
+    // the comparison and the store
+    const bool isChanged{
+        state != m_trackState
+        || durationS != m_durationS
+        || trackIndex != m_currentTrackIndex
+        || playlistSequence != m_playlistSequence
+        || trackInfo != std::atomic_load(&m_trackInfo)};
+    if (!isChanged)
+        return;
+
+    m_trackState          = state;
+    m_durationS           = durationS;
+    m_currentTrackIndex   = trackIndex;
+    m_playlistSequence    = playlistSequence;
+    std::atomic_store(&m_trackInfo, std::move(trackInfo));
+
+    // The output thread may be waiting for an unpause
+    wakeOutputThread();
+
+    notifyStateChange();
+}
+
+void PlaybackEngine::recordClockAnchor(size_t writePositionBefore)
+{
+    const Music *track{m_playlist->getCurrentTrack()};
+    const int channels{track->getOutputChannelCount()};
+    if (channels == 0)
+        return;
+
+    // The frames written since `writePositionBefore` end at the current
+    // position of the track, minus what waits for a crossfade mix
+    const size_t written{m_pcmBuffer.getWritePosition() - writePositionBefore};
+    const ClockAnchor anchor{
+        writePositionBefore,
+        std::max<int64_t>(0, m_playlist->getPcmFramePosition() - (int64_t)(written / channels)),
+        track->getOutputSampleRate(),
+        channels};
+    // If the output thread is far behind, the tag is lost and the
+    // clock counts on from the previous one
+    m_clockAnchors.write(&anchor, 1);
+}
+
+void PlaybackEngine::notifyStateChange()
+{
+    std::lock_guard<std::mutex> lock{m_callbackMutex};
+    if (m_stateChangeCallback)
+        m_stateChangeCallback();
+}
+
+void PlaybackEngine::decodeLoop()
+{
+    while (!m_isDecodeStopRequested)
+    {
+        runCommands();
+
+        // Buffer is full enough, sleep until the output thread drains it
+        // to the low watermark or a command arrives
+        if (m_pcmBuffer.getReadAvailable() >= m_highWatermark)
+        {
+            waitForDecodeWakeup();
+            continue;
+        }
+
+        bool isTicked{};
+        if (!m_playlist->hasEnded())
+        {
+            const size_t writePositionBefore{m_pcmBuffer.getWritePosition()};
+            m_playlist->tickCurrentTrack();
+            recordClockAnchor(writePositionBefore);
+            isTicked = m_playlist->isPlaying();
+        }
+        publishState();
+
+        if (isTicked)
+        {
+            // The output thread may be waiting for samples
+            wakeOutputThread();
+        }
+        else
+        {
+            // Paused, ended or waiting for the buffer to drain,
+            // sleep until a command arrives or the output thread played
+            // the buffered samples
+            waitForDecodeWakeup();
+        }
+    }
+}
+
+void PlaybackEngine::outputLoop()
+{
+    // Position tags taken from the decode thread, oldest first
+    std::deque<ClockAnchor> anchors;
+    // Tags before this buffer position belong to flushed samples
+    size_t firstValidPosition{};
+    int64_t lastFrame{};
+    int lastSampleRate{};
+
+    while (!m_isOutputStopRequested)
+    {
+        if (m_isFlushRequested.exchange(false))
+        {
+            firstValidPosition = m_flushPosition;
+            m_pcmBuffer.discardUntil(firstValidPosition);
+            // The decode thread may be waiting for free space
+            wakeDecodeThread();
+        }
+
+        if (m_trackState == Music::STATE_PAUSED)
+        {
+            // Stop the clock where the sound stopped
+            if (lastSampleRate)
+            {
+                m_clock.update(lastFrame, lastSampleRate, false);
+                lastSampleRate = 0;
+            }
+            waitForOutputWakeup();
+            continue;
+        }
+
+        AudioOutput *output{m_playlist->getAudioOutput()};
+        const size_t channels{(size_t)output->getChannelCount()};
+        if (channels == 0 || m_pcmBuffer.getReadAvailable() < channels)
+        {
+            waitForOutputWakeup();
+            continue;
+        }
+
+        // The samples go right from the PCM buffer to the sink
+        size_t takenCount{};
+        if (output->writeFrom(m_pcmBuffer, OUTPUT_CHUNK_SIZE, takenCount))
+        {
+            // Drop a chunk if the sink failed before taking any,
+            // so a broken sink doesn't stop the playlist
+            if (takenCount == 0)
+            {
+                const size_t count{std::min(m_pcmBuffer.getReadAvailable(), OUTPUT_CHUNK_SIZE / channels * channels)};
+                m_pcmBuffer.discardUntil(m_pcmBuffer.getReadPosition() + count);
+                takenCount = count;
+            }
+            std::cerr << "Output stage failed to write " << takenCount << " samples" << '\n';
+        }
+        else if (takenCount == 0)
+        {
+            // The sink is being reopened with another format,
+            // the decode thread wakes us up when it is done
+            waitForOutputWakeup();
+            continue;
+        }
+
+        // The sample heard now is behind the read position by the
+        // samples still queued in the device
+        const size_t delaySamples{(size_t)output->getDelayFrames() * channels};
+        const size_t readPosition{m_pcmBuffer.getReadPosition()};
+        const size_t audiblePosition{readPosition - std::min(delaySamples, readPosition)};
+
+        ClockAnchor anchor;
+        while (m_clockAnchors.read(&anchor, 1))
+        {
+            if (anchor.ringPosition >= firstValidPosition)
+                anchors.push_back(anchor);
+        }
+        // Keep the last tag that is already audible, drop the older ones
+        while (anchors.size() > 1 && anchors[1].ringPosition <= audiblePosition)
+            anchors.pop_front();
+
+        // Before the first tag the device still plays flushed samples,
+        // the clock keeps the position set by the seek
+        if (!anchors.empty() && anchors.front().ringPosition <= audiblePosition)
+        {
+            const ClockAnchor &base{anchors.front()};
+            lastFrame = base.trackFrame
+                + (int64_t)((audiblePosition - base.ringPosition) / base.channels);
+            lastSampleRate = base.sampleRate;
+            m_clock.update(lastFrame, lastSampleRate, true);
+
+            const int64_t positionS{lastFrame / lastSampleRate};
+            if (m_notifiedPositionS.exchange(positionS) != positionS)
+                notifyStateChange();
+        }
+
+        // Time to decode the next burst
+        if (m_pcmBuffer.getReadAvailable() <= m_lowWatermark)
+            wakeDecodeThread();
+    }
+}
+
+PlaybackEngine::~PlaybackEngine()
+{
+    stop();
+    m_playlist->setPcmBuffer(nullptr);
+}
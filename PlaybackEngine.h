@@ -0,0 +1,263 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include "Playlist.h"
+#include "RingBuffer.h"
+#include "PlaybackClock.h"
+
+/*
+ * Plays a playlist on its own threads, so the GUI can't disturb the audio.
+ *
+ * The decode thread ticks the playlist and puts the resampled samples into
+ * a lock-free ring buffer. The output thread drains that buffer into the
+ * output device. The decode thread can run ahead of the device, so a short
+ * stall on the decode side is not audible.
+ *
+ * The decode thread fills the buffer up to the high watermark, then sleeps
+ * until the output thread drains it to the low watermark. Neither thread
+ * polls: they wake each other up with condition variables, and sleep
+ * while paused until a command arrives.
+ *
+ * Other threads don't touch the playlist directly: they post commands that
+ * are run by the decode thread and read the published state atomics.
+ * The track list (paths, journal) is read with `Playlist::lockTrackList()`,
+ * which the decode thread only holds while it changes the list, so opening
+ * a file on a slow disk doesn't block the reader.
+ *
+ * The playback position comes from the output side: the decode thread tags
+ * the buffered samples with their position in the track (`ClockAnchor`),
+ * the output thread counts the samples it gave to the device, subtracts
+ * the ones the device has not played yet and updates the `PlaybackClock`.
+ */
+class PlaybackEngine final
+{
+public:
+    using Command = std::function<void(Playlist&)>;
+    /*
+     * Returns true if it changed what is played, see `postFlushIf()`.
+     */
+    using FlushingCommand = std::function<bool(Playlist&)>;
+    /*
+     * Called on the decode or the output thread when the published
+     * state changed. Should only wake up the GUI thread.
+     */
+    using StateChangeCallback = std::function<void()>;
+
+    enum PowerProfile
+    {
+        // Keeps less than a second decoded ahead, uses little memory
+        POWERPROFILE_NORMAL,
+        // Decodes several seconds ahead in bursts and sleeps between them,
+        // so the CPU can stay in deep idle states (laptops, SBCs)
+        POWERPROFILE_LOW_POWER,
+    };
+
+    // Number of samples (not frames) the PCM buffer can hold
+    // About 0.7 s of 48 kHz stereo
+    static constexpr size_t NORMAL_PCM_BUFFER_SIZE{1 << 16};
+    // About 11 s of 48 kHz stereo
+    static constexpr size_t LOW_POWER_PCM_BUFFER_SIZE{1 << 20};
+    // Number of samples the output thread writes to the device at once
+    static constexpr size_t OUTPUT_CHUNK_SIZE{4096};
+    // Number of position tags the decode thread can queue for the output thread
+    static constexpr size_t CLOCK_ANCHOR_BUFFER_SIZE{4096};
+
+private:
+    Playlist *m_playlist{};
+    RingBuffer<int16_t> m_pcmBuffer;
+    // Stop decoding when the buffer has this many samples
+    size_t m_highWatermark{};
+    // Start decoding again when the buffer drained to this many samples
+    size_t m_lowWatermark{};
+
+    std::thread m_decodeThread;
+    std::thread m_outputThread;
+    std::atomic<bool> m_isDecodeStopRequested{};
+    std::atomic<bool> m_isOutputStopRequested{};
+
+    std::mutex m_commandMutex;
+    std::deque<Command> m_commands;
+
+    // The threads sleep on these when they have nothing to do
+    std::mutex m_wakeMutex;
+    std::condition_variable m_decodeWakeCv;
+    std::condition_variable m_outputWakeCv;
+    // Guarded by `m_wakeMutex`, so a wake-up is not lost if it comes
+    // before the thread starts waiting
+    bool m_isDecodeWakeRequested{};
+    bool m_isOutputWakeRequested{};
+
+    // Set by the decode thread when the buffered samples became invalid
+    // (seek, track change). The output thread throws away everything
+    // before `m_flushPosition`.
+    std::atomic<bool> m_isFlushRequested{};
+    std::atomic<size_t> m_flushPosition{};
+
+    // Written by the decode thread, read by the output thread
+    RingBuffer<ClockAnchor> m_clockAnchors{CLOCK_ANCHOR_BUFFER_SIZE};
+    PlaybackClock m_clock;
+    // The whole second of the clock the state change callback was called for
+    std::atomic<int64_t> m_notifiedPositionS{-1};
+
+    //-------------------------- Published state ------------------------------
+    std::atomic<Music::State> m_trackState{Music::STATE_UNINITIALIZED};
+    std::atomic<int64_t> m_durationS{};
+    std::atomic<size_t> m_currentTrackIndex{};
+    // Sequence number of the last playlist change, see `PlaylistJournal`
+    std::atomic<uint64_t> m_playlistSequence{};
+    // Read and written with `std::atomic_load()` and `std::atomic_store()`
+    std::shared_ptr<const TrackInfo> m_trackInfo;
+    //-------------------------------------------------------------------------
+
+    std::mutex m_callbackMutex;
+    StateChangeCallback m_stateChangeCallback;
+
+    void decodeLoop();
+    void outputLoop();
+
+    void wakeDecodeThread();
+    void wakeOutputThread();
+    /*
+     * Sleep until the matching `wake*Thread()` is called.
+     * Returns immediately if it was called since the last wait.
+     */
+    void waitForDecodeWakeup();
+    void waitForOutputWakeup();
+
+    /*
+     * Run the commands posted since the last call.
+     * Called by the decode thread.
+     */
+    void runCommands();
+
+    /*
+     * Update the published state atomics and call the state change
+     * callback if any of them changed.
+     * Called by the decode thread.
+     */
+    void publishState();
+
+    /*
+     * Tell the output thread which track position the samples written
+     * to the PCM buffer from `writePositionBefore` on belong to.
+     * Called by the decode thread after writing.
+     */
+    void recordClockAnchor(size_t writePositionBefore);
+
+    /*
+     * Throw away the samples in the PCM buffer and show the position of
+     * the current track right away. Called by the decode thread after
+     * a command changed what is played.
+     */
+    void flushAfterCommand(Playlist &playlist);
+
+    /*
+     * Call the state change callback, if there is one.
+     */
+    void notifyStateChange();
+
+public:
+    PlaybackEngine(Playlist *playlist, PowerProfile powerProfile=POWERPROFILE_NORMAL);
+    PlaybackEngine(const PlaybackEngine&) = delete;
+    PlaybackEngine(PlaybackEngine&&) = delete;
+    PlaybackEngine& operator=(const PlaybackEngine&) = delete;
+    PlaybackEngine& operator=(PlaybackEngine&&) = delete;
+
+    /*
+     * Start the decode and output threads.
+     */
+    void start();
+    /*
+     * Stop and join the threads. Called by the destructor.
+     */
+    void stop();
+
+    /*
+     * Queue a command to be run on the decode thread.
+     * If `isFlushNeeded` is true, the samples decoded before the command
+     * are thrown away instead of being played (use it when seeking or
+     * changing track).
+     */
+    void post(Command command, bool isFlushNeeded=false);
+    /*
+     * Queue a command that decides itself whether the samples decoded
+     * before it are thrown away, by returning true.
+     * For commands that only sometimes change what is played
+     * (adding to an empty playlist, removing the current track).
+     */
+    void postFlushIf(FlushingCommand command);
+
+    /*
+     * Only read the track list of it, while holding `lockTrackList()`,
+     * everything else is used by the decode thread.
+     */
+    inline Playlist* getPlaylist() { return m_playlist; }
+
+    /*
+     * Set the function called when the published state changes.
+     * It is also called when the playback position reaches a new second,
+     * so while playing it is called about once a second, when paused
+     * not at all. Pass nullptr to remove it.
+     */
+    inline void setStateChangeCallback(StateChangeCallback callback)
+    {
+        std::lock_guard<std::mutex> lock{m_callbackMutex};
+        m_stateChangeCallback = std::move(callback);
+    }
+
+    inline Music::State getTrackState() const { return m_trackState; }
+    inline bool isPlaying() const { return m_trackState == Music::STATE_PLAYING; }
+    /*
+     * Return the position of the sample heard now, in seconds.
+     * Lock-free, cheap enough to call on every frame of an animation.
+     */
+    inline double getPositionS() const { return m_clock.getPositionS(); }
+    inline int64_t getCurrentTimestampS() const { return (int64_t)m_clock.getPositionS(); }
+    inline int64_t getDurationS() const { return m_durationS; }
+    inline size_t getCurrentTrackIndex() const { return m_currentTrackIndex; }
+    inline uint64_t getPlaylistSequence() const { return m_playlistSequence; }
+    /*
+     * Return the description of the current track, nullptr if none is open.
+     */
+    inline std::shared_ptr<const TrackInfo> getTrackInfo() const
+    {
+        return std::atomic_load(&m_trackInfo);
+    }
+
+    ~PlaybackEngine();
+};
@@ -29,9 +29,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Playlist.h"
 #include <iostream>
 #include <algorithm>
+#include <numeric>
+#include <random>
+#include <chrono>
+#include <cmath>
 
-Playlist::Playlist(const std::string &audioDevName)
-    : m_audioDevName{audioDevName}
+Playlist::Playlist(std::unique_ptr<AudioSink> sink)
+    : m_output{std::move(sink)}
 {
 }
 
@@ -57,10 +61,15 @@ void Playlist::openTrackAtIndex(size_t index)
         return;
     }
 
-    m_currentTrack->closeAndReset();
+    cancelCrossfade();
+    cancelPreload();
+    cancelSeekIndexScan();
+    getCurrentTrack()->closeAndReset();
 
+    if (m_prefetcher)
+        m_prefetcher->recordOpen(m_filePaths[index]);
     // If failed to open track at the current index
-    if (m_currentTrack->open(m_filePaths[index], m_audioDevName))
+    if (getCurrentTrack()->open(m_filePaths[index], &m_output))
     {
         ++m_failsSinceLastOpenSuccess;
         // Try the next one
@@ -68,20 +77,296 @@ void Playlist::openTrackAtIndex(size_t index)
     }
     else
     {
-        m_currentTrackIndex = index;
+        setCurrentTrackIndex(index);
         m_failsSinceLastOpenSuccess = 0;
+        updateLibraryIndex();
+        applyReplayGain();
+        startSeekIndexScan();
+        startPreloadingNextTrack();
     }
 }
 
+void Playlist::updateLibraryIndex()
+{
+    if (!m_libraryIndex)
+        return;
+
+    const std::string &path{m_filePaths[m_currentTrackIndex]};
+    FileIdentity identity;
+    if (FileIdentity::get(path, identity))
+        return;
+    m_libraryIndex->update(path, identity, getCurrentTrack()->getMetadata());
+}
+
+int Playlist::parseReplayGainMode(const std::string &name, ReplayGainMode &output)
+{
+    if (name == "off")
+        output = REPLAYGAIN_OFF;
+    else if (name == "track")
+        output = REPLAYGAIN_TRACK;
+    else if (name == "album")
+        output = REPLAYGAIN_ALBUM;
+    else
+        return 1;
+    return 0;
+}
+
+const char* Playlist::getReplayGainModeName(ReplayGainMode mode)
+{
+    switch (mode)
+    {
+    case REPLAYGAIN_OFF:   return "off";
+    case REPLAYGAIN_TRACK: return "track";
+    case REPLAYGAIN_ALBUM: return "album";
+    }
+    return "unknown";
+}
+
+void Playlist::setReplayGain(ReplayGainMode mode, double preampDb)
+{
+    m_replayGainMode = mode;
+    m_replayGainPreampDb = preampDb;
+    applyReplayGain();
+}
+
+double Playlist::getMeasuredAlbumLoudness(const std::string &album) const
+{
+    if (!m_libraryIndex)
+        return NAN;
+
+    // Mean of the powers weighted by the durations, as if the
+    // album was measured in one piece
+    double powerSum{};
+    double durationSum{};
+    for (const std::string &path : m_filePaths)
+    {
+        const std::optional<TrackMetadata> metadata{m_libraryIndex->find(path)};
+        if (!metadata || metadata->album != album || metadata->durationMs <= 0
+                || !metadata->loudness.isMeasured())
+            continue;
+
+        const double duration{(double)metadata->durationMs};
+        // Silent tracks count with zero power
+        if (std::isfinite(metadata->loudness.integratedLufs))
+            powerSum += duration*std::pow(10.0, metadata->loudness.integratedLufs/10.0);
+        durationSum += duration;
+    }
+
+    if (powerSum <= 0)
+        return NAN;
+    return 10.0*std::log10(powerSum/durationSum);
+}
+
+double Playlist::calculateReplayGainDb(const TrackMetadata &metadata) const
+{
+    const LoudnessInfo &loudness{metadata.loudness};
+
+    double gainDb{NAN};
+    if (m_replayGainMode == REPLAYGAIN_ALBUM)
+    {
+        gainDb = loudness.albumGainDb;
+        if (std::isnan(gainDb) && !metadata.album.empty())
+            gainDb = REPLAYGAIN_REFERENCE_LUFS - getMeasuredAlbumLoudness(metadata.album);
+    }
+    // Tracks without album information get their own gain
+    if (std::isnan(gainDb))
+        gainDb = loudness.trackGainDb;
+    if (std::isnan(gainDb) && std::isfinite(loudness.integratedLufs))
+        gainDb = REPLAYGAIN_REFERENCE_LUFS - loudness.integratedLufs;
+    if (std::isnan(gainDb))
+        gainDb = 0;
+
+    return std::clamp(gainDb + m_replayGainPreampDb, REPLAYGAIN_MIN_DB, REPLAYGAIN_MAX_DB);
+}
+
+void Playlist::applyReplayGain()
+{
+    Music *track{getCurrentTrack()};
+    if (track->getState() == Music::STATE_UNINITIALIZED)
+        return;
+
+    if (m_replayGainMode == REPLAYGAIN_OFF)
+    {
+        track->setGain(1.0f);
+        return;
+    }
+
+    // The tags are read from the file, the measurement is only in the index
+    TrackMetadata metadata{track->getMetadata()};
+    if (const std::optional<TrackMetadata> indexed{getTrackMetadataAt(m_currentTrackIndex)})
+    {
+        metadata.loudness.integratedLufs = indexed->loudness.integratedLufs;
+        metadata.loudness.truePeak = indexed->loudness.truePeak;
+    }
+
+    const double gainDb{calculateReplayGainDb(metadata)};
+    track->setGain(GainStage::dbToLinear(gainDb));
+    std::cout << "ReplayGain (" << getReplayGainModeName(m_replayGainMode)
+        << "): " << gainDb << " dB" << '\n';
+}
+
+void Playlist::startSeekIndexScan()
+{
+    Music *track{getCurrentTrack()};
+    if (m_seekIndexScan.valid() || !track->needsSeekIndex())
+        return;
+
+    m_isSeekIndexScanCancelled = false;
+    m_seekIndexScanPath = track->getFilePath();
+    const int streamIndex{track->getAudioStreamIndex()};
+    m_seekIndexScan = std::async(std::launch::async,
+            [this, path=m_seekIndexScanPath, streamIndex](){
+        SeekIndex index;
+        if (SeekIndex::scan(path, streamIndex, index, &m_isSeekIndexScanCancelled) == 0)
+        {
+            FileIdentity identity;
+            if (FileIdentity::get(path, identity) == 0)
+                index.saveToCache(path, identity);
+        }
+        return index;
+    });
+}
+
+void Playlist::cancelSeekIndexScan()
+{
+    if (!m_seekIndexScan.valid())
+        return;
+
+    m_isSeekIndexScanCancelled = true;
+    m_seekIndexScan.get();
+    m_seekIndexScanPath.clear();
+}
+
+void Playlist::collectSeekIndexScan()
+{
+    if (!m_seekIndexScan.valid()
+            || m_seekIndexScan.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+        return;
+
+    SeekIndex index{m_seekIndexScan.get()};
+    if (getCurrentTrack()->getFilePath() == m_seekIndexScanPath)
+    {
+        std::cout << "Seek index built with " << index.getEntryCount() << " entries" << '\n';
+        getCurrentTrack()->setSeekIndex(std::move(index));
+    }
+    m_seekIndexScanPath.clear();
+}
+
+void Playlist::schedulePrefetch()
+{
+    if (!m_prefetcher)
+        return;
+
+    // The track after the current one is opened by the preload right away,
+    // the read-ahead starts after it
+    const size_t firstIndex{std::min(m_currentTrackIndex + 2, m_filePaths.size())};
+    const size_t endIndex{std::min(firstIndex + m_prefetcher->getTrackCount(), m_filePaths.size())};
+    m_prefetcher->schedule(std::vector<std::string>(
+                m_filePaths.begin() + firstIndex, m_filePaths.begin() + endIndex));
+}
+
+void Playlist::startPreloadingNextTrack()
+{
+    if (m_preloadResult.valid())
+        return;
+
+    const size_t nextIndex{m_currentTrackIndex + 1};
+    if (nextIndex < m_filePaths.size())
+    {
+        m_nextTrackPath = m_filePaths[nextIndex];
+        // Before scheduling, which forgets the track as it isn't upcoming anymore
+        if (m_prefetcher && m_nextTrackPath != m_prefetchCountedPath)
+        {
+            m_prefetcher->recordOpen(m_nextTrackPath);
+            m_prefetchCountedPath = m_nextTrackPath;
+        }
+    }
+
+    // Called after every track change and playlist edit,
+    // the upcoming tracks may have changed too
+    schedulePrefetch();
+
+    if (nextIndex >= m_filePaths.size())
+        return;
+
+    Music *nextTrack{m_nextTrack};
+    const std::string path{m_nextTrackPath};
+    m_preloadResult = std::async(std::launch::async, [nextTrack, path](){
+        return nextTrack->preload(path);
+    });
+}
+
+void Playlist::cancelPreload()
+{
+    if (!m_preloadResult.valid())
+        return;
+
+    m_preloadResult.get();
+    m_nextTrack->closeAndReset();
+    m_nextTrackPath.clear();
+}
+
+bool Playlist::isGaplessSwitchPossible()
+{
+    if (!m_preloadResult.valid()
+            || m_currentTrackIndex + 1 >= m_filePaths.size()
+            || m_filePaths[m_currentTrackIndex + 1] != m_nextTrackPath)
+        return false;
+
+    m_preloadResult.wait();
+    return m_nextTrack->getState() == Music::STATE_PAUSED
+        && m_nextTrack->canPlayWithoutReconfiguring(m_output);
+}
+
+bool Playlist::switchToPreloadedTrack()
+{
+    if (!m_preloadResult.valid())
+        return false;
+
+    const bool isPreloadOk{m_preloadResult.get() == Music::OPENERROR_OK};
+    if (!isPreloadOk || m_filePaths[m_currentTrackIndex] != m_nextTrackPath)
+    {
+        m_nextTrack->closeAndReset();
+        m_nextTrackPath.clear();
+        return false;
+    }
+
+    // Only reopens the device if the new track needs other parameters
+    if (m_nextTrack->attachOutput(&m_output))
+    {
+        m_nextTrack->closeAndReset();
+        m_nextTrackPath.clear();
+        return false;
+    }
+    m_nextTrack->unPause();
+
+    cancelSeekIndexScan();
+    Music *previousTrack{getCurrentTrack()};
+    m_currentTrack = m_nextTrack;
+    m_nextTrack = previousTrack;
+    m_nextTrackPath.clear();
+    if (m_nextTrack->getState() != Music::STATE_UNINITIALIZED)
+        m_nextTrack->closeAndReset();
+
+    m_failsSinceLastOpenSuccess = 0;
+    std::cout << "Switched to the preloaded track" << '\n';
+    updateLibraryIndex();
+    applyReplayGain();
+    startSeekIndexScan();
+
+    startPreloadingNextTrack();
+    return true;
+}
+
 void Playlist::startPlaying()
 {
     // If playlist is empty
     if (m_filePaths.size() < 1)
         return;
 
-    if (m_currentTrack->getState() == m_currentTrack->STATE_UNINITIALIZED)
+    if (getCurrentTrack()->getState() == Music::STATE_UNINITIALIZED)
         openTrackAtIndex(m_currentTrackIndex);
-    m_currentTrack->unPause();
+    getCurrentTrack()->unPause();
 }
 
 void Playlist::tickCurrentTrack()
@@ -90,22 +375,51 @@ void Playlist::tickCurrentTrack()
     if (m_filePaths.size() < 1)
         return;
 
+    collectSeekIndexScan();
+
+    Music *currentTrack{getCurrentTrack()};
+
+    // Both tracks are played until the fade is over
+    if (m_crossfader.isActive())
+    {
+        tickCrossfade();
+        return;
+    }
+
     // If music ended or errored out
-    if (m_currentTrack->hasEnded() || m_currentTrack->isInErrorState())
+    if (currentTrack->hasEnded() || currentTrack->isInErrorState())
     {
+        // If the next track needs a different output, the buffered end of
+        // this one has to be played before the device is reopened
+        if (m_pcmBuffer && m_pcmBuffer->getReadAvailable() > 0
+                && !isGaplessSwitchPossible())
+            return;
+
         std::cout << "Current music has ended or errored out, opening next one" << '\n';
 
         // Play the next music
-        ++m_currentTrackIndex;
+        setCurrentTrackIndex(m_currentTrackIndex + 1);
         // If the music index is valid
-        if (m_currentTrackIndex < m_filePaths.size())
+        if (m_currentTrackIndex < m_filePaths.size()
+                && !switchToPreloadedTrack())
             openTrackAtIndex(m_currentTrackIndex);
     }
+    // Preload the next track if the playlist changed since the last preload
+    else if (currentTrack->getState() == Music::STATE_PLAYING)
+    {
+        startPreloadingNextTrack();
+
+        if (startCrossfadeIfDue())
+        {
+            tickCrossfade();
+            return;
+        }
+    }
 
     // If the music index is valid
     if (m_currentTrackIndex < m_filePaths.size())
     {
-        m_currentTrack->tick();
+        getCurrentTrack()->tick();
     }
     // End of playlist
     else
@@ -114,14 +428,112 @@ void Playlist::tickCurrentTrack()
     }
 }
 
+bool Playlist::startCrossfadeIfDue()
+{
+    if (!m_pcmBuffer || !m_crossfader.isEnabled())
+        return false;
+
+    Music *outgoing{getCurrentTrack()};
+    const int64_t durationFrames{outgoing->getDurationFrames()};
+    if (durationFrames <= 0)
+        return false;
+    const int64_t remainingFrames{durationFrames - outgoing->getOutputFramePosition()};
+    int64_t fadeFrames{m_crossfader.getDurationFrames(outgoing->getOutputSampleRate())};
+    // Don't fade through the whole next track if it is short
+    if (m_nextTrack->getDurationFrames() > 0)
+        fadeFrames = std::min(fadeFrames, m_nextTrack->getDurationFrames() / 2);
+    if (remainingFrames <= 0 || remainingFrames > fadeFrames)
+        return false;
+
+    // The mix needs the same sample rate and channel count,
+    // otherwise the tracks are played after each other
+    if (!isGaplessSwitchPossible())
+        return false;
+
+    // Make the preloaded track current, the closed one in the fade
+    // slot takes the place of the outgoing track
+    Music *idleTrack{m_fadingTrack};
+    m_fadingTrack = outgoing;
+    m_currentTrack = idleTrack;
+    setCurrentTrackIndex(m_currentTrackIndex + 1);
+    if (!switchToPreloadedTrack())
+    {
+        m_currentTrack = outgoing;
+        m_fadingTrack = idleTrack;
+        setCurrentTrackIndex(m_currentTrackIndex - 1);
+        return false;
+    }
+
+    m_crossfader.start(remainingFrames, outgoing->getOutputSampleRate(), outgoing->getOutputChannelCount());
+    outgoing->setPcmBuffer(m_crossfader.getOutgoingBuffer());
+    getCurrentTrack()->setPcmBuffer(m_crossfader.getIncomingBuffer());
+    std::cout << "Crossfading for " << remainingFrames << " frames ("
+        << Crossfader::getCurveName(m_crossfader.getCurve()) << ")" << '\n';
+    return true;
+}
+
+void Playlist::tickCrossfade()
+{
+    Music *outgoing{m_fadingTrack};
+    Music *incoming{getCurrentTrack()};
+
+    // When paused, neither of them is decoded
+    if (incoming->getState() == Music::STATE_PAUSED)
+        return;
+
+    // Keep both decoders ahead of the mix point, one packet per tick each,
+    // so the overlap costs at most twice the decoding of a single track
+    if (outgoing->getState() == Music::STATE_PLAYING
+            && m_crossfader.getOutgoingBuffer()->getReadAvailable() < Crossfader::STAGING_LOOKAHEAD)
+        outgoing->tick();
+    if (incoming->getState() == Music::STATE_PLAYING
+            && m_crossfader.getIncomingBuffer()->getReadAvailable() < Crossfader::STAGING_LOOKAHEAD)
+        incoming->tick();
+
+    // The end of the outgoing track may come before the fade is over
+    // (the duration in the header is not exact), then it is mixed as silence
+    m_crossfader.mix(*m_pcmBuffer, outgoing->getState() != Music::STATE_PLAYING);
+
+    if (m_crossfader.isFadeDone()
+            || (incoming->getState() != Music::STATE_PLAYING
+                && m_crossfader.getIncomingBuffer()->getReadAvailable() == 0))
+        finishCrossfade();
+}
+
+void Playlist::finishCrossfade()
+{
+    // What the incoming track decoded ahead is played after the mix,
+    // if it doesn't fit, the next tick continues
+    if (!m_crossfader.finish(*m_pcmBuffer))
+        return;
+    releaseFadingTrack();
+    std::cout << "Crossfade finished" << '\n';
+}
+
+void Playlist::cancelCrossfade()
+{
+    if (!m_crossfader.isActive())
+        return;
+
+    m_crossfader.cancel();
+    releaseFadingTrack();
+}
+
+void Playlist::releaseFadingTrack()
+{
+    getCurrentTrack()->setPcmBuffer(m_pcmBuffer);
+    m_fadingTrack->closeAndReset();
+    m_fadingTrack->setPcmBuffer(m_pcmBuffer);
+}
+
 void Playlist::unpauseCurrentTrack()
 {
-    m_currentTrack->unPause();
+    getCurrentTrack()->unPause();
 }
 
 void Playlist::pauseCurrentTrack()
 {
-    m_currentTrack->pause();
+    getCurrentTrack()->pause();
 }
 
 void Playlist::jumpToPrevTrack()
@@ -137,20 +549,79 @@ void Playlist::jumpToNextTrack()
     openTrackAtIndex(m_currentTrackIndex + 1);
 }
 
+int Playlist::seekCurrentTrackToS(double seconds)
+{
+    Music *track{getCurrentTrack()};
+    if (track->getState() == Music::STATE_UNINITIALIZED)
+        return 1;
+    if (track->seekToS(seconds))
+        return 1;
+
+    // The index went past the end when the last track ended,
+    // the track itself is still open
+    if (hasEnded() && !m_filePaths.empty())
+        setCurrentTrackIndex(m_filePaths.size() - 1);
+    return 0;
+}
+
 void Playlist::reloadCurrentTrack()
 {
     openTrackAtIndex(m_currentTrackIndex);
 }
 
+void Playlist::moveTrack(size_t fromIndex, size_t toIndex)
+{
+    if (fromIndex >= m_filePaths.size() || toIndex >= m_filePaths.size()
+            || fromIndex == toIndex)
+        return;
+
+    cancelPreload();
+
+    std::lock_guard<std::mutex> lock{m_trackListMutex};
+    // Rotate the range between the two positions
+    if (fromIndex < toIndex)
+        std::rotate(m_filePaths.begin() + fromIndex, m_filePaths.begin() + fromIndex + 1,
+                m_filePaths.begin() + toIndex + 1);
+    else
+        std::rotate(m_filePaths.begin() + toIndex, m_filePaths.begin() + fromIndex,
+                m_filePaths.begin() + fromIndex + 1);
+    m_journal.recordMove(fromIndex, toIndex);
+
+    // Follow the current track
+    if (m_currentTrackIndex == fromIndex)
+        setCurrentTrackIndexLocked(toIndex);
+    else if (fromIndex < m_currentTrackIndex && toIndex >= m_currentTrackIndex)
+        setCurrentTrackIndexLocked(m_currentTrackIndex - 1);
+    else if (fromIndex > m_currentTrackIndex && toIndex <= m_currentTrackIndex)
+        setCurrentTrackIndexLocked(m_currentTrackIndex + 1);
+}
+
 void Playlist::shuffle()
 {
-    std::random_shuffle(m_filePaths.begin(), m_filePaths.end());
-    m_isPlaylistChanged = true;
+    cancelPreload();
+
+    std::vector<size_t> permutation(m_filePaths.size());
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::shuffle(permutation.begin(), permutation.end(), std::mt19937{std::random_device{}()});
+
+    std::vector<std::string> shuffledPaths;
+    shuffledPaths.reserve(m_filePaths.size());
+    for (size_t from : permutation)
+        shuffledPaths.push_back(m_filePaths[from]);
+    {
+        std::lock_guard<std::mutex> lock{m_trackListMutex};
+        m_filePaths = std::move(shuffledPaths);
+        m_journal.recordPermute(std::move(permutation));
+    }
 
     openTrackAtIndex(0);
 }
 
 Playlist::~Playlist()
 {
-    delete m_currentTrack;
+    cancelPreload();
+    cancelSeekIndexScan();
+    delete m_currentTrack.load();
+    delete m_nextTrack;
+    delete m_fadingTrack;
 }
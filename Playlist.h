@@ -30,30 +30,171 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <vector>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <future>
+#include <optional>
 #include "Music.h"
+#include "LibraryIndex.h"
+#include "PlaylistJournal.h"
+#include "Crossfader.h"
+#include "LoudnessAnalyzer.h"
+#include "Prefetcher.h"
 
 /*
  * This class represents a playlist containing tracks.
  */
 class Playlist final
 {
+public:
+    enum ReplayGainMode
+    {
+        REPLAYGAIN_OFF,
+        // Every track is played at the same loudness
+        REPLAYGAIN_TRACK,
+        // The tracks of an album keep their loudness relative to each other
+        REPLAYGAIN_ALBUM,
+    };
+
+    // The loudness the gains bring the tracks to (ReplayGain 2.0)
+    static constexpr double REPLAYGAIN_REFERENCE_LUFS{-18.0};
+    static constexpr double REPLAYGAIN_MIN_DB{-24.0};
+    static constexpr double REPLAYGAIN_MAX_DB{12.0};
+
 private:
-    // Name of the output audio device
-    std::string m_audioDevName;
+    // The output device, kept open while the playlist exists
+    AudioOutput m_output;
     // We don't store the file contents, only the
     // filenames and open them on-the-fly
     std::vector<std::string> m_filePaths;
     // Index of currently played music in the playlist
     size_t m_currentTrackIndex{};
     // Currently played music
-    Music *m_currentTrack{new Music};
-    // If the playlist changed since last time
-    bool m_isPlaylistChanged{true};
+    // Atomic, so other threads can see which track is current
+    std::atomic<Music*> m_currentTrack{new Music};
+    // The track after the current one, opened in the background,
+    // so it can be started without a gap
+    Music *m_nextTrack{new Music};
+    // The track fading out during a crossfade, otherwise closed
+    Music *m_fadingTrack{new Music};
+    Crossfader m_crossfader;
+    // Path of the track in `m_nextTrack`
+    std::string m_nextTrackPath;
+    // Result of the background preload of `m_nextTrack`,
+    // not valid if there is no preload
+    std::future<Music::OpenError> m_preloadResult;
+    // Builds the seek index of the current track in the background,
+    // not valid if there is no scan
+    std::future<SeekIndex> m_seekIndexScan;
+    // Path of the scanned track
+    std::string m_seekIndexScanPath;
+    std::atomic<bool> m_isSeekIndexScanCancelled{};
+    // Where the tracks put their decoded samples, can be nullptr
+    RingBuffer<int16_t> *m_pcmBuffer{};
+    // Stores the metadata of the opened tracks, can be nullptr
+    LibraryIndex *m_libraryIndex{};
+    // Measures the added tracks, can be nullptr
+    LoudnessAnalyzer *m_loudnessAnalyzer{};
+    // Reads ahead the upcoming tracks, can be nullptr
+    Prefetcher *m_prefetcher{};
+    // The last preloaded track counted by the prefetcher, so preloading it
+    // again after a playlist edit doesn't count as another open
+    std::string m_prefetchCountedPath;
+    ReplayGainMode m_replayGainMode{REPLAYGAIN_OFF};
+    double m_replayGainPreampDb{};
+
+    /*
+     * If the current track is close enough to its end, make the preloaded
+     * track current and start fading from the old one to it.
+     *
+     * Returns true if the crossfade started.
+     */
+    bool startCrossfadeIfDue();
+    /*
+     * Decode both tracks of the crossfade and mix them.
+     */
+    void tickCrossfade();
+    /*
+     * End the crossfade, the current track continues alone.
+     * Waits for the next tick if the PCM buffer is full.
+     */
+    void finishCrossfade();
+    /*
+     * Close the track that faded out and give the PCM buffer
+     * back to the tracks.
+     */
+    void releaseFadingTrack();
+
+    /*
+     * Put the metadata of the current track to the library index.
+     */
+    void updateLibraryIndex();
+
+    /*
+     * Calculate the gain of a track from its tags or its measured loudness.
+     * Returns 0 dB (and the preamp) if neither is known.
+     */
+    double calculateReplayGainDb(const TrackMetadata &metadata) const;
+    /*
+     * Return the loudness of the measured tracks of the album in the
+     * playlist, NAN if none of them is measured.
+     */
+    double getMeasuredAlbumLoudness(const std::string &album) const;
+    /*
+     * Set the gain of the current track according to the ReplayGain mode.
+     */
+    void applyReplayGain();
+
+    /*
+     * Tell the prefetcher which tracks come after the current one
+     * and the preloaded one.
+     */
+    void schedulePrefetch();
+
+    /*
+     * Start building the seek index of the current track if it needs one.
+     */
+    void startSeekIndexScan();
+    /*
+     * Stop the scan and wait for it.
+     */
+    void cancelSeekIndexScan();
+    /*
+     * Give the result of a finished scan to the current track.
+     */
+    void collectSeekIndexScan();
+    // The changes of the track list and the current index
+    PlaylistJournal m_journal;
+    // Guards `m_filePaths`, `m_currentTrackIndex` and `m_journal` against
+    // readers on other threads, see `lockTrackList()`. Only held while they
+    // are changed in memory, never while a file is opened or a preload
+    // is waited for.
+    mutable std::mutex m_trackListMutex;
     // Number of fails since the last successful open
     int m_failsSinceLastOpenSuccess{};
 
+    /*
+     * Set `m_currentTrackIndex` and record it in the journal if it changed.
+     * `m_trackListMutex` must be held.
+     */
+    inline void setCurrentTrackIndexLocked(size_t index)
+    {
+        if (index == m_currentTrackIndex)
+            return;
+        m_currentTrackIndex = index;
+        m_journal.recordCurrentIndex(index);
+    }
+    inline void setCurrentTrackIndex(size_t index)
+    {
+        std::lock_guard<std::mutex> lock{m_trackListMutex};
+        setCurrentTrackIndexLocked(index);
+    }
+
 public:
-    Playlist(const std::string &audioDevName);
+    /*
+     * Create an empty playlist that plays to `sink`.
+     */
+    Playlist(std::unique_ptr<AudioSink> sink);
     Playlist(const Playlist&) = delete;
     Playlist(Playlist&&) = delete;
     Playlist& operator=(const Playlist&) = delete;
@@ -61,32 +202,73 @@ public:
 
     inline void addNewTrack(const std::string &filePath)
     {
-        m_filePaths.push_back(filePath);
-        m_isPlaylistChanged = true;
+        {
+            std::lock_guard<std::mutex> lock{m_trackListMutex};
+            m_filePaths.push_back(filePath);
+            m_journal.recordInsert(m_filePaths.size() - 1, 1);
+        }
+        if (m_loudnessAnalyzer)
+            m_loudnessAnalyzer->enqueue({filePath});
+    }
+
+    /*
+     * Append tracks to the end of the playlist.
+     * Recorded as a single change.
+     */
+    inline void addNewTracks(const std::vector<std::string> &filePaths)
+    {
+        {
+            std::lock_guard<std::mutex> lock{m_trackListMutex};
+            const size_t firstIndex{m_filePaths.size()};
+            m_filePaths.insert(m_filePaths.end(), filePaths.begin(), filePaths.end());
+            m_journal.recordInsert(firstIndex, filePaths.size());
+        }
+        if (m_loudnessAnalyzer)
+            m_loudnessAnalyzer->enqueue(filePaths);
     }
 
     inline void removeTrack(size_t index)
     {
-        if (m_filePaths.size() == 0)
+        if (index >= m_filePaths.size())
             return;
 
-        m_filePaths.erase(m_filePaths.begin() + index);
+        cancelPreload();
+
+        {
+            std::lock_guard<std::mutex> lock{m_trackListMutex};
+            m_filePaths.erase(m_filePaths.begin() + index);
+            m_journal.recordRemove(index, 1);
+            // Keep the index pointing to the same track
+            if (index < m_currentTrackIndex)
+                setCurrentTrackIndexLocked(m_currentTrackIndex - 1);
+        }
 
         // If the currently playing track needs to be removed
         if (index == m_currentTrackIndex)
             // Open the new current track
             openTrackAtIndex(m_currentTrackIndex);
-
-        m_isPlaylistChanged = true;
     }
 
     inline void removeAllTracks()
     {
-        m_filePaths.clear();
-        m_currentTrack->closeAndReset();
-        m_isPlaylistChanged = true;
+        cancelCrossfade();
+        cancelPreload();
+        cancelSeekIndexScan();
+        {
+            std::lock_guard<std::mutex> lock{m_trackListMutex};
+            m_journal.recordRemove(0, m_filePaths.size());
+            m_filePaths.clear();
+            setCurrentTrackIndexLocked(0);
+        }
+        getCurrentTrack()->closeAndReset();
     }
 
+    /*
+     * Move the track at `fromIndex` to `toIndex`.
+     * The current track stays the same.
+     */
+    void moveTrack(size_t fromIndex, size_t toIndex);
+
     void shuffle();
 
     inline size_t getNumOfTracks() const { return m_filePaths.size(); }
@@ -95,17 +277,129 @@ public:
     {
         return m_filePaths[index];
     }
+    /*
+     * Return the metadata of the track from the library index,
+     * without opening the file.
+     */
+    inline std::optional<TrackMetadata> getTrackMetadataAt(size_t index) const
+    {
+        if (!m_libraryIndex || index >= m_filePaths.size())
+            return std::nullopt;
+        return m_libraryIndex->find(m_filePaths[index]);
+    }
+    inline void setLibraryIndex(LibraryIndex *index) { m_libraryIndex = index; }
+    inline LibraryIndex* getLibraryIndex() { return m_libraryIndex; }
+    /*
+     * Set the analyzer that measures the tracks added from now on.
+     */
+    inline void setLoudnessAnalyzer(LoudnessAnalyzer *analyzer) { m_loudnessAnalyzer = analyzer; }
+    /*
+     * Set the prefetcher that reads ahead the upcoming tracks.
+     */
+    inline void setPrefetcher(Prefetcher *prefetcher) { m_prefetcher = prefetcher; }
+    inline Prefetcher* getPrefetcher() { return m_prefetcher; }
+
+    /*
+     * Set how the gain of the tracks is chosen, `preampDb` is added to it.
+     * Applies to the current track immediately.
+     */
+    void setReplayGain(ReplayGainMode mode, double preampDb);
+    inline ReplayGainMode getReplayGainMode() const { return m_replayGainMode; }
+    inline double getReplayGainPreampDb() const { return m_replayGainPreampDb; }
+
+    /*
+     * Parse a ReplayGain mode name ("off", "track" or "album").
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    static int parseReplayGainMode(const std::string &name, ReplayGainMode &output);
+    static const char* getReplayGainModeName(ReplayGainMode mode);
+
     inline std::string getCurrentTrackName() const
     {
         return m_filePaths.size() == 0 ? "" : m_filePaths[m_currentTrackIndex];
     }
     inline bool isPlaying() const
     {
-        return m_currentTrack->getState() == Music::STATE_PLAYING;
+        return getCurrentTrack()->getState() == Music::STATE_PLAYING;
     }
     bool hasEnded() const { return m_currentTrackIndex >= m_filePaths.size(); }
 
-    Music* getCurrentTrack() { return m_currentTrack; }
+    /*
+     * Can be called from any thread, but only the thread that ticks
+     * the playlist may use the returned track.
+     */
+    Music* getCurrentTrack() { return m_currentTrack.load(); }
+    const Music* getCurrentTrack() const { return m_currentTrack.load(); }
+
+    /*
+     * The output is thread safe, see `AudioOutput`.
+     */
+    AudioOutput* getAudioOutput() { return &m_output; }
+
+    /*
+     * Set the buffer where the tracks put their decoded samples.
+     * See `Music::setPcmBuffer()`.
+     */
+    inline void setPcmBuffer(RingBuffer<int16_t> *buffer)
+    {
+        cancelCrossfade();
+        cancelPreload();
+        m_pcmBuffer = buffer;
+        getCurrentTrack()->setPcmBuffer(buffer);
+        m_nextTrack->setPcmBuffer(buffer);
+        m_fadingTrack->setPcmBuffer(buffer);
+    }
+
+    /*
+     * Set the crossfade between the tracks, a duration of 0 turns it off.
+     * Only works with a PCM buffer, see `setPcmBuffer()`.
+     */
+    inline void setCrossfade(Crossfader::Curve curve, double durationS)
+    {
+        m_crossfader.setFade(curve, durationS);
+    }
+    inline const Crossfader& getCrossfader() const { return m_crossfader; }
+    inline bool isCrossfading() const { return m_crossfader.isActive(); }
+
+    /*
+     * Stop a running crossfade: the track fading out is closed and
+     * the mixed samples that are not in the PCM buffer yet are dropped.
+     * Called when the buffered samples are thrown away (seek, track change).
+     */
+    void cancelCrossfade();
+
+    /*
+     * Return the position in the current track of the frame after the last
+     * one put to the PCM buffer. During a crossfade it is behind the
+     * position of the track, which counts the samples waiting to be mixed.
+     */
+    inline int64_t getPcmFramePosition() const
+    {
+        return getCurrentTrack()->getOutputFramePosition()
+            - (int64_t)m_crossfader.getIncomingStagedFrames();
+    }
+
+    /*
+     * Start opening the track after the current one in the background.
+     */
+    void startPreloadingNextTrack();
+    /*
+     * Wait for the background preload to finish and close the preloaded track.
+     */
+    void cancelPreload();
+    /*
+     * If the preloaded track is the one at the current index, make it the
+     * current track (a pointer swap) and start preloading the next one.
+     *
+     * Returns true if succeeded, false if the track has to be opened normally.
+     */
+    bool switchToPreloadedTrack();
+    /*
+     * Return whether the preloaded track is the one after the current index
+     * and can continue on the output without reopening it.
+     * Waits for the preload to finish.
+     */
+    bool isGaplessSwitchPossible();
 
     void openTrackAtIndex(size_t index);
     void startPlaying();
@@ -115,21 +409,36 @@ public:
     void unpauseCurrentTrack();
     void pauseCurrentTrack();
 
+    /*
+     * Seek in the current track. If the playlist was played to the end,
+     * its last track becomes current again and plays from the position.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int seekCurrentTrackToS(double seconds);
+
     void jumpToPrevTrack();
     void jumpToNextTrack();
     void reloadCurrentTrack();
 
     /*
-     * Return whether the playlist has changed since the last time this
-     * function was called.
-     * If only the current index changed, it is not considered to be a change.
+     * Lock the track list for reading from another thread. While it is
+     * held, the paths, the current index and the journal don't change:
+     * `getNumOfTracks()`, `getTrackFilepathAt()`, `getTrackMetadataAt()`,
+     * `getCurrentTrackIndex()`, `getCurrentTrackName()`, `hasEnded()` and
+     * `getJournal()` can be called. The thread changing the playlist
+     * doesn't need it.
      */
-    inline bool isPlaylistChangedSinceLastTime()
+    inline std::unique_lock<std::mutex> lockTrackList() const
     {
-        bool origVal{m_isPlaylistChanged};
-        m_isPlaylistChanged = false;
-        return origVal;
+        return std::unique_lock<std::mutex>{m_trackListMutex};
     }
 
+    /*
+     * Return the changes made to the playlist.
+     * Only read it from other threads while holding `lockTrackList()`.
+     */
+    inline const PlaylistJournal& getJournal() const { return m_journal; }
+
     ~Playlist();
 };
@@ -0,0 +1,109 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "PlaylistJournal.h"
+#include <utility>
+
+void PlaylistJournal::append(PlaylistChange &&change)
+{
+    change.sequence = ++m_latestSequence;
+    m_entries.push_back(std::move(change));
+    if (m_entries.size() > MAX_ENTRIES)
+        m_entries.pop_front();
+}
+
+void PlaylistJournal::recordInsert(size_t index, size_t count)
+{
+    if (count == 0)
+        return;
+
+    PlaylistChange change;
+    change.type = PlaylistChange::TYPE_INSERT;
+    change.index = index;
+    change.count = count;
+    append(std::move(change));
+}
+
+void PlaylistJournal::recordRemove(size_t index, size_t count)
+{
+    if (count == 0)
+        return;
+
+    PlaylistChange change;
+    change.type = PlaylistChange::TYPE_REMOVE;
+    change.index = index;
+    change.count = count;
+    append(std::move(change));
+}
+
+void PlaylistJournal::recordMove(size_t fromIndex, size_t toIndex)
+{
+    if (fromIndex == toIndex)
+        return;
+
+    PlaylistChange change;
+    change.type = PlaylistChange::TYPE_MOVE;
+    change.index = fromIndex;
+    change.toIndex = toIndex;
+    change.count = 1;
+    append(std::move(change));
+}
+
+void PlaylistJournal::recordPermute(std::vector<size_t> &&permutation)
+{
+    PlaylistChange change;
+    change.type = PlaylistChange::TYPE_PERMUTE;
+    change.count = permutation.size();
+    change.permutation = std::make_shared<const std::vector<size_t>>(std::move(permutation));
+    append(std::move(change));
+}
+
+void PlaylistJournal::recordCurrentIndex(size_t index)
+{
+    PlaylistChange change;
+    change.type = PlaylistChange::TYPE_CURRENT_INDEX;
+    change.index = index;
+    append(std::move(change));
+}
+
+PlaylistJournal::ReadResult PlaylistJournal::readSince(
+        uint64_t sequence, std::vector<PlaylistChange> &output) const
+{
+    if (sequence >= m_latestSequence)
+        return READRESULT_OK;
+
+    // The next change the consumer needs was already dropped
+    if (m_entries.empty() || m_entries.front().sequence > sequence + 1)
+        return READRESULT_RESYNC;
+
+    // The sequence numbers are consecutive, so the first needed entry
+    // can be found without searching
+    const size_t firstI{(size_t)(sequence + 1 - m_entries.front().sequence)};
+    output.insert(output.end(), m_entries.begin() + firstI, m_entries.end());
+    return READRESULT_OK;
+}
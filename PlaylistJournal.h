@@ -0,0 +1,116 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * A change made to the playlist.
+ */
+struct PlaylistChange
+{
+    enum Type
+    {
+        // `count` tracks were inserted at `index`
+        TYPE_INSERT,
+        // `count` tracks were removed from `index`
+        TYPE_REMOVE,
+        // The track at `index` was moved to `toIndex`
+        TYPE_MOVE,
+        // Every track was reordered, see `permutation`
+        TYPE_PERMUTE,
+        // The current track index was changed to `index`
+        TYPE_CURRENT_INDEX,
+    };
+
+    Type type{};
+    // Sequence number of the change, the first one is 1
+    uint64_t sequence{};
+    size_t index{};
+    size_t count{};
+    size_t toIndex{};
+    // For `TYPE_PERMUTE`: the track at position i came from `permutation[i]`
+    std::shared_ptr<const std::vector<size_t>> permutation;
+};
+
+/*
+ * A bounded log of the changes made to the playlist.
+ *
+ * Every consumer (the GUI, the persistence, the prefetcher, ...) keeps the
+ * sequence number of the last change it processed and reads only the newer
+ * ones, so its work is proportional to the size of the change, not to the
+ * size of the playlist.
+ *
+ * Only the last `MAX_ENTRIES` changes are kept. A consumer that falls
+ * further behind has to rebuild its state from the playlist.
+ *
+ * Not thread safe, it is guarded by the same lock as the playlist.
+ */
+class PlaylistJournal final
+{
+public:
+    static constexpr size_t MAX_ENTRIES{1024};
+
+    enum ReadResult
+    {
+        // The changes were put to the output
+        READRESULT_OK,
+        // Some of the changes are not kept any more, the consumer has to
+        // rebuild its state and continue from `getLatestSequence()`
+        READRESULT_RESYNC,
+    };
+
+private:
+    std::deque<PlaylistChange> m_entries;
+    uint64_t m_latestSequence{};
+
+    void append(PlaylistChange &&change);
+
+public:
+    void recordInsert(size_t index, size_t count);
+    void recordRemove(size_t index, size_t count);
+    void recordMove(size_t fromIndex, size_t toIndex);
+    void recordPermute(std::vector<size_t> &&permutation);
+    void recordCurrentIndex(size_t index);
+
+    /*
+     * Return the sequence number of the newest change, 0 if there is none.
+     * A new consumer should start from here.
+     */
+    inline uint64_t getLatestSequence() const { return m_latestSequence; }
+
+    /*
+     * Append the changes newer than `sequence` to `output`.
+     */
+    ReadResult readSince(uint64_t sequence, std::vector<PlaylistChange> &output) const;
+};
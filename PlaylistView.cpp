@@ -0,0 +1,231 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "PlaylistView.h"
+#include <algorithm>
+#include <FL/fl_draw.H>
+
+PlaylistView::PlaylistView(int x, int y, int w, int h)
+    : Fl_Group(x, y, w, h)
+{
+    box(FL_DOWN_BOX);
+
+    m_scrollbar = new Fl_Scrollbar{
+            x+w-Fl::scrollbar_size(), y, Fl::scrollbar_size(), h};
+    m_scrollbar->type(FL_VERTICAL);
+    m_scrollbar->linesize(1);
+    m_scrollbar->callback(&s_scrollbar_cb, this);
+
+    end();
+    resizable(nullptr);
+}
+
+int PlaylistView::getRowHeight() const
+{
+    fl_font(m_textFont, m_textSize);
+    return fl_height() + 2;
+}
+
+size_t PlaylistView::getVisibleRowCount() const
+{
+    const int rowHeight{getRowHeight()};
+    return (h() + rowHeight - 1) / rowHeight;
+}
+
+void PlaylistView::updateScrollbar()
+{
+    // The fully visible rows
+    const int windowSize{std::max(1, h() / getRowHeight())};
+    m_scrollbar->value((int)m_topRow, windowSize, 0, (int)m_rowCount);
+}
+
+void PlaylistView::scrollToRow(size_t row)
+{
+    const size_t fullyVisibleRows{std::max<size_t>(1, h() / getRowHeight())};
+    const size_t maxTopRow{m_rowCount > fullyVisibleRows ? m_rowCount - fullyVisibleRows : 0};
+    const size_t newTopRow{std::min(row, maxTopRow)};
+    if (newTopRow != m_topRow)
+    {
+        m_topRow = newTopRow;
+        redraw();
+    }
+    updateScrollbar();
+}
+
+void PlaylistView::setRowCount(size_t count)
+{
+    m_rowCount = count;
+    if (m_currentRow != NO_ROW && m_currentRow >= count)
+        m_currentRow = NO_ROW;
+    // Clamp the scroll position
+    scrollToRow(m_topRow);
+    redraw();
+}
+
+void PlaylistView::rowsInserted(size_t index, size_t count)
+{
+    m_rowCount += count;
+    if (m_currentRow != NO_ROW && m_currentRow >= index)
+        m_currentRow += count;
+
+    if (index < m_topRow)
+        m_topRow += count;
+    else if (index < m_topRow + getVisibleRowCount())
+        redraw();
+    updateScrollbar();
+}
+
+void PlaylistView::rowsRemoved(size_t index, size_t count)
+{
+    count = std::min(count, m_rowCount - std::min(index, m_rowCount));
+    m_rowCount -= count;
+    if (m_currentRow != NO_ROW && m_currentRow >= index)
+        m_currentRow = m_currentRow >= index + count ? m_currentRow - count : NO_ROW;
+
+    if (index + count <= m_topRow)
+    {
+        m_topRow -= count;
+    }
+    // The first visible rows were removed
+    else if (index < m_topRow)
+    {
+        m_topRow = index;
+        redraw();
+    }
+    else if (index < m_topRow + getVisibleRowCount())
+    {
+        redraw();
+    }
+    // Clamp the scroll position
+    scrollToRow(m_topRow);
+}
+
+void PlaylistView::rowsChanged(size_t first, size_t last)
+{
+    if (last >= m_topRow && first < m_topRow + getVisibleRowCount())
+        redraw();
+}
+
+void PlaylistView::setCurrentRow(size_t row)
+{
+    if (row == m_currentRow)
+        return;
+    m_currentRow = row;
+    redraw();
+}
+
+void PlaylistView::scrollbar_cb()
+{
+    scrollToRow(std::max(0, m_scrollbar->value()));
+}
+
+void PlaylistView::resize(int x, int y, int w, int h)
+{
+    Fl_Widget::resize(x, y, w, h);
+    m_scrollbar->resize(x+w-Fl::scrollbar_size(), y, Fl::scrollbar_size(), h);
+    scrollToRow(m_topRow);
+}
+
+void PlaylistView::draw()
+{
+    const int rowHeight{getRowHeight()};
+    const size_t visibleRows{std::min(getVisibleRowCount(), m_rowCount - std::min(m_topRow, m_rowCount))};
+
+    m_visibleRowTexts.clear();
+    if (visibleRows && m_rowTextGetter)
+        m_rowTextGetter(m_topRow, visibleRows, m_visibleRowTexts);
+
+    fl_push_clip(x(), y(), getListWidth(), h());
+    fl_rectf(x(), y(), getListWidth(), h(), color());
+
+    fl_font(m_textFont, m_textSize);
+    for (size_t i{}; i < m_visibleRowTexts.size(); ++i)
+    {
+        const size_t row{m_topRow + i};
+        const int rowY{y() + (int)i * rowHeight};
+        if (row == m_currentRow)
+            fl_rectf(x(), rowY, getListWidth(), rowHeight, selection_color());
+
+        fl_color(m_textColor);
+        fl_draw(m_visibleRowTexts[i].c_str(), x()+3, rowY + rowHeight - fl_descent() - 1);
+    }
+
+    fl_pop_clip();
+
+    draw_child(*m_scrollbar);
+}
+
+int PlaylistView::handle(int event)
+{
+    switch (event)
+    {
+    case FL_PUSH:
+        if (Fl::event_inside(x(), y(), getListWidth(), h()))
+        {
+            const size_t row{m_topRow + (Fl::event_y() - y()) / getRowHeight()};
+            if (row < m_rowCount)
+            {
+                m_clickedRow = row;
+                do_callback();
+                m_clickedRow = NO_ROW;
+            }
+            return 1;
+        }
+        break;
+
+    case FL_MOUSEWHEEL:
+    {
+        const long newTopRow{(long)m_topRow + Fl::event_dy() * 3};
+        scrollToRow(std::max(0l, newTopRow));
+        return 1;
+    }
+
+    case FL_KEYDOWN:
+    {
+        const size_t pageSize{std::max<size_t>(1, h() / getRowHeight())};
+        switch (Fl::event_key())
+        {
+        case FL_Page_Up:
+            scrollToRow(m_topRow > pageSize ? m_topRow - pageSize : 0);
+            return 1;
+        case FL_Page_Down:
+            scrollToRow(m_topRow + pageSize);
+            return 1;
+        case FL_Home:
+            scrollToRow(0);
+            return 1;
+        case FL_End:
+            scrollToRow(m_rowCount);
+            return 1;
+        }
+        break;
+    }
+    }
+
+    return Fl_Group::handle(event);
+}
@@ -0,0 +1,141 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <FL/Fl.H>
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Scrollbar.H>
+
+/*
+ * A list widget that doesn't store its rows.
+ *
+ * Only the number of rows is known by the widget, the text of the visible
+ * rows is requested when drawing, so drawing takes the same time and the
+ * widget takes the same memory for any number of rows.
+ * The row of the current track is highlighted.
+ */
+class PlaylistView final : public Fl_Group
+{
+public:
+    /*
+     * Called when drawing, should put the text of the rows
+     * [`firstRow`, `firstRow`+`rowCount`) to `output`.
+     * It may put less rows if the list got shorter since `setRowCount()`.
+     */
+    using RowTextGetter = std::function<void(
+            size_t firstRow, size_t rowCount, std::vector<std::string> &output)>;
+
+    // Returned by `getClickedRow()` when no row was clicked
+    static constexpr size_t NO_ROW{(size_t)-1};
+
+private:
+    Fl_Scrollbar *m_scrollbar{};
+    RowTextGetter m_rowTextGetter;
+
+    size_t m_rowCount{};
+    // Index of the first visible row
+    size_t m_topRow{};
+    size_t m_currentRow{NO_ROW};
+    size_t m_clickedRow{NO_ROW};
+
+    Fl_Color m_textColor{FL_FOREGROUND_COLOR};
+    Fl_Font m_textFont{FL_HELVETICA};
+    Fl_Fontsize m_textSize{14};
+
+    // The text of the visible rows, reused between draws
+    std::vector<std::string> m_visibleRowTexts;
+
+    static void s_scrollbar_cb(Fl_Widget*, void *t)
+    {
+        static_cast<PlaylistView*>(t)->scrollbar_cb();
+    }
+    void scrollbar_cb();
+
+    int getRowHeight() const;
+    // Number of rows that fit in the widget, including a partially visible one
+    size_t getVisibleRowCount() const;
+    inline int getListWidth() const { return w() - m_scrollbar->w(); }
+
+    void updateScrollbar();
+
+protected:
+    void draw() override;
+
+public:
+    PlaylistView(int x, int y, int w, int h);
+    PlaylistView(const PlaylistView&) = delete;
+    PlaylistView(PlaylistView&&) = delete;
+    PlaylistView& operator=(const PlaylistView&) = delete;
+    PlaylistView& operator=(PlaylistView&&) = delete;
+
+    int handle(int event) override;
+    void resize(int x, int y, int w, int h) override;
+
+    inline void setRowTextGetter(RowTextGetter getter) { m_rowTextGetter = std::move(getter); }
+
+    /*
+     * Set the number of rows and redraw the visible ones.
+     * Call it when the playlist changes.
+     */
+    void setRowCount(size_t count);
+    inline size_t getRowCount() const { return m_rowCount; }
+
+    /*
+     * Update the widget after a change of the list.
+     * Only redraws if the change is visible, the rows above the
+     * visible ones shift the scroll position, so the view stays still.
+     */
+    void rowsInserted(size_t index, size_t count);
+    void rowsRemoved(size_t index, size_t count);
+    // Rows [`first`, `last`] have a new text
+    void rowsChanged(size_t first, size_t last);
+
+    /*
+     * Highlight a row, pass `NO_ROW` to highlight nothing.
+     */
+    void setCurrentRow(size_t row);
+    inline size_t getCurrentRow() const { return m_currentRow; }
+
+    /*
+     * Scroll so `row` is the first visible row, or as close as possible.
+     */
+    void scrollToRow(size_t row);
+
+    /*
+     * Return the row clicked by the user, valid in the callback.
+     */
+    inline size_t getClickedRow() const { return m_clickedRow; }
+
+    inline void textcolor(Fl_Color color) { m_textColor = color; }
+    inline void textfont(Fl_Font font) { m_textFont = font; }
+    inline void textsize(Fl_Fontsize size) { m_textSize = size; }
+};
@@ -0,0 +1,216 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Prefetcher.h"
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+// Read-ahead is issued in pieces of this size, so a cancel stops it soon
+constexpr size_t CHUNK_SIZE = 1 << 20;
+
+}
+
+Prefetcher::Prefetcher(size_t trackCount, size_t bytesPerTrack, size_t budgetBytes)
+    : m_trackCount{trackCount}, m_bytesPerTrack{bytesPerTrack}, m_budgetBytes{budgetBytes},
+    m_budgetLeft{budgetBytes}
+{
+}
+
+void Prefetcher::start()
+{
+    m_isStopRequested = false;
+    m_worker = std::thread{&Prefetcher::workerLoop, this};
+}
+
+void Prefetcher::schedule(const std::vector<std::string> &upcomingPaths)
+{
+    const std::vector<std::string> paths(upcomingPaths.begin(),
+            upcomingPaths.begin() + std::min(upcomingPaths.size(), m_trackCount));
+    const auto isUpcoming{[&paths](const std::string &path){
+        return std::find(paths.begin(), paths.end(), path) != paths.end();
+    }};
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        // Called on every playlist tick
+        if (paths == m_scheduledPaths)
+            return;
+        m_scheduledPaths = paths;
+
+        m_stats.cancelledCount += std::count_if(m_queue.begin(), m_queue.end(),
+                [&isUpcoming](const std::string &path){ return !isUpcoming(path); });
+
+        // The prefetched tracks that stay upcoming keep their share of the budget.
+        // The ones that got nothing are tried again, the budget may have freed up.
+        m_prefetched.erase(std::remove_if(m_prefetched.begin(), m_prefetched.end(),
+                    [&isUpcoming](const std::pair<std::string, size_t> &entry){
+                        return !isUpcoming(entry.first) || entry.second == 0;
+                    }), m_prefetched.end());
+        size_t usedBytes{};
+        for (const auto &entry : m_prefetched)
+            usedBytes += entry.second;
+
+        if (!m_currentPath.empty())
+        {
+            if (isUpcoming(m_currentPath))
+                usedBytes += m_currentLength;
+            else
+                m_isCurrentCancelled = true;
+        }
+        m_budgetLeft = m_budgetBytes - std::min(usedBytes, m_budgetBytes);
+
+        m_queue.clear();
+        for (const std::string &path : paths)
+        {
+            const bool isPrefetched{std::find_if(m_prefetched.begin(), m_prefetched.end(),
+                    [&path](const std::pair<std::string, size_t> &entry){
+                        return entry.first == path;
+                    }) != m_prefetched.end()};
+            if (!isPrefetched && !(path == m_currentPath && !m_isCurrentCancelled))
+                m_queue.push_back(path);
+        }
+    }
+    m_cv.notify_one();
+}
+
+void Prefetcher::recordOpen(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    const bool isPrefetched{std::find_if(m_prefetched.begin(), m_prefetched.end(),
+            [&path](const std::pair<std::string, size_t> &entry){
+                return entry.first == path && entry.second > 0;
+            }) != m_prefetched.end()};
+    if (isPrefetched)
+        ++m_stats.hitCount;
+    else
+        ++m_stats.missCount;
+}
+
+size_t Prefetcher::prefetchFile(int fd, size_t length)
+{
+    size_t offset{};
+    while (offset < length && !m_isCurrentCancelled)
+    {
+        const size_t chunk{std::min(CHUNK_SIZE, length - offset)};
+#ifdef __linux__
+        // Returns when the reads are queued, so the chunks don't pile up
+        // in the I/O queue. Not every file system supports it.
+        if (readahead(fd, offset, chunk)
+                && posix_fadvise(fd, offset, chunk, POSIX_FADV_WILLNEED))
+            break;
+#else
+        if (posix_fadvise(fd, offset, chunk, POSIX_FADV_WILLNEED))
+            break;
+#endif
+        offset += chunk;
+    }
+    return offset;
+}
+
+void Prefetcher::workerLoop()
+{
+    while (true)
+    {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_cv.wait(lock, [this](){ return m_isStopRequested || !m_queue.empty(); });
+            if (m_isStopRequested)
+                break;
+            path = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_currentPath = path;
+            m_currentLength = 0;
+            m_isCurrentCancelled = false;
+        }
+
+        // Opening may block too on a network share, so it is done unlocked.
+        // Non-blocking, so a FIFO doesn't wait for a writer.
+        const int fd{open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK)};
+        struct stat fileStat{};
+        const bool isOk{fd >= 0 && fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode)};
+
+        size_t length{};
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            if (isOk && !m_isCurrentCancelled)
+            {
+                length = std::min({(size_t)fileStat.st_size, m_bytesPerTrack, m_budgetLeft});
+                m_budgetLeft -= length;
+                m_currentLength = length;
+            }
+        }
+
+        const size_t prefetchedBytes{length ? prefetchFile(fd, length) : 0};
+        if (fd >= 0)
+            close(fd);
+
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stats.prefetchedBytes += prefetchedBytes;
+        if (m_isCurrentCancelled)
+            ++m_stats.cancelledCount;
+        // Even if nothing is prefetched (out of budget, not a regular file),
+        // so it is not queued again
+        else
+            m_prefetched.emplace_back(path, length);
+        m_currentPath.clear();
+        m_currentLength = 0;
+    }
+}
+
+void Prefetcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_isStopRequested = true;
+        m_queue.clear();
+        m_scheduledPaths.clear();
+    }
+    m_isCurrentCancelled = true;
+    m_cv.notify_all();
+
+    if (m_worker.joinable())
+        m_worker.join();
+}
+
+Prefetcher::Stats Prefetcher::getStats()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_stats;
+}
+
+Prefetcher::~Prefetcher()
+{
+    stop();
+}
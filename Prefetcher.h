@@ -0,0 +1,155 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Asks the OS to read the beginning of the upcoming tracks into the page
+ * cache, so opening them doesn't wait for a slow disk or a network share.
+ *
+ * The playlist tells which tracks come next with `schedule()`. The track
+ * right after the current one is opened by the preload of the playlist
+ * anyway, so the scheduled tracks start after it. A worker
+ * thread issues read-ahead for the first `bytesPerTrack` bytes of each,
+ * at most `budgetBytes` in total for the scheduled tracks. Scheduling
+ * other tracks (a jump, a shuffle, an edit) drops the queued ones and
+ * stops the one being prefetched if it isn't upcoming anymore.
+ * The read-ahead is only a hint, the pages may be dropped before use.
+ */
+class Prefetcher final
+{
+public:
+    static constexpr size_t DEFAULT_TRACK_COUNT{3};
+    static constexpr size_t DEFAULT_BYTES_PER_TRACK{16 << 20};
+    static constexpr size_t DEFAULT_BUDGET_BYTES{32 << 20};
+
+    /*
+     * The playlist counts an open when it opens a track directly
+     * (start, jump, failed gapless switch) and when the preload of the
+     * next track starts. So a hit means the track was read ahead while an
+     * earlier track was playing.
+     */
+    struct Stats
+    {
+        // Opened tracks that were prefetched before they were opened
+        size_t hitCount{};
+        // Opened tracks that weren't: the first preload, jumps, and tracks
+        // whose prefetch wasn't done yet or were out of budget
+        size_t missCount{};
+        // Prefetches dropped or stopped, because the upcoming tracks changed
+        size_t cancelledCount{};
+        // Bytes read-ahead was issued for
+        uint64_t prefetchedBytes{};
+    };
+
+private:
+    const size_t m_trackCount{};
+    const size_t m_bytesPerTrack{};
+    const size_t m_budgetBytes{};
+
+    std::thread m_worker;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // Guarded by `m_mutex`:
+    // The last scheduled tracks
+    std::vector<std::string> m_scheduledPaths;
+    // Upcoming tracks not prefetched yet
+    std::deque<std::string> m_queue;
+    // Upcoming tracks prefetched already and the prefetched bytes of each
+    std::vector<std::pair<std::string, size_t>> m_prefetched;
+    // Track being prefetched, empty if none
+    std::string m_currentPath;
+    // Bytes reserved for `m_currentPath`, 0 until its file is opened
+    size_t m_currentLength{};
+    // The bytes the upcoming tracks may still use
+    size_t m_budgetLeft{};
+    bool m_isStopRequested{};
+    Stats m_stats;
+
+    // Set when `m_currentPath` isn't needed anymore
+    std::atomic<bool> m_isCurrentCancelled{};
+
+    void workerLoop();
+    /*
+     * Issue read-ahead for the file. Stops early if `m_isCurrentCancelled`
+     * becomes true.
+     *
+     * Returns the number of bytes read-ahead was issued for.
+     */
+    size_t prefetchFile(int fd, size_t length);
+
+public:
+    Prefetcher(
+            size_t trackCount=DEFAULT_TRACK_COUNT,
+            size_t bytesPerTrack=DEFAULT_BYTES_PER_TRACK,
+            size_t budgetBytes=DEFAULT_BUDGET_BYTES);
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher(Prefetcher&&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+    Prefetcher& operator=(Prefetcher&&) = delete;
+
+    /*
+     * Start the worker thread.
+     */
+    void start();
+
+    /*
+     * Set the tracks that come next, in the order they will be played.
+     * Only the first `getTrackCount()` are used. Thread safe.
+     */
+    void schedule(const std::vector<std::string> &upcomingPaths);
+
+    /*
+     * Count a hit or a miss for opening the file, see `Stats`. Call it
+     * before the `schedule()` that drops the file from the upcoming
+     * tracks. Thread safe.
+     */
+    void recordOpen(const std::string &path);
+
+    /*
+     * Stop the prefetching and wait for the worker.
+     */
+    void stop();
+
+    inline size_t getTrackCount() const { return m_trackCount; }
+    Stats getStats();
+
+    ~Prefetcher();
+};
@@ -0,0 +1,172 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <algorithm>
+
+/*
+ * A lock-free single-producer/single-consumer ring buffer.
+ * One thread may call the writer functions while one other thread
+ * calls the reader functions, without any locking.
+ *
+ * The read and write positions only grow, the index in the storage
+ * is the position masked with the (power of 2) capacity.
+ */
+template <typename T>
+class RingBuffer final
+{
+private:
+    std::unique_ptr<T[]> m_data;
+    size_t m_capacity{};
+    size_t m_mask{};
+
+    // Keep the two positions in separate cache lines,
+    // so the producer and the consumer don't fight for them
+    alignas(64) std::atomic<size_t> m_writePos{};
+    alignas(64) std::atomic<size_t> m_readPos{};
+
+    static size_t roundUpToPowerOf2(size_t value)
+    {
+        size_t output{1};
+        while (output < value)
+            output <<= 1;
+        return output;
+    }
+
+public:
+    /*
+     * Create a ring buffer that can hold at least `minCapacity` elements.
+     */
+    explicit RingBuffer(size_t minCapacity)
+        : m_capacity{roundUpToPowerOf2(minCapacity)}
+    {
+        m_mask = m_capacity - 1;
+        m_data = std::make_unique<T[]>(m_capacity);
+    }
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer(RingBuffer&&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    RingBuffer& operator=(RingBuffer&&) = delete;
+
+    inline size_t getCapacity() const { return m_capacity; }
+
+    /*
+     * Return the number of elements the reader can read.
+     * Exact when called by the reader, a lower bound otherwise.
+     */
+    inline size_t getReadAvailable() const
+    {
+        return m_writePos.load(std::memory_order_acquire)
+            - m_readPos.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Return the number of elements the writer can write.
+     * Exact when called by the writer, a lower bound otherwise.
+     */
+    inline size_t getWriteAvailable() const
+    {
+        return m_capacity - getReadAvailable();
+    }
+
+    /*
+     * Return the total number of elements written since the creation.
+     */
+    inline size_t getWritePosition() const
+    {
+        return m_writePos.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Return the total number of elements read or discarded since the creation.
+     */
+    inline size_t getReadPosition() const
+    {
+        return m_readPos.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Writer only.
+     * Copy at most `count` elements into the buffer.
+     *
+     * Returns the number of elements written.
+     */
+    size_t write(const T *data, size_t count)
+    {
+        const size_t writePos{m_writePos.load(std::memory_order_relaxed)};
+        const size_t readPos{m_readPos.load(std::memory_order_acquire)};
+        count = std::min(count, m_capacity - (writePos - readPos));
+
+        const size_t startI{writePos & m_mask};
+        const size_t firstPart{std::min(count, m_capacity - startI)};
+        std::copy(data, data + firstPart, m_data.get() + startI);
+        std::copy(data + firstPart, data + count, m_data.get());
+
+        m_writePos.store(writePos + count, std::memory_order_release);
+        return count;
+    }
+
+    /*
+     * Reader only.
+     * Copy at most `count` elements out of the buffer.
+     *
+     * Returns the number of elements read.
+     */
+    size_t read(T *data, size_t count)
+    {
+        const size_t readPos{m_readPos.load(std::memory_order_relaxed)};
+        const size_t writePos{m_writePos.load(std::memory_order_acquire)};
+        count = std::min(count, writePos - readPos);
+
+        const size_t startI{readPos & m_mask};
+        const size_t firstPart{std::min(count, m_capacity - startI)};
+        std::copy(m_data.get() + startI, m_data.get() + startI + firstPart, data);
+        std::copy(m_data.get(), m_data.get() + (count - firstPart), data + firstPart);
+
+        m_readPos.store(readPos + count, std::memory_order_release);
+        return count;
+    }
+
+    /*
+     * Reader only.
+     * Throw away every element written before write position `position`.
+     * Elements written after it are kept.
+     */
+    void discardUntil(size_t position)
+    {
+        const size_t readPos{m_readPos.load(std::memory_order_relaxed)};
+        // Position is already read, nothing to do
+        if (position - readPos > m_capacity)
+            return;
+        m_readPos.store(position, std::memory_order_release);
+    }
+};
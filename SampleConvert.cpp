@@ -0,0 +1,178 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SampleConvertKernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+#if defined(__SSE2__)
+
+struct Sse2Isa
+{
+    static constexpr size_t WIDTH{8};
+    using Vec = __m128i;
+
+    static inline Vec load(const int16_t *input)
+    {
+        return _mm_loadu_si128((const __m128i*)input);
+    }
+
+    static inline Vec load(const int32_t *input)
+    {
+        const __m128i low{_mm_srai_epi32(_mm_loadu_si128((const __m128i*)input), 16)};
+        const __m128i high{_mm_srai_epi32(_mm_loadu_si128((const __m128i*)(input + 4)), 16)};
+        return _mm_packs_epi32(low, high);
+    }
+
+    static inline __m128i floatToS32(const float *input)
+    {
+        __m128 scaled{_mm_mul_ps(_mm_loadu_ps(input), _mm_set1_ps(32768.0f))};
+        scaled = _mm_min_ps(scaled, _mm_set1_ps(32767.0f));
+        scaled = _mm_max_ps(scaled, _mm_set1_ps(-32768.0f));
+        return _mm_cvtps_epi32(scaled);
+    }
+
+    static inline Vec load(const float *input)
+    {
+        return _mm_packs_epi32(floatToS32(input), floatToS32(input + 4));
+    }
+
+    static inline void store(int16_t *output, Vec vec)
+    {
+        _mm_storeu_si128((__m128i*)output, vec);
+    }
+
+    static inline void storeInterleaved2(int16_t *output, Vec left, Vec right)
+    {
+        store(output,     _mm_unpacklo_epi16(left, right));
+        store(output + 8, _mm_unpackhi_epi16(left, right));
+    }
+};
+using BestIsa = Sse2Isa;
+constexpr const char *BEST_ISA_NAME{"SSE2"};
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+struct NeonIsa
+{
+    static constexpr size_t WIDTH{8};
+    using Vec = int16x8_t;
+
+    static inline Vec load(const int16_t *input)
+    {
+        return vld1q_s16(input);
+    }
+
+    static inline Vec load(const int32_t *input)
+    {
+        return vcombine_s16(
+                vshrn_n_s32(vld1q_s32(input), 16),
+                vshrn_n_s32(vld1q_s32(input + 4), 16));
+    }
+
+    static inline int32x4_t floatToS32(const float *input)
+    {
+        float32x4_t scaled{vmulq_n_f32(vld1q_f32(input), 32768.0f)};
+        scaled = vminq_f32(scaled, vdupq_n_f32(32767.0f));
+        scaled = vmaxq_f32(scaled, vdupq_n_f32(-32768.0f));
+        return vcvtnq_s32_f32(scaled);
+    }
+
+    static inline Vec load(const float *input)
+    {
+        return vcombine_s16(vqmovn_s32(floatToS32(input)), vqmovn_s32(floatToS32(input + 4)));
+    }
+
+    static inline void store(int16_t *output, Vec vec)
+    {
+        vst1q_s16(output, vec);
+    }
+
+    static inline void storeInterleaved2(int16_t *output, Vec left, Vec right)
+    {
+        vst2q_s16(output, (int16x8x2_t{{left, right}}));
+    }
+};
+using BestIsa = NeonIsa;
+constexpr const char *BEST_ISA_NAME{"NEON"};
+
+#else
+
+using BestIsa = ScalarIsa;
+constexpr const char *BEST_ISA_NAME{"scalar"};
+
+#endif
+
+#ifdef LIGHTMUSIC_HAVE_AVX2
+inline bool isAvx2Supported()
+{
+    static const bool isSupported{(bool)__builtin_cpu_supports("avx2")};
+    return isSupported;
+}
+#endif
+
+} // namespace
+
+namespace SampleConvert
+{
+
+Kernel findKernel(AVSampleFormat inFormat, int channels, bool isSimdAllowed)
+{
+    if (!isSimdAllowed)
+        return selectKernel<ScalarIsa>(inFormat, channels);
+
+#ifdef LIGHTMUSIC_HAVE_AVX2
+    if (isAvx2Supported())
+    {
+        if (Kernel kernel{findAvx2Kernel(inFormat, channels)})
+            return kernel;
+    }
+#endif
+    return selectKernel<BestIsa>(inFormat, channels);
+}
+
+const char* getInstructionSetName(bool isSimdAllowed)
+{
+    if (!isSimdAllowed)
+        return "scalar";
+
+#ifdef LIGHTMUSIC_HAVE_AVX2
+    if (isAvx2Supported())
+        return "AVX2";
+#endif
+    return BEST_ISA_NAME;
+}
+
+} // namespace SampleConvert
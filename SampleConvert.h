@@ -0,0 +1,70 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+extern "C"
+{
+#include <libavutil/samplefmt.h>
+}
+
+/*
+ * Conversion of decoded samples to the interleaved signed 16-bit
+ * samples the output takes, for tracks that don't need a sample rate or
+ * channel layout conversion (most of them). It is faster than going
+ * through libswresample, which is only used when resampling is needed.
+ *
+ * The kernels are specialized at compile time for each input format and
+ * for mono and stereo, and are vectorized with SSE2, AVX2 or NEON.
+ * The best instruction set of the CPU is picked at runtime.
+ */
+namespace SampleConvert
+{
+
+/*
+ * Convert `frames` sample frames of `channels` channels from `input`
+ * (one pointer per plane, like `AVFrame::extended_data`) to interleaved
+ * samples in `output`.
+ */
+using Kernel = void(*)(const uint8_t *const *input, int16_t *output, size_t frames, int channels);
+
+/*
+ * Return the kernel converting `inFormat` with `channels` channels,
+ * nullptr if the format is not supported.
+ * If `isSimdAllowed` is false, the scalar version is returned (for benchmarking).
+ */
+Kernel findKernel(AVSampleFormat inFormat, int channels, bool isSimdAllowed=true);
+
+/*
+ * Return the name of the instruction set `findKernel()` uses.
+ */
+const char* getInstructionSetName(bool isSimdAllowed=true);
+
+} // namespace SampleConvert
@@ -0,0 +1,110 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * The AVX2 kernels. This file is compiled with AVX2 enabled, the other
+ * files are not, so the functions here are only called after checking
+ * the CPU (see `SampleConvert::findKernel()`).
+ */
+
+#include "SampleConvertKernels.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+namespace
+{
+
+struct Avx2Isa
+{
+    static constexpr size_t WIDTH{16};
+    using Vec = __m256i;
+
+    static inline Vec load(const int16_t *input)
+    {
+        return _mm256_loadu_si256((const __m256i*)input);
+    }
+
+    // `_mm256_packs_epi32()` packs within the 128-bit lanes,
+    // this puts the 64-bit quarters back to order
+    static inline Vec packS32(__m256i low, __m256i high)
+    {
+        return _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xd8);
+    }
+
+    static inline Vec load(const int32_t *input)
+    {
+        return packS32(
+                _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)input), 16),
+                _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(input + 8)), 16));
+    }
+
+    static inline __m256i floatToS32(const float *input)
+    {
+        __m256 scaled{_mm256_mul_ps(_mm256_loadu_ps(input), _mm256_set1_ps(32768.0f))};
+        scaled = _mm256_min_ps(scaled, _mm256_set1_ps(32767.0f));
+        scaled = _mm256_max_ps(scaled, _mm256_set1_ps(-32768.0f));
+        return _mm256_cvtps_epi32(scaled);
+    }
+
+    static inline Vec load(const float *input)
+    {
+        return packS32(floatToS32(input), floatToS32(input + 8));
+    }
+
+    static inline void store(int16_t *output, Vec vec)
+    {
+        _mm256_storeu_si256((__m256i*)output, vec);
+    }
+
+    static inline void storeInterleaved2(int16_t *output, Vec left, Vec right)
+    {
+        // Frames 0-3 and 8-11, then 4-7 and 12-15
+        const __m256i low{_mm256_unpacklo_epi16(left, right)};
+        const __m256i high{_mm256_unpackhi_epi16(left, right)};
+        store(output,      _mm256_permute2x128_si256(low, high, 0x20));
+        store(output + 16, _mm256_permute2x128_si256(low, high, 0x31));
+    }
+};
+
+} // namespace
+
+SampleConvert::Kernel SampleConvert::findAvx2Kernel(AVSampleFormat inFormat, int channels)
+{
+    return selectKernel<Avx2Isa>(inFormat, channels);
+}
+
+#else
+
+SampleConvert::Kernel SampleConvert::findAvx2Kernel(AVSampleFormat, int)
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * The conversion kernels, as templates over the instruction set.
+ * Only included by the SampleConvert*.cpp files.
+ */
+
+#pragma once
+
+#include "SampleConvert.h"
+#include <cmath>
+
+namespace SampleConvert
+{
+
+/*
+ * Return the AVX2 kernel, nullptr if the format is not supported or
+ * the AVX2 kernels were not built. The caller checks the CPU.
+ * Defined in SampleConvertAvx2.cpp.
+ */
+Kernel findAvx2Kernel(AVSampleFormat inFormat, int channels);
+
+} // namespace SampleConvert
+
+// The files including this are compiled with different instruction set
+// flags, so nothing here may be shared between them: the linker would
+// keep one of the copies, maybe the AVX2 one.
+namespace
+{
+
+inline int16_t toS16(int16_t sample)
+{
+    return sample;
+}
+
+inline int16_t toS16(int32_t sample)
+{
+    return (int16_t)(sample >> 16);
+}
+
+inline int16_t toS16(float sample)
+{
+    // The same rounding and clipping as libswresample and the vector code
+    float scaled{sample * 32768.0f};
+    scaled = scaled < 32767.0f ? scaled : 32767.0f;
+    scaled = scaled > -32768.0f ? scaled : -32768.0f;
+    return (int16_t)lrintf(scaled);
+}
+
+/*
+ * The fallback "instruction set", one sample at a time.
+ *
+ * An instruction set has:
+ *  - `WIDTH`: the number of 16-bit samples in a vector
+ *  - `load()`: convert `WIDTH` samples of an input type to a vector
+ *  - `store()`: write a vector
+ *  - `storeInterleaved2()`: write two vectors interleaved (left, right, left...)
+ */
+struct ScalarIsa
+{
+    static constexpr size_t WIDTH{1};
+    using Vec = int16_t;
+
+    template <typename In>
+    static inline Vec load(const In *input) { return toS16(*input); }
+    static inline void store(int16_t *output, Vec vec) { *output = vec; }
+    static inline void storeInterleaved2(int16_t *output, Vec left, Vec right)
+    {
+        output[0] = left;
+        output[1] = right;
+    }
+};
+
+/*
+ * Interleaved input: the channel count doesn't matter, every sample
+ * is converted in place.
+ */
+template <typename Isa, typename In>
+void convertInterleaved(const uint8_t *const *input, int16_t *output, size_t frames, int channels)
+{
+    const In *samples{(const In*)input[0]};
+    const size_t count{frames * channels};
+
+    size_t i{};
+    for (; i + Isa::WIDTH <= count; i += Isa::WIDTH)
+        Isa::store(output + i, Isa::load(samples + i));
+    for (; i < count; ++i)
+        output[i] = toS16(samples[i]);
+}
+
+/*
+ * Planar input. `Channels` is 1 or 2, or 0 for any other channel count.
+ */
+template <typename Isa, typename In, int Channels>
+void convertPlanar(const uint8_t *const *input, int16_t *output, size_t frames, int channels)
+{
+    if constexpr (Channels == 1)
+    {
+        // A single plane is the same as interleaved
+        convertInterleaved<Isa, In>(input, output, frames, 1);
+    }
+    else if constexpr (Channels == 2)
+    {
+        const In *left{(const In*)input[0]};
+        const In *right{(const In*)input[1]};
+
+        size_t i{};
+        for (; i + Isa::WIDTH <= frames; i += Isa::WIDTH)
+            Isa::storeInterleaved2(output + i * 2, Isa::load(left + i), Isa::load(right + i));
+        for (; i < frames; ++i)
+        {
+            output[i * 2]     = toS16(left[i]);
+            output[i * 2 + 1] = toS16(right[i]);
+        }
+    }
+    else
+    {
+        // Rare (surround), not worth vectorizing
+        for (size_t i{}; i < frames; ++i)
+        {
+            for (int ch{}; ch < channels; ++ch)
+                output[i * channels + ch] = toS16(((const In*)input[ch])[i]);
+        }
+    }
+}
+
+template <typename Isa, typename In>
+SampleConvert::Kernel selectPlanarKernel(int channels)
+{
+    switch (channels)
+    {
+    case 1:  return convertPlanar<Isa, In, 1>;
+    case 2:  return convertPlanar<Isa, In, 2>;
+    default: return convertPlanar<Isa, In, 0>;
+    }
+}
+
+template <typename Isa>
+SampleConvert::Kernel selectKernel(AVSampleFormat inFormat, int channels)
+{
+    if (channels <= 0)
+        return nullptr;
+
+    switch (inFormat)
+    {
+    case AV_SAMPLE_FMT_S16:  return convertInterleaved<Isa, int16_t>;
+    case AV_SAMPLE_FMT_S32:  return convertInterleaved<Isa, int32_t>;
+    case AV_SAMPLE_FMT_FLT:  return convertInterleaved<Isa, float>;
+    case AV_SAMPLE_FMT_S16P: return selectPlanarKernel<Isa, int16_t>(channels);
+    case AV_SAMPLE_FMT_S32P: return selectPlanarKernel<Isa, int32_t>(channels);
+    case AV_SAMPLE_FMT_FLTP: return selectPlanarKernel<Isa, float>(channels);
+    default:                 return nullptr;
+    }
+}
+
+} // namespace
@@ -0,0 +1,207 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SeekIndex.h"
+#include "MappedInput.h"
+#include "TrackCacheFile.h"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+
+const TrackCacheFile::Format CACHE_FILE_FORMAT{
+        "seek", ".idx", {'L', 'M', 'S', 'E', 'E', 'K', 0, 0}, 2};
+
+/*
+ * Header of a cache file, the payload is `entryCount` entries.
+ */
+struct CacheFileHeader
+{
+    int32_t streamIndex;
+    int32_t timeBaseNum;
+    int32_t timeBaseDen;
+    uint32_t reserved;
+    uint64_t entryCount;
+};
+
+} // namespace
+
+void SeekIndex::reset(int streamIndex, AVRational timeBase)
+{
+    m_entries.clear();
+    m_streamIndex = streamIndex;
+    m_timeBase = timeBase;
+    m_entryIntervalPts = std::max<int64_t>(1, ENTRY_INTERVAL_S / av_q2d(timeBase));
+    m_isComplete = false;
+}
+
+void SeekIndex::addPacket(int64_t pts, int64_t pos)
+{
+    if (pts == AV_NOPTS_VALUE || pos < 0)
+        return;
+    if (!m_entries.empty() && pts < m_entries.back().pts + m_entryIntervalPts)
+        return;
+
+    m_entries.push_back({pts, pos});
+}
+
+const SeekIndex::Entry* SeekIndex::findEntryBefore(int64_t pts) const
+{
+    // The first entry after `pts`
+    auto it{std::upper_bound(m_entries.begin(), m_entries.end(), pts,
+            [](int64_t value, const Entry &entry){ return value < entry.pts; })};
+    if (it == m_entries.begin())
+        return nullptr;
+    return &*(it - 1);
+}
+
+bool SeekIndex::isUsefulFor(const AVFormatContext *formatContext)
+{
+    if (!formatContext || !formatContext->iformat
+            || (formatContext->iformat->flags & AVFMT_NO_BYTE_SEEK))
+        return false;
+
+    // Formats whose timestamp seeking is an estimation or a bisection
+    static const char *const formatNames[]{"mp3", "aac", "ac3", "eac3", "ogg"};
+    const std::string name{formatContext->iformat->name};
+    return std::find_if(std::begin(formatNames), std::end(formatNames),
+            [&name](const char *formatName){ return name == formatName; }) != std::end(formatNames);
+}
+
+int SeekIndex::scan(
+        const std::string &filePath,
+        int streamIndex,
+        SeekIndex &output,
+        const std::atomic<bool> *cancelFlag)
+{
+    // Declared first, so it is freed after the format context
+    MappedInput mappedInput;
+    AVFormatContext *formatContext{avformat_alloc_context()};
+    if (!formatContext)
+        return 1;
+    // Every packet is read, so the file is read through a mapping if possible
+    if (mappedInput.open(filePath) == 0)
+        mappedInput.attach(formatContext);
+
+    if (avformat_open_input(&formatContext, filePath.c_str(), nullptr, nullptr))
+        return 1;
+
+    if (streamIndex < 0 || (unsigned)streamIndex >= formatContext->nb_streams)
+    {
+        avformat_close_input(&formatContext);
+        return 1;
+    }
+
+    output.reset(streamIndex, formatContext->streams[streamIndex]->time_base);
+
+    AVPacket *packet{av_packet_alloc()};
+    if (!packet)
+    {
+        avformat_close_input(&formatContext);
+        return 1;
+    }
+
+    int result{};
+    while (true)
+    {
+        if (cancelFlag && *cancelFlag)
+        {
+            result = 1;
+            break;
+        }
+
+        const int readResult{av_read_frame(formatContext, packet)};
+        if (readResult == AVERROR_EOF)
+            break;
+        if (readResult < 0)
+        {
+            result = 1;
+            break;
+        }
+
+        if (packet->stream_index == streamIndex)
+            output.addPacket(packet->pts, packet->pos);
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&formatContext);
+
+    if (result == 0)
+        output.markComplete();
+    return result;
+}
+
+std::string SeekIndex::getCachePath(const std::string &filePath)
+{
+    return TrackCacheFile::getPath(CACHE_FILE_FORMAT, filePath);
+}
+
+int SeekIndex::saveToCache(const std::string &filePath, const FileIdentity &identity) const
+{
+    if (!m_isComplete)
+        return 1;
+
+    CacheFileHeader header{};
+    header.streamIndex = m_streamIndex;
+    header.timeBaseNum = m_timeBase.num;
+    header.timeBaseDen = m_timeBase.den;
+    header.entryCount = m_entries.size();
+    return TrackCacheFile::write(CACHE_FILE_FORMAT, filePath, identity, &header, sizeof(header),
+            {{m_entries.data(), m_entries.size() * sizeof(Entry)}});
+}
+
+int SeekIndex::loadFromCache(
+        const std::string &filePath,
+        const FileIdentity &identity,
+        SeekIndex &output)
+{
+    std::ifstream file;
+    CacheFileHeader header;
+    uint64_t payloadSize{};
+    if (TrackCacheFile::open(CACHE_FILE_FORMAT, filePath, identity,
+                &header, sizeof(header), file, payloadSize)
+            || header.timeBaseNum <= 0 || header.timeBaseDen <= 0
+            || header.entryCount == 0
+            || payloadSize != header.entryCount * sizeof(Entry))
+        return 1;
+
+    output.reset(header.streamIndex, AVRational{header.timeBaseNum, header.timeBaseDen});
+    output.m_entries.resize(header.entryCount);
+    if (!file.read((char*)output.m_entries.data(), header.entryCount * sizeof(Entry)))
+    {
+        output.m_entries.clear();
+        return 1;
+    }
+    output.m_isComplete = true;
+
+    std::cout << "Loaded seek index with " << header.entryCount << " entries" << '\n';
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "FileIdentity.h"
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+/*
+ * A table of packet timestamps and byte positions of an audio stream.
+ *
+ * Some formats (like MP3 and ADTS AAC) have no index of their own,
+ * libav can only estimate where a timestamp is in them, especially with
+ * variable bit rate. With this table a seek can jump to the byte position
+ * of a packet right before the target.
+ *
+ * It is built while a track is played through for the first time, or by
+ * scanning the packets of the file. Complete tables are cached in the
+ * cache directory together with the identity of the file.
+ */
+class SeekIndex final
+{
+public:
+    struct Entry
+    {
+        // In the time base of the stream
+        int64_t pts;
+        // Byte position of the packet in the file
+        int64_t pos;
+    };
+
+    // Minimum distance of two entries, a seek decodes at most this much
+    // before reaching the target
+    static constexpr double ENTRY_INTERVAL_S{0.5};
+
+private:
+    std::vector<Entry> m_entries;
+    int m_streamIndex{-1};
+    AVRational m_timeBase{0, 1};
+    // The distance of the entries in the time base of the stream
+    int64_t m_entryIntervalPts{};
+    // True if every packet of the stream was added
+    bool m_isComplete{};
+
+public:
+    SeekIndex() {}
+
+    /*
+     * Remove the entries and start a new table for a stream.
+     */
+    void reset(int streamIndex, AVRational timeBase);
+
+    /*
+     * Record a packet of the stream. Packets closer than `ENTRY_INTERVAL_S`
+     * to the last entry and packets without timestamp or position
+     * are not stored. The packets should be added in order.
+     */
+    void addPacket(int64_t pts, int64_t pos);
+
+    /*
+     * Mark the table as complete, call it after the last packet of the file.
+     */
+    inline void markComplete() { m_isComplete = !m_entries.empty(); }
+    inline bool isComplete() const { return m_isComplete; }
+
+    /*
+     * Return the last entry at or before `pts`, nullptr if there is none.
+     */
+    const Entry* findEntryBefore(int64_t pts) const;
+
+    inline size_t getEntryCount() const { return m_entries.size(); }
+    inline int getStreamIndex() const { return m_streamIndex; }
+    inline AVRational getTimeBase() const { return m_timeBase; }
+
+    /*
+     * Return whether the format can use a seek index, that is, it can seek
+     * by byte position and doesn't have an accurate index of its own.
+     */
+    static bool isUsefulFor(const AVFormatContext *formatContext);
+
+    /*
+     * Read every packet of the audio stream of the file without decoding
+     * them and build a complete table. Stops if `cancelFlag` becomes true.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    static int scan(
+            const std::string &filePath,
+            int streamIndex,
+            SeekIndex &output,
+            const std::atomic<bool> *cancelFlag=nullptr);
+
+    /*
+     * Return the path of the cache file of the table of `filePath`.
+     */
+    static std::string getCachePath(const std::string &filePath);
+
+    /*
+     * Write a complete table to the cache.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int saveToCache(const std::string &filePath, const FileIdentity &identity) const;
+
+    /*
+     * Read the cached table of the file if it was made from the current
+     * version of the file.
+     *
+     * Returns 0 if succeeded, nonzero if there is no usable table.
+     */
+    static int loadFromCache(
+            const std::string &filePath,
+            const FileIdentity &identity,
+            SeekIndex &output);
+};
@@ -0,0 +1,228 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SpectrumAnalyzer.h"
+#include "StageTiming.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/*
+ * Scale a linear amplitude (1 is full scale) to [0, 1].
+ */
+inline float amplitudeToScale(float amplitude)
+{
+    if (amplitude <= 0)
+        return 0;
+    const float db{20.0f * std::log10(amplitude)};
+    return std::clamp((db - SpectrumAnalyzer::MIN_DB) / -SpectrumAnalyzer::MIN_DB, 0.0f, 1.0f);
+}
+
+} // namespace
+
+SpectrumAnalyzer::SpectrumAnalyzer(const PcmTap *tap, FrameCallback frameCallback)
+    : m_tap{tap}, m_frameCallback{std::move(frameCallback)}
+{
+    // Hann window
+    m_window.resize(FFT_SIZE);
+    for (size_t i{}; i < FFT_SIZE; ++i)
+        m_window[i] = 0.5f - 0.5f * std::cos(2.0 * M_PI * i / FFT_SIZE);
+
+    m_samples.resize(FFT_SIZE * PcmTap::CHANNELS);
+    m_re.resize(FFT_SIZE);
+    m_im.resize(FFT_SIZE);
+}
+
+void SpectrumAnalyzer::start()
+{
+    m_isStopRequested = false;
+    m_thread = std::thread{&SpectrumAnalyzer::threadLoop, this};
+}
+
+void SpectrumAnalyzer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_stopMutex};
+        m_isStopRequested = true;
+    }
+    m_stopCv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void SpectrumAnalyzer::calculateBandEdges(int sampleRate)
+{
+    const size_t maxBin{FFT_SIZE / 2};
+    const double binHz{(double)sampleRate / FFT_SIZE};
+    const double maxFrequency{std::min(MAX_FREQUENCY, sampleRate / 2.0)};
+
+    // Skip the DC bin, and give every band at least one bin
+    size_t previousEdge{};
+    for (size_t i{}; i <= BAND_COUNT; ++i)
+    {
+        const double frequency{MIN_FREQUENCY
+            * std::pow(maxFrequency / MIN_FREQUENCY, (double)i / BAND_COUNT)};
+        size_t edge{(size_t)std::lround(frequency / binHz)};
+        edge = std::max(edge, i == 0 ? 1 : previousEdge + 1);
+        m_bandEdges[i] = std::min(edge, maxBin);
+        previousEdge = edge;
+    }
+    m_bandSampleRate = sampleRate;
+}
+
+bool SpectrumAnalyzer::analyze(float elapsedS)
+{
+    const float fall{FALL_PER_S * elapsedS};
+
+    uint64_t endFrame{};
+    int sampleRate{};
+    const size_t frameCount{m_tap->read(m_samples.data(), FFT_SIZE, endFrame, sampleRate)};
+    if (frameCount == 0 && m_tap->getWrittenFrameCount() != 0)
+    {
+        // The writer overwrote the samples while reading them
+        ++m_droppedFrameCount;
+        return false;
+    }
+
+    const size_t newFrameCount{(size_t)std::min<uint64_t>(endFrame - m_lastEndFrame, frameCount)};
+    m_lastEndFrame = std::max(m_lastEndFrame, endFrame);
+
+    // Paused or stopped: let the levels fall, then stop publishing frames
+    if (newFrameCount == 0 || sampleRate <= 0)
+    {
+        bool isChanged{};
+        for (float &band : m_shownFrame.bands)
+        {
+            isChanged |= band > 0;
+            band = std::max(0.0f, band - fall);
+        }
+        for (float &peak : m_shownFrame.peaks)
+        {
+            isChanged |= peak > 0;
+            peak = std::max(0.0f, peak - fall);
+        }
+        return isChanged;
+    }
+
+    // The peaks of the samples that arrived since the last frame
+    for (int channel{}; channel < PcmTap::CHANNELS; ++channel)
+    {
+        int peak{};
+        for (size_t i{frameCount - newFrameCount}; i < frameCount; ++i)
+            peak = std::max(peak, std::abs((int)m_samples[i*PcmTap::CHANNELS + channel]));
+        const float level{amplitudeToScale(peak / 32768.0f)};
+        m_shownFrame.peaks[channel] = std::max(level, m_shownFrame.peaks[channel] - fall);
+    }
+
+    // The latest samples are at the end, zeros before them at the start
+    const size_t padding{FFT_SIZE - frameCount};
+    std::fill(m_re.begin(), m_re.begin() + padding, 0.0f);
+    for (size_t i{}; i < frameCount; ++i)
+    {
+        const float mono{(m_samples[i*2] + m_samples[i*2 + 1]) / 65536.0f};
+        m_re[padding + i] = mono * m_window[padding + i];
+    }
+    std::fill(m_im.begin(), m_im.end(), 0.0f);
+    m_fft.transform(m_re.data(), m_im.data());
+
+    if (sampleRate != m_bandSampleRate)
+        calculateBandEdges(sampleRate);
+
+    for (size_t band{}; band < BAND_COUNT; ++band)
+    {
+        float maxPower{};
+        for (size_t bin{m_bandEdges[band]}; bin < m_bandEdges[band + 1]; ++bin)
+            maxPower = std::max(maxPower, m_re[bin]*m_re[bin] + m_im[bin]*m_im[bin]);
+        // A full scale sine is 0 dB, the Hann window halves the amplitude
+        const float level{amplitudeToScale(std::sqrt(maxPower) * 4.0f / FFT_SIZE)};
+        m_shownFrame.bands[band] = std::max(level, m_shownFrame.bands[band] - fall);
+    }
+    return true;
+}
+
+void SpectrumAnalyzer::threadLoop()
+{
+    const auto interval{std::chrono::microseconds{1000000 / FRAME_RATE}};
+    auto deadline{Clock::now()};
+    auto lastFrameTime{deadline};
+
+    std::unique_lock<std::mutex> lock{m_stopMutex};
+    while (true)
+    {
+        deadline += interval;
+        if (m_stopCv.wait_until(lock, deadline, [this](){ return m_isStopRequested; }))
+            break;
+        lock.unlock();
+
+        const auto now{Clock::now()};
+        const float elapsedS{std::chrono::duration<float>(now - lastFrameTime).count()};
+        lastFrameTime = now;
+
+        bool isChanged;
+        {
+            TIME_STAGE(StageTiming::STAGE_SPECTRUM);
+            isChanged = analyze(elapsedS);
+        }
+        if (isChanged)
+        {
+            {
+                std::lock_guard<std::mutex> frameLock{m_frameMutex};
+                const uint64_t sequence{m_frame.sequence};
+                m_frame = m_shownFrame;
+                m_frame.sequence = sequence + 1;
+            }
+            m_frameCallback();
+        }
+
+        // Skip the frames we are late for instead of catching up
+        const auto lateFrames{(Clock::now() - deadline) / interval};
+        if (lateFrames > 0)
+        {
+            m_droppedFrameCount += lateFrames;
+            deadline += interval * lateFrames;
+        }
+
+        lock.lock();
+    }
+}
+
+SpectrumAnalyzer::Frame SpectrumAnalyzer::getFrame() const
+{
+    std::lock_guard<std::mutex> lock{m_frameMutex};
+    return m_frame;
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+    stop();
+}
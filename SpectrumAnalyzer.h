@@ -0,0 +1,145 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "PcmTap.h"
+#include "Fft.h"
+
+/*
+ * Calculates a log-frequency spectrum and the peak levels of the samples
+ * in a `PcmTap`, on its own thread, at most `FRAME_RATE` times a second.
+ *
+ * The audio threads never wait for it: a frame whose samples were
+ * overwritten while copying them is dropped, and a late frame is skipped
+ * instead of catching up. Every frame costs the same (one FFT of
+ * `FFT_SIZE`), it is recorded as the "spectrum" stage by `StageTiming`.
+ */
+class SpectrumAnalyzer final
+{
+public:
+    static constexpr size_t FFT_SIZE{2048};
+    static constexpr size_t BAND_COUNT{32};
+    static constexpr int FRAME_RATE{60};
+    static constexpr double MIN_FREQUENCY{30.0};
+    static constexpr double MAX_FREQUENCY{16000.0};
+    // The bottom of the scale, 0 dBFS is the top
+    static constexpr float MIN_DB{-80.0f};
+    // How fast the bars and the meters fall, in scale heights per second
+    static constexpr float FALL_PER_S{1.5f};
+
+    /*
+     * The levels of a frame, scaled to [0, 1] (`MIN_DB` to 0 dBFS).
+     */
+    struct Frame
+    {
+        std::array<float, BAND_COUNT> bands{};
+        std::array<float, PcmTap::CHANNELS> peaks{};
+        // Incremented with every frame
+        uint64_t sequence{};
+    };
+
+    /*
+     * Called on the analyzer thread when a new frame is ready.
+     */
+    using FrameCallback = std::function<void()>;
+
+private:
+    const PcmTap *m_tap{};
+    FrameCallback m_frameCallback;
+
+    std::thread m_thread;
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCv;
+    // Guarded by `m_stopMutex`
+    bool m_isStopRequested{};
+
+    mutable std::mutex m_frameMutex;
+    // Guarded by `m_frameMutex`
+    Frame m_frame;
+
+    //------------------- Used only by the analyzer thread --------------------
+
+    Fft m_fft{FFT_SIZE};
+    std::vector<float> m_window;
+    std::vector<int16_t> m_samples;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+    // The FFT bins of the bands, recalculated when the sample rate changes
+    std::array<size_t, BAND_COUNT + 1> m_bandEdges{};
+    int m_bandSampleRate{};
+    uint64_t m_lastEndFrame{};
+    // The levels shown, they fall slowly
+    Frame m_shownFrame;
+
+    //-------------------------------------------------------------------------
+
+    std::atomic<uint64_t> m_droppedFrameCount{};
+
+    void threadLoop();
+    /*
+     * Read the tap and update `m_shownFrame`.
+     *
+     * Returns false if the frame has to be dropped.
+     */
+    bool analyze(float elapsedS);
+    void calculateBandEdges(int sampleRate);
+
+public:
+    /*
+     * `tap` must outlive the analyzer.
+     */
+    SpectrumAnalyzer(const PcmTap *tap, FrameCallback frameCallback);
+    SpectrumAnalyzer(const SpectrumAnalyzer&) = delete;
+    SpectrumAnalyzer(SpectrumAnalyzer&&) = delete;
+    SpectrumAnalyzer& operator=(const SpectrumAnalyzer&) = delete;
+    SpectrumAnalyzer& operator=(SpectrumAnalyzer&&) = delete;
+
+    void start();
+    void stop();
+
+    /*
+     * Return the latest frame. Thread safe.
+     */
+    Frame getFrame() const;
+
+    /*
+     * Return the number of frames dropped or skipped since the start.
+     */
+    inline uint64_t getDroppedFrameCount() const { return m_droppedFrameCount; }
+
+    ~SpectrumAnalyzer();
+};
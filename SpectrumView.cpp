@@ -0,0 +1,76 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SpectrumView.h"
+#include <FL/fl_draw.H>
+
+// Width of a peak meter and the gap before it
+static constexpr int METER_W{6};
+static constexpr int METER_GAP{4};
+
+SpectrumView::SpectrumView(int x, int y, int w, int h, const SpectrumAnalyzer *analyzer)
+    : Fl_Widget(x, y, w, h), m_analyzer{analyzer}
+{
+}
+
+void SpectrumView::draw()
+{
+    const SpectrumAnalyzer::Frame frame{m_analyzer->getFrame()};
+
+    fl_push_clip(x(), y(), w(), h());
+    fl_rectf(x(), y(), w(), h(), color());
+
+    const int metersW{PcmTap::CHANNELS * (METER_W + METER_GAP)};
+    const int bandsW{w() - metersW};
+    const int bandCount{(int)SpectrumAnalyzer::BAND_COUNT};
+    if (bandsW >= bandCount)
+    {
+        fl_color(color2());
+        for (int i{}; i < bandCount; ++i)
+        {
+            const int barX{x() + bandsW * i / bandCount};
+            const int barW{x() + bandsW * (i + 1) / bandCount - barX - 1};
+            const int barH{(int)(frame.bands[i] * h())};
+            if (barW > 0 && barH > 0)
+                fl_rectf(barX, y() + h() - barH, barW, barH);
+        }
+    }
+
+    for (int i{}; i < PcmTap::CHANNELS; ++i)
+    {
+        const int meterX{x() + w() - metersW + i * (METER_W + METER_GAP) + METER_GAP};
+        const int meterH{(int)(frame.peaks[i] * h())};
+        // Red near full scale
+        const Fl_Color clipColor{FL_RED};
+        fl_color(frame.peaks[i] > 0.98f ? clipColor : selection_color());
+        if (meterH > 0)
+            fl_rectf(meterX, y() + h() - meterH, METER_W, meterH);
+    }
+
+    fl_pop_clip();
+}
@@ -0,0 +1,167 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "StageTiming.h"
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <algorithm>
+#if defined(__linux__) || defined(__linux) || defined(__unix__) || defined(__unix)
+#include <csignal>
+#include <pthread.h>
+#endif
+
+namespace StageTiming
+{
+
+std::atomic<bool> g_isEnabled{};
+
+static Histogram s_histograms[STAGE_COUNT];
+
+static const char *STAGE_NAMES[STAGE_COUNT]{
+    "tick",
+    "read packet",
+    "send packet",
+    "receive frame",
+    "resample",
+    "convert",
+    "gain",
+    "PCM push",
+    "sink write",
+    "spectrum",
+};
+
+int Histogram::getBucketIndex(uint64_t ns)
+{
+    // The small values have a bucket each
+    if (ns < SUB_BUCKET_COUNT)
+        return ns;
+
+    const int exponent{63 - __builtin_clzll(ns)};
+    const int subBucket{(int)(ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1)};
+    const int index{(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + subBucket};
+    return std::min(index, BUCKET_COUNT - 1);
+}
+
+uint64_t Histogram::getBucketUpperBound(int index)
+{
+    if (index < SUB_BUCKET_COUNT)
+        return index;
+
+    const int exponent{index / SUB_BUCKET_COUNT + SUB_BUCKET_BITS - 1};
+    const uint64_t subBucket{(uint64_t)(index % SUB_BUCKET_COUNT)};
+    const uint64_t bucketWidth{uint64_t{1} << (exponent - SUB_BUCKET_BITS)};
+    return ((SUB_BUCKET_COUNT + subBucket) << (exponent - SUB_BUCKET_BITS)) + bucketWidth - 1;
+}
+
+void Histogram::record(uint64_t ns)
+{
+    m_buckets[getBucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max{m_maxNs.load(std::memory_order_relaxed)};
+    while (ns > max && !m_maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t Histogram::getPercentileNs(double percentile) const
+{
+    const uint64_t count{getCount()};
+    if (count == 0)
+        return 0;
+
+    // The rank of the value, counted from 1
+    const uint64_t rank{std::max<uint64_t>(1, (uint64_t)(percentile / 100.0 * count + 0.5))};
+    uint64_t seen{};
+    for (int i{}; i < BUCKET_COUNT; ++i)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(getBucketUpperBound(i), getMaxNs());
+    }
+    // Recorded while we were reading
+    return getMaxNs();
+}
+
+void record(Stage stage, uint64_t ns)
+{
+    s_histograms[stage].record(ns);
+}
+
+void dump(std::ostream &output)
+{
+    output << "Stage timing (us):\n"
+        << std::setw(14) << std::left << "stage" << std::right
+        << std::setw(12) << "count"
+        << std::setw(12) << "p50"
+        << std::setw(12) << "p99"
+        << std::setw(12) << "max" << '\n';
+
+    const auto flags{output.flags()};
+    const auto precision{output.precision()};
+    output << std::fixed << std::setprecision(1);
+    for (int i{}; i < STAGE_COUNT; ++i)
+    {
+        const Histogram &histogram{s_histograms[i]};
+        output << std::setw(14) << std::left << STAGE_NAMES[i] << std::right
+            << std::setw(12) << histogram.getCount()
+            << std::setw(12) << histogram.getPercentileNs(50) / 1000.0
+            << std::setw(12) << histogram.getPercentileNs(99) / 1000.0
+            << std::setw(12) << histogram.getMaxNs() / 1000.0 << '\n';
+    }
+    output.flags(flags);
+    output.precision(precision);
+}
+
+void startSignalDumper()
+{
+#if defined(__linux__) || defined(__linux) || defined(__unix__) || defined(__unix)
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &signals, nullptr))
+    {
+        std::cerr << "Failed to block SIGUSR1, stage timing can't be dumped with it" << '\n';
+        return;
+    }
+
+    // Printing is not allowed in a signal handler, this thread
+    // takes the signal instead
+    std::thread{[signals](){
+        while (true)
+        {
+            int signal{};
+            if (sigwait(&signals, &signal) == 0 && signal == SIGUSR1)
+                dump(std::cerr);
+        }
+    }}.detach();
+#endif
+}
+
+} // namespace StageTiming
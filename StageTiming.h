@@ -0,0 +1,180 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Timing of the stages of the playback hot path, to find out which one is
+ * slow when playback stutters.
+ *
+ * Every stage has a lock-free log-linear histogram (8 buckets per power
+ * of 2, so the error is at most 12.5%), recording costs two clock reads
+ * and a few relaxed atomic additions. Recording is off until
+ * `setEnabled()` is called, and the whole thing is compiled out unless
+ * the LIGHTMUSIC_STAGE_TIMING CMake option is on.
+ */
+namespace StageTiming
+{
+
+enum Stage
+{
+    // The whole `Music::tick()`
+    STAGE_TICK,
+    // `av_read_frame()`
+    STAGE_READ_PACKET,
+    // `avcodec_send_packet()`
+    STAGE_SEND_PACKET,
+    // `avcodec_receive_frame()`
+    STAGE_RECEIVE_FRAME,
+    // `swr_convert()`
+    STAGE_RESAMPLE,
+    // The sample conversion kernels, used instead of `swr_convert()`
+    STAGE_CONVERT,
+    // The ReplayGain stage, see `GainStage`
+    STAGE_GAIN,
+    // Putting the samples to the PCM buffer, including waiting for room
+    STAGE_PCM_PUSH,
+    // Writing to the sink (device, file)
+    STAGE_SINK_WRITE,
+    // A frame of the spectrum analyzer, see `SpectrumAnalyzer`
+    STAGE_SPECTRUM,
+
+    STAGE_COUNT,
+};
+
+class Histogram final
+{
+public:
+    // Sub-buckets per power of 2
+    static constexpr int SUB_BUCKET_BITS{3};
+    static constexpr int SUB_BUCKET_COUNT{1 << SUB_BUCKET_BITS};
+    // Up to 2^40 ns (18 minutes), longer times go to the last bucket
+    static constexpr int BUCKET_COUNT{(40 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT};
+
+private:
+    std::atomic<uint64_t> m_buckets[BUCKET_COUNT]{};
+    std::atomic<uint64_t> m_count{};
+    std::atomic<uint64_t> m_maxNs{};
+
+    static int getBucketIndex(uint64_t ns);
+    static uint64_t getBucketUpperBound(int index);
+
+public:
+    Histogram() {}
+    Histogram(const Histogram&) = delete;
+    Histogram(Histogram&&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+    Histogram& operator=(Histogram&&) = delete;
+
+    /*
+     * Add a value. Can be called from any thread.
+     */
+    void record(uint64_t ns);
+
+    inline uint64_t getCount() const { return m_count.load(std::memory_order_relaxed); }
+    inline uint64_t getMaxNs() const { return m_maxNs.load(std::memory_order_relaxed); }
+    /*
+     * Return the value at `percentile` (0-100), rounded up to the
+     * bucket boundary. Returns 0 if the histogram is empty.
+     */
+    uint64_t getPercentileNs(double percentile) const;
+};
+
+extern std::atomic<bool> g_isEnabled;
+
+inline bool isEnabled() { return g_isEnabled.load(std::memory_order_relaxed); }
+inline void setEnabled(bool isEnabled) { g_isEnabled.store(isEnabled, std::memory_order_relaxed); }
+
+void record(Stage stage, uint64_t ns);
+
+/*
+ * Print the count, median, 99th percentile and maximum of every stage.
+ */
+void dump(std::ostream &output);
+
+/*
+ * Dump to the standard error when the process gets SIGUSR1.
+ * The signal is blocked in the calling thread and a thread waits for it,
+ * so it must be called before other threads are started (they inherit
+ * the signal mask).
+ */
+void startSignalDumper();
+
+/*
+ * Records the time from its construction to its destruction.
+ */
+class ScopedTimer final
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Stage m_stage;
+    bool m_isActive;
+    Clock::time_point m_start;
+
+public:
+    inline explicit ScopedTimer(Stage stage)
+        : m_stage{stage}, m_isActive{isEnabled()}
+    {
+        if (m_isActive)
+            m_start = Clock::now();
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer(ScopedTimer&&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(ScopedTimer&&) = delete;
+
+    inline ~ScopedTimer()
+    {
+        if (m_isActive)
+            record(m_stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - m_start).count());
+    }
+};
+
+} // namespace StageTiming
+
+#ifdef LIGHTMUSIC_STAGE_TIMING
+#define STAGE_TIMING_CONCAT_(a, b) a##b
+#define STAGE_TIMING_CONCAT(a, b) STAGE_TIMING_CONCAT_(a, b)
+// Time the rest of the enclosing scope as `stage`
+#define TIME_STAGE(stage) \
+    StageTiming::ScopedTimer STAGE_TIMING_CONCAT(stageTimer, __LINE__){stage}
+// Evaluate `expression` and time it as `stage`
+#define TIMED_STAGE(stage, expression) \
+    ([&](){ TIME_STAGE(stage); return expression; }())
+#else
+#define TIME_STAGE(stage) do {} while (false)
+#define TIMED_STAGE(stage, expression) (expression)
+#endif
@@ -0,0 +1,145 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TrackCacheFile.h"
+#include "LibraryIndex.h"
+#include "sys-specific.h"
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+
+namespace
+{
+
+/*
+ * The part of the header shared by every format.
+ */
+struct CommonHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    int64_t modificationTime;
+    uint64_t fileSize;
+    // Stored to detect hash collisions of the file name
+    uint64_t pathLength;
+};
+
+} // namespace
+
+std::string TrackCacheFile::getPath(const Format &format, const std::string &trackPath)
+{
+    const std::string cacheDir{SysSpecific::getCacheDir()};
+    if (cacheDir.empty())
+        return "";
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx%s",
+            (unsigned long long)LibraryIndex::hashPath(trackPath), format.extension);
+    return cacheDir + "/" + format.dirName + "/" + name;
+}
+
+int TrackCacheFile::write(
+        const Format &format,
+        const std::string &trackPath,
+        const FileIdentity &identity,
+        const void *header, size_t headerSize,
+        const std::vector<Chunk> &payload)
+{
+    const std::string cachePath{getPath(format, trackPath)};
+    if (cachePath.empty())
+        return 1;
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path{cachePath}.parent_path(), error);
+    if (error)
+        return 1;
+
+    CommonHeader commonHeader{};
+    std::memcpy(commonHeader.magic, format.magic, sizeof(commonHeader.magic));
+    commonHeader.version = format.version;
+    commonHeader.modificationTime = identity.modificationTime;
+    commonHeader.fileSize = identity.size;
+    commonHeader.pathLength = trackPath.size();
+
+    const std::string tmpPath{cachePath + ".tmp"};
+    {
+        std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+        file.write((const char*)&commonHeader, sizeof(commonHeader));
+        file.write((const char*)header, headerSize);
+        file.write(trackPath.data(), trackPath.size());
+        for (const Chunk &chunk : payload)
+            file.write((const char*)chunk.data, chunk.size);
+        if (!file)
+            return 1;
+    }
+    std::filesystem::rename(tmpPath, cachePath, error);
+    return error ? 1 : 0;
+}
+
+int TrackCacheFile::open(
+        const Format &format,
+        const std::string &trackPath,
+        const FileIdentity &identity,
+        void *header, size_t headerSize,
+        std::ifstream &file,
+        uint64_t &payloadSize)
+{
+    const std::string cachePath{getPath(format, trackPath)};
+    if (cachePath.empty())
+        return 1;
+
+    std::error_code error;
+    const uint64_t cacheFileSize{std::filesystem::file_size(cachePath, error)};
+    if (error || cacheFileSize < sizeof(CommonHeader) + headerSize)
+        return 1;
+
+    file.open(cachePath, std::ios::binary);
+    if (!file)
+        return 1;
+
+    CommonHeader commonHeader;
+    if (!file.read((char*)&commonHeader, sizeof(commonHeader))
+            || std::memcmp(commonHeader.magic, format.magic, sizeof(commonHeader.magic))
+            || commonHeader.version != format.version
+            || commonHeader.modificationTime != identity.modificationTime
+            || commonHeader.fileSize != identity.size
+            || commonHeader.pathLength != trackPath.size()
+            || cacheFileSize - sizeof(CommonHeader) - headerSize < commonHeader.pathLength)
+        return 1;
+
+    if (!file.read((char*)header, headerSize))
+        return 1;
+
+    std::string storedPath(commonHeader.pathLength, '\0');
+    if (!file.read(storedPath.data(), storedPath.size()) || storedPath != trackPath)
+        return 1;
+
+    payloadSize = cacheFileSize - sizeof(CommonHeader) - headerSize - commonHeader.pathLength;
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "FileIdentity.h"
+
+/*
+ * A file in the cache directory holding data derived from a track,
+ * like its seek index or its waveform.
+ *
+ * The file is named after the hash of the path of the track. It starts with
+ * a common header identifying the version of the track, followed by
+ * the header of the format, the path of the track and the payload.
+ */
+class TrackCacheFile final
+{
+public:
+    /*
+     * Describes a kind of cache file.
+     */
+    struct Format
+    {
+        // Subdirectory of the cache directory
+        const char *dirName;
+        // Extension of the file names, with the dot
+        const char *extension;
+        char magic[8];
+        uint32_t version;
+    };
+
+    /*
+     * A block of bytes to write after the path.
+     */
+    struct Chunk
+    {
+        const void *data;
+        size_t size;
+    };
+
+    /*
+     * Return the path of the cache file of `trackPath`,
+     * an empty string if there is no cache directory.
+     */
+    static std::string getPath(const Format &format, const std::string &trackPath);
+
+    /*
+     * Write the cache file of `trackPath`: the common header, the format
+     * header of `headerSize` bytes, the path and the `payload` chunks.
+     * The file is written to a temporary file and renamed,
+     * so a reader never sees half of it.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    static int write(
+            const Format &format,
+            const std::string &trackPath,
+            const FileIdentity &identity,
+            const void *header, size_t headerSize,
+            const std::vector<Chunk> &payload);
+
+    /*
+     * Open the cache file of `trackPath` and read the format header into
+     * `header` if the file was made from the current version of the track.
+     * `file` is left at the start of the payload and `payloadSize` is set
+     * to the number of bytes after the path, so the caller can check that
+     * it matches the header exactly.
+     *
+     * Returns 0 if succeeded, nonzero if there is no usable cache file.
+     */
+    static int open(
+            const Format &format,
+            const std::string &trackPath,
+            const FileIdentity &identity,
+            void *header, size_t headerSize,
+            std::ifstream &file,
+            uint64_t &payloadSize);
+};
@@ -0,0 +1,246 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Waveform.h"
+#include "AudioFileDecoder.h"
+#include "TrackCacheFile.h"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+const TrackCacheFile::Format CACHE_FILE_FORMAT{
+        "waveform", ".wf", {'L', 'M', 'W', 'A', 'V', 'E', 0, 0}, 2};
+
+/*
+ * Header of a cache file, the payload is the bins of every level,
+ * from the finest one.
+ */
+struct CacheFileHeader
+{
+    int32_t sampleRate;
+    uint32_t reserved;
+    int64_t frameCount;
+};
+
+/*
+ * Return the number of bins on every level for a track
+ * of `frameCount` frames.
+ */
+std::vector<size_t> getLevelSizes(int64_t frameCount)
+{
+    std::vector<size_t> sizes;
+    if (frameCount <= 0)
+        return sizes;
+
+    sizes.push_back((size_t)((frameCount + Waveform::BIN_FRAMES - 1) / Waveform::BIN_FRAMES));
+    while (sizes.back() > 1)
+        sizes.push_back((sizes.back() + 1) / 2);
+    return sizes;
+}
+
+inline Waveform::Bin mergeBins(const Waveform::Bin &a, const Waveform::Bin &b)
+{
+    const float rms{std::sqrt(((float)a.rms*a.rms + (float)b.rms*b.rms) / 2.0f)};
+    return Waveform::Bin{
+        std::min(a.min, b.min),
+        std::max(a.max, b.max),
+        (uint8_t)std::min(255.0f, std::round(rms))};
+}
+
+} // namespace
+
+void Waveform::buildLevels()
+{
+    m_levels.resize(1);
+    while (m_levels.back().size() > 1)
+    {
+        const std::vector<Bin> &below{m_levels.back()};
+        std::vector<Bin> level((below.size() + 1) / 2);
+        for (size_t i{}; i < below.size() / 2; ++i)
+            level[i] = mergeBins(below[i*2], below[i*2 + 1]);
+        // An odd bin at the end has nothing to merge with
+        if (below.size() % 2)
+            level.back() = below.back();
+        m_levels.push_back(std::move(level));
+    }
+}
+
+void Waveform::getColumns(size_t columnCount, std::vector<Column> &output) const
+{
+    output.assign(columnCount, Column{});
+    if (m_levels.empty() || columnCount == 0)
+        return;
+
+    // The coarsest level that still has a bin for every column
+    const double finestBinsPerColumn{(double)m_levels[0].size() / columnCount};
+    size_t levelI{};
+    while (levelI + 1 < m_levels.size() && finestBinsPerColumn >= (double)(2ull << levelI))
+        ++levelI;
+    const std::vector<Bin> &bins{m_levels[levelI]};
+    const double binsPerColumn{(double)bins.size() / columnCount};
+
+    for (size_t i{}; i < columnCount; ++i)
+    {
+        const size_t first{std::min(bins.size() - 1, (size_t)(i * binsPerColumn))};
+        const size_t last{std::min(bins.size(),
+                std::max(first + 1, (size_t)((i + 1) * binsPerColumn)))};
+
+        int min{bins[first].min};
+        int max{bins[first].max};
+        float squareSum{};
+        for (size_t j{first}; j < last; ++j)
+        {
+            min = std::min<int>(min, bins[j].min);
+            max = std::max<int>(max, bins[j].max);
+            squareSum += (float)bins[j].rms * bins[j].rms;
+        }
+        output[i].min = min / 127.0f;
+        output[i].max = max / 127.0f;
+        output[i].rms = std::sqrt(squareSum / (last - first)) / 255.0f;
+    }
+}
+
+int Waveform::build(
+        const std::string &filePath,
+        Waveform &output,
+        const std::atomic<bool> *cancelFlag)
+{
+    AudioFileDecoder decoder;
+    if (decoder.open(filePath))
+        return 1;
+    const int channelCount{decoder.getChannelCount()};
+
+    std::vector<Bin> bins;
+    int64_t frameCount{};
+    // The bin being filled
+    int binFrameCount{};
+    float binMin{};
+    float binMax{};
+    float binSquareSum{};
+    auto storeBin{[&](){
+        bins.push_back(Bin{
+                (int8_t)std::lround(std::clamp(binMin, -1.0f, 1.0f) * 127.0f),
+                (int8_t)std::lround(std::clamp(binMax, -1.0f, 1.0f) * 127.0f),
+                (uint8_t)std::lround(std::min(1.0f,
+                        std::sqrt(binSquareSum / ((float)binFrameCount*channelCount))) * 255.0f)});
+        binFrameCount = 0;
+        binMin = 0;
+        binMax = 0;
+        binSquareSum = 0;
+    }};
+
+    const int result{decoder.decode([&](const float *samples, size_t frames){
+        for (size_t i{}; i < frames; ++i)
+        {
+            for (int j{}; j < channelCount; ++j)
+            {
+                const float sample{samples[i*channelCount + j]};
+                binMin = std::min(binMin, sample);
+                binMax = std::max(binMax, sample);
+                binSquareSum += sample*sample;
+            }
+            if (++binFrameCount == BIN_FRAMES)
+                storeBin();
+        }
+        frameCount += frames;
+    }, cancelFlag)};
+    if (result)
+        return 1;
+    if (binFrameCount)
+        storeBin();
+    if (bins.empty())
+        return 1;
+
+    output.m_sampleRate = decoder.getSampleRate();
+    output.m_frameCount = frameCount;
+    output.m_levels.clear();
+    output.m_levels.push_back(std::move(bins));
+    output.buildLevels();
+    return 0;
+}
+
+std::string Waveform::getCachePath(const std::string &filePath)
+{
+    return TrackCacheFile::getPath(CACHE_FILE_FORMAT, filePath);
+}
+
+int Waveform::saveToCache(const std::string &filePath, const FileIdentity &identity) const
+{
+    if (m_levels.empty())
+        return 1;
+
+    CacheFileHeader header{};
+    header.sampleRate = m_sampleRate;
+    header.frameCount = m_frameCount;
+
+    std::vector<TrackCacheFile::Chunk> payload;
+    for (const auto &level : m_levels)
+        payload.push_back({level.data(), level.size() * sizeof(Bin)});
+    return TrackCacheFile::write(CACHE_FILE_FORMAT, filePath, identity,
+            &header, sizeof(header), payload);
+}
+
+int Waveform::loadFromCache(
+        const std::string &filePath,
+        const FileIdentity &identity,
+        Waveform &output)
+{
+    std::ifstream file;
+    CacheFileHeader header;
+    uint64_t payloadSize{};
+    if (TrackCacheFile::open(CACHE_FILE_FORMAT, filePath, identity,
+                &header, sizeof(header), file, payloadSize)
+            || header.sampleRate <= 0
+            || header.frameCount <= 0)
+        return 1;
+
+    // A frame count that doesn't match the size of the file means a corrupt cache
+    const std::vector<size_t> levelSizes{getLevelSizes(header.frameCount)};
+    uint64_t binCount{};
+    for (const size_t size : levelSizes)
+        binCount += size;
+    if (payloadSize != binCount * sizeof(Bin))
+        return 1;
+
+    std::vector<std::vector<Bin>> levels;
+    for (const size_t size : levelSizes)
+    {
+        std::vector<Bin> level(size);
+        if (!file.read((char*)level.data(), size * sizeof(Bin)))
+            return 1;
+        levels.push_back(std::move(level));
+    }
+
+    output.m_levels = std::move(levels);
+    output.m_frameCount = header.frameCount;
+    output.m_sampleRate = header.sampleRate;
+    return 0;
+}
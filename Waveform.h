@@ -0,0 +1,138 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "FileIdentity.h"
+
+/*
+ * The overview of the waveform of a track, for drawing it on the seek bar.
+ *
+ * The track is split to bins of `BIN_FRAMES` frames, every bin stores
+ * the minimum, the maximum and the RMS of the samples of all channels,
+ * quantized to a byte each. Every level of the pyramid merges two bins of
+ * the level below, until a single bin covers the whole track. Drawing picks
+ * the level with about one bin per pixel, so it costs the same for a
+ * 3-minute song and a 3-hour mix.
+ *
+ * Built by decoding the whole file once, then cached in the cache
+ * directory together with the identity of the file.
+ */
+class Waveform final
+{
+public:
+    struct Bin
+    {
+        // Scaled to [-127, 127]
+        int8_t min;
+        int8_t max;
+        // Scaled to [0, 255]
+        uint8_t rms;
+    };
+    static_assert(sizeof(Bin) == 3);
+
+    /*
+     * The samples under a column of the drawing, in [-1, 1].
+     */
+    struct Column
+    {
+        float min;
+        float max;
+        float rms;
+    };
+
+    // Frames per bin on the finest level, about 23 ms at 44.1 kHz
+    static constexpr int BIN_FRAMES{1024};
+
+private:
+    // Level 0 is the finest, every level has half as many bins
+    // (rounded up) as the one below it
+    std::vector<std::vector<Bin>> m_levels;
+    int64_t m_frameCount{};
+    int m_sampleRate{};
+
+    /*
+     * Build the levels above the finest one.
+     */
+    void buildLevels();
+
+public:
+    Waveform() {}
+
+    inline bool isEmpty() const { return m_levels.empty(); }
+    inline int64_t getFrameCount() const { return m_frameCount; }
+    inline int getSampleRate() const { return m_sampleRate; }
+    inline size_t getLevelCount() const { return m_levels.size(); }
+    inline const std::vector<Bin>& getLevel(size_t level) const { return m_levels[level]; }
+
+    /*
+     * Fill `output` with `columnCount` columns covering the whole track.
+     * Every column merges at most a few bins of the matching level,
+     * the cost only depends on `columnCount`.
+     */
+    void getColumns(size_t columnCount, std::vector<Column> &output) const;
+
+    /*
+     * Decode the file and build the pyramid. Stops if `cancelFlag`
+     * becomes true.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    static int build(
+            const std::string &filePath,
+            Waveform &output,
+            const std::atomic<bool> *cancelFlag=nullptr);
+
+    /*
+     * Return the path of the cache file of the waveform of `filePath`.
+     */
+    static std::string getCachePath(const std::string &filePath);
+
+    /*
+     * Write the waveform to the cache.
+     *
+     * Returns 0 if succeeded, nonzero otherwise.
+     */
+    int saveToCache(const std::string &filePath, const FileIdentity &identity) const;
+
+    /*
+     * Read the cached waveform of the file if it was made from the current
+     * version of the file.
+     *
+     * Returns 0 if succeeded, nonzero if there is no usable waveform.
+     */
+    static int loadFromCache(
+            const std::string &filePath,
+            const FileIdentity &identity,
+            Waveform &output);
+};
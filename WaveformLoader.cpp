@@ -0,0 +1,96 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "WaveformLoader.h"
+#include <iostream>
+#include <utility>
+
+WaveformLoader::WaveformLoader(ReadyCallback readyCallback)
+    : m_readyCallback{std::move(readyCallback)}
+{
+}
+
+void WaveformLoader::load(const std::string &filePath)
+{
+    FileIdentity identity;
+    if (FileIdentity::get(filePath, identity))
+        return;
+
+    auto waveform{std::make_shared<Waveform>()};
+    if (Waveform::loadFromCache(filePath, identity, *waveform))
+    {
+        if (Waveform::build(filePath, *waveform, &m_isCancelRequested))
+        {
+            if (!m_isCancelRequested)
+                std::cerr << "Failed to build waveform of " << filePath << '\n';
+            return;
+        }
+        if (waveform->saveToCache(filePath, identity))
+            std::cerr << "Failed to cache waveform of " << filePath << '\n';
+        std::cout << "Built waveform with " << waveform->getLevel(0).size() << " bins" << '\n';
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{m_resultMutex};
+        m_result = std::move(waveform);
+        m_resultPath = filePath;
+    }
+    m_readyCallback();
+}
+
+void WaveformLoader::request(const std::string &filePath)
+{
+    cancel();
+
+    m_isCancelRequested = false;
+    m_thread = std::thread{&WaveformLoader::load, this, filePath};
+}
+
+void WaveformLoader::cancel()
+{
+    m_isCancelRequested = true;
+    if (m_thread.joinable())
+        m_thread.join();
+
+    std::lock_guard<std::mutex> lock{m_resultMutex};
+    m_result.reset();
+    m_resultPath.clear();
+}
+
+std::shared_ptr<const Waveform> WaveformLoader::takeResult(std::string &filePathOut)
+{
+    std::lock_guard<std::mutex> lock{m_resultMutex};
+    filePathOut = std::move(m_resultPath);
+    m_resultPath.clear();
+    return std::move(m_result);
+}
+
+WaveformLoader::~WaveformLoader()
+{
+    cancel();
+}
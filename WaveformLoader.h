@@ -0,0 +1,93 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Waveform.h"
+
+/*
+ * Gets the waveform of a track on a background thread: from the cache if
+ * it has one for the current version of the file, otherwise by decoding
+ * the file, in which case the result is cached.
+ *
+ * Only the last requested track matters, a new request cancels the
+ * running one.
+ */
+class WaveformLoader final
+{
+public:
+    /*
+     * Called on the loader thread when a waveform is ready.
+     */
+    using ReadyCallback = std::function<void()>;
+
+private:
+    ReadyCallback m_readyCallback;
+
+    std::thread m_thread;
+    std::atomic<bool> m_isCancelRequested{};
+
+    std::mutex m_resultMutex;
+    // Guarded by `m_resultMutex`
+    std::shared_ptr<const Waveform> m_result;
+    std::string m_resultPath;
+
+    void load(const std::string &filePath);
+
+public:
+    explicit WaveformLoader(ReadyCallback readyCallback);
+    WaveformLoader(const WaveformLoader&) = delete;
+    WaveformLoader(WaveformLoader&&) = delete;
+    WaveformLoader& operator=(const WaveformLoader&) = delete;
+    WaveformLoader& operator=(WaveformLoader&&) = delete;
+
+    /*
+     * Start getting the waveform of `filePath`.
+     * Cancels the running request and waits for it.
+     */
+    void request(const std::string &filePath);
+
+    /*
+     * Stop the running request and wait for it.
+     */
+    void cancel();
+
+    /*
+     * Return the finished waveform and its path, nullptr if there is none.
+     * The result is removed from the loader.
+     */
+    std::shared_ptr<const Waveform> takeResult(std::string &filePathOut);
+
+    ~WaveformLoader();
+};
@@ -0,0 +1,93 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "WaveformSlider.h"
+#include <utility>
+#include <algorithm>
+#include <FL/fl_draw.H>
+
+WaveformSlider::WaveformSlider(int x, int y, int w, int h, const char *label)
+    : Fl_Hor_Nice_Slider(x, y, w, h, label)
+{
+}
+
+void WaveformSlider::setWaveform(std::shared_ptr<const Waveform> waveform)
+{
+    m_waveform = std::move(waveform);
+    m_columns.clear();
+    redraw();
+}
+
+void WaveformSlider::draw()
+{
+    if (!m_waveform)
+    {
+        Fl_Hor_Nice_Slider::draw();
+        return;
+    }
+
+    draw_box();
+    const int areaX{x() + Fl::box_dx(box())};
+    const int areaY{y() + Fl::box_dy(box())};
+    const int areaW{w() - Fl::box_dw(box())};
+    const int areaH{h() - Fl::box_dh(box())};
+    if (areaW <= 0 || areaH <= 0)
+        return;
+
+    // Only recalculated when the width changes, a draw is O(width)
+    if (m_columns.size() != (size_t)areaW)
+        m_waveform->getColumns(areaW, m_columns);
+
+    const double range{maximum() - minimum()};
+    const int playedW{range > 0
+        ? (int)((value() - minimum()) / range * areaW) : 0};
+    const Fl_Color playedPeakColor{fl_darker(color2())};
+    const Fl_Color unplayedPeakColor{FL_DARK3};
+    const Fl_Color unplayedRmsColor{FL_GRAY};
+    const int middleY{areaY + areaH / 2};
+    const int halfH{areaH / 2};
+
+    fl_push_clip(areaX, areaY, areaW, areaH);
+    fl_rectf(areaX, areaY, areaW, areaH, color());
+    for (int i{}; i < areaW; ++i)
+    {
+        const Waveform::Column &column{m_columns[i]};
+        const bool isPlayed{i < playedW};
+
+        // The peaks, with the RMS over them
+        fl_color(isPlayed ? playedPeakColor : unplayedPeakColor);
+        fl_yxline(areaX + i,
+                middleY - (int)(column.max * halfH), middleY - (int)(column.min * halfH));
+        const int rmsH{(int)(column.rms * halfH)};
+        fl_color(isPlayed ? color2() : unplayedRmsColor);
+        fl_yxline(areaX + i, middleY - rmsH, middleY + rmsH);
+    }
+    fl_color(FL_WHITE);
+    fl_yxline(areaX + std::min(playedW, areaW - 1), areaY, areaY + areaH - 1);
+    fl_pop_clip();
+}
@@ -0,0 +1,60 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <FL/Fl.H>
+#include <FL/Fl_Hor_Nice_Slider.H>
+#include "Waveform.h"
+
+/*
+ * A horizontal slider that draws the waveform of the track behind the
+ * position. The played part is drawn with `color2()`.
+ * Without a waveform it looks like a normal slider.
+ */
+class WaveformSlider final : public Fl_Hor_Nice_Slider
+{
+private:
+    std::shared_ptr<const Waveform> m_waveform;
+    // The columns of the waveform at the current width, reused between draws
+    std::vector<Waveform::Column> m_columns;
+
+protected:
+    void draw() override;
+
+public:
+    WaveformSlider(int x, int y, int w, int h, const char *label=nullptr);
+
+    /*
+     * Set the waveform to draw, nullptr to draw a plain slider.
+     */
+    void setWaveform(std::shared_ptr<const Waveform> waveform);
+    inline bool hasWaveform() const { return (bool)m_waveform; }
+};
@@ -0,0 +1,118 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef __GLIBC__
+
+namespace
+{
+
+std::atomic<size_t> s_allocationCount{};
+
+} // namespace
+
+// The allocator of glibc under its internal names, the wrappers below
+// replace the public ones for the whole process, the shared libraries included
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+// Used by `av_malloc()`
+int posix_memalign(void **output, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) || (alignment & (alignment - 1)))
+        return EINVAL;
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *ptr{__libc_memalign(alignment, size)};
+    if (!ptr)
+        return ENOMEM;
+    *output = ptr;
+    return 0;
+}
+} // extern "C"
+
+bool AllocationCounter::isAvailable()
+{
+    return true;
+}
+
+size_t AllocationCounter::getCount()
+{
+    return s_allocationCount.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::isAvailable()
+{
+    return false;
+}
+
+size_t AllocationCounter::getCount()
+{
+    return 0;
+}
+
+#endif
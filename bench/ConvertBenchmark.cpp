@@ -0,0 +1,162 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Measures the sample conversion kernels against libswresample.
+ *
+ * For every input format and a few channel counts, converts a block of
+ * random samples to interleaved S16 repeatedly and prints the number of
+ * samples converted per second by `swr_convert()`, the scalar kernels and
+ * the vectorized kernels.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <cstring>
+#include "SampleConvert.h"
+extern "C"
+{
+#include <libswresample/swresample.h>
+#include <libavutil/channel_layout.h>
+}
+
+using Clock = std::chrono::steady_clock;
+
+// Sample frames converted at once, about the size of a decoded frame
+static constexpr int BLOCK_FRAMES{4096};
+// Every measurement converts this many sample frames
+static constexpr int64_t TOTAL_FRAMES{int64_t{1} << 26};
+static constexpr int SAMPLE_RATE{48000};
+
+/*
+ * Random input in `format`, one vector per plane.
+ */
+static std::vector<std::vector<uint8_t>> makeInput(AVSampleFormat format, int channels)
+{
+    const bool isPlanar{(bool)av_sample_fmt_is_planar(format)};
+    const int planeCount{isPlanar ? channels : 1};
+    const size_t planeSize{(size_t)BLOCK_FRAMES * av_get_bytes_per_sample(format)
+        * (isPlanar ? 1 : channels)};
+
+    std::mt19937 random{12345};
+    std::uniform_real_distribution<float> distribution{-1.0f, 1.0f};
+    std::vector<std::vector<uint8_t>> planes(planeCount, std::vector<uint8_t>(planeSize));
+    for (auto &plane : planes)
+    {
+        for (size_t i{}; i + 4 <= planeSize; i += 4)
+        {
+            const float value{distribution(random)};
+            if (format == AV_SAMPLE_FMT_FLT || format == AV_SAMPLE_FMT_FLTP)
+                std::memcpy(plane.data() + i, &value, 4);
+            else
+            {
+                const int32_t integer{(int32_t)(value * 2147483647.0f)};
+                std::memcpy(plane.data() + i, &integer, 4);
+            }
+        }
+    }
+    return planes;
+}
+
+/*
+ * Run `convert` until `TOTAL_FRAMES` frames are converted and
+ * return the samples per second.
+ */
+template <typename Function>
+static double measure(int channels, Function convert)
+{
+    const auto start{Clock::now()};
+    for (int64_t frames{}; frames < TOTAL_FRAMES; frames += BLOCK_FRAMES)
+        convert();
+    const std::chrono::duration<double> time{Clock::now() - start};
+    return (double)TOTAL_FRAMES * channels / time.count();
+}
+
+static void benchmarkFormat(AVSampleFormat format, int channels)
+{
+    const auto planes{makeInput(format, channels)};
+    std::vector<const uint8_t*> input;
+    for (const auto &plane : planes)
+        input.push_back(plane.data());
+    std::vector<int16_t> output((size_t)BLOCK_FRAMES * channels);
+
+    const int64_t layout{av_get_default_channel_layout(channels)};
+    SwrContext *resampleContext{swr_alloc_set_opts(
+            nullptr,
+            layout, AV_SAMPLE_FMT_S16, SAMPLE_RATE,
+            layout, format, SAMPLE_RATE,
+            0, nullptr)};
+    if (!resampleContext || swr_init(resampleContext))
+    {
+        std::cerr << "Failed to init resample context\n";
+        swr_free(&resampleContext);
+        return;
+    }
+    uint8_t *outputBuffer{(uint8_t*)output.data()};
+    const double swrRate{measure(channels, [&](){
+        swr_convert(resampleContext, &outputBuffer, BLOCK_FRAMES, input.data(), BLOCK_FRAMES);
+    })};
+    swr_free(&resampleContext);
+
+    const SampleConvert::Kernel scalarKernel{SampleConvert::findKernel(format, channels, false)};
+    const double scalarRate{measure(channels, [&](){
+        scalarKernel(input.data(), output.data(), BLOCK_FRAMES, channels);
+    })};
+
+    const SampleConvert::Kernel simdKernel{SampleConvert::findKernel(format, channels)};
+    const double simdRate{measure(channels, [&](){
+        simdKernel(input.data(), output.data(), BLOCK_FRAMES, channels);
+    })};
+
+    std::cout << std::setw(5) << av_get_sample_fmt_name(format) << " -> s16, "
+        << channels << " ch: " << std::fixed << std::setprecision(0)
+        << "swr " << std::setw(6) << swrRate / 1e6 << " MS/s, "
+        << "scalar " << std::setw(6) << scalarRate / 1e6 << " MS/s, "
+        << SampleConvert::getInstructionSetName() << " "
+        << std::setw(6) << simdRate / 1e6 << " MS/s ("
+        << std::setprecision(1) << simdRate / swrRate << "x swr)\n";
+}
+
+int main()
+{
+    const AVSampleFormat formats[]{
+        AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16P,
+        AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32P,
+        AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLTP};
+
+    for (const AVSampleFormat format : formats)
+    {
+        for (const int channels : {1, 2, 6})
+            benchmarkFormat(format, channels);
+    }
+
+    return 0;
+}
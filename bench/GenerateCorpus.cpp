@@ -0,0 +1,277 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Generates the corpus of `lightmusic-bench` with the libav encoders.
+ *
+ * Usage: lightmusic-gen-corpus DIRECTORY
+ *
+ * Every file has the same synthetic content (a tone per channel with
+ * slowly changing pitch and some noise), so the runs are comparable.
+ * The encoders run in bit-exact mode, so the same libav version always
+ * makes the same files. Formats whose encoder is missing from the libav
+ * build are skipped. The generated file names are written to
+ * DIRECTORY/corpus.txt, one per line.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+}
+
+// Length of every file
+static constexpr int DURATION_S{20};
+
+struct CorpusEntry
+{
+    // The first encoder found is used
+    std::vector<std::string> encoderNames;
+    const char *muxerName;
+    const char *extension;
+    int sampleRate;
+    int channels;
+};
+
+static const CorpusEntry CORPUS[]{
+    {{"pcm_s16le"},            "wav",      "wav",  44100, 2},
+    {{"pcm_s16le"},            "wav",      "wav",  48000, 1},
+    {{"pcm_s16le"},            "wav",      "wav",  96000, 2},
+    {{"flac"},                 "flac",     "flac", 44100, 2},
+    {{"flac"},                 "flac",     "flac", 48000, 6},
+    {{"libmp3lame"},           "mp3",      "mp3",  44100, 2},
+    {{"libmp3lame"},           "mp3",      "mp3",  22050, 1},
+    {{"libopus", "opus"},      "ogg",      "opus", 48000, 2},
+    {{"libvorbis", "vorbis"},  "ogg",      "ogg",  44100, 2},
+    {{"libvorbis", "vorbis"},  "ogg",      "ogg",  48000, 1},
+    {{"flac"},                 "matroska", "mkv",  48000, 2},
+    {{"aac"},                  "matroska", "mkv",  44100, 2},
+};
+
+/*
+ * Return sample `i` of channel `channel`, between -1 and 1.
+ */
+static double generateSample(int64_t i, int channel, int sampleRate, uint32_t &noiseState)
+{
+    const double t{(double)i / sampleRate};
+    // A different tone per channel, its pitch goes up and down every 4 s
+    const double frequency{220.0 * (channel + 1) * (1.0 + 0.5 * std::sin(2 * M_PI * t / 4.0))};
+    // Linear congruential generator, the same on every machine
+    noiseState = noiseState * 1664525u + 1013904223u;
+    const double noise{(double)(noiseState >> 8) / (1 << 24) - 0.5};
+    return 0.5 * std::sin(2 * M_PI * frequency * t) + 0.05 * noise;
+}
+
+static void writeSample(AVFrame *frame, int i, int channel, double value)
+{
+    const bool isPlanar{(bool)av_sample_fmt_is_planar((AVSampleFormat)frame->format)};
+    const int index{isPlanar ? i : i * frame->channels + channel};
+    uint8_t *plane{frame->extended_data[isPlanar ? channel : 0]};
+    switch (av_get_packed_sample_fmt((AVSampleFormat)frame->format))
+    {
+    case AV_SAMPLE_FMT_S16: ((int16_t*)plane)[index] = (int16_t)std::lrint(value * 32767); break;
+    case AV_SAMPLE_FMT_S32: ((int32_t*)plane)[index] = (int32_t)std::lrint(value * 2147483647.0); break;
+    case AV_SAMPLE_FMT_FLT: ((float*)plane)[index] = (float)value; break;
+    case AV_SAMPLE_FMT_DBL: ((double*)plane)[index] = value; break;
+    default: break;
+    }
+}
+
+/*
+ * Send `frame` (nullptr to flush) to the encoder and write
+ * the packets it gives.
+ *
+ * Returns 0 if succeeded, nonzero otherwise.
+ */
+static int encodeFrame(AVFormatContext *formatContext, AVCodecContext *codecContext,
+        AVStream *stream, AVFrame *frame, AVPacket *packet)
+{
+    if (avcodec_send_frame(codecContext, frame) < 0)
+        return 1;
+
+    while (true)
+    {
+        const int result{avcodec_receive_packet(codecContext, packet)};
+        if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+            return 0;
+        if (result < 0)
+            return 1;
+
+        av_packet_rescale_ts(packet, codecContext->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        if (av_interleaved_write_frame(formatContext, packet) < 0)
+            return 1;
+    }
+}
+
+/*
+ * Encode the corpus file described by `entry` to `path`.
+ *
+ * Returns 0 if succeeded, 1 if failed, -1 if the encoder is not available.
+ */
+static int generateFile(const CorpusEntry &entry, const std::string &path)
+{
+    const AVCodec *codec{};
+    for (const std::string &name : entry.encoderNames)
+    {
+        if ((codec = avcodec_find_encoder_by_name(name.c_str())))
+            break;
+    }
+    if (!codec)
+        return -1;
+
+    AVFormatContext *formatContext{};
+    if (avformat_alloc_output_context2(&formatContext, nullptr, entry.muxerName, path.c_str()) < 0)
+        return 1;
+    formatContext->flags |= AVFMT_FLAG_BITEXACT;
+
+    AVStream *stream{avformat_new_stream(formatContext, nullptr)};
+    AVCodecContext *codecContext{avcodec_alloc_context3(codec)};
+    AVFrame *frame{av_frame_alloc()};
+    AVPacket *packet{av_packet_alloc()};
+    int result{1};
+    do
+    {
+        if (!stream || !codecContext || !frame || !packet)
+            break;
+
+        codecContext->sample_rate    = entry.sampleRate;
+        codecContext->channels       = entry.channels;
+        codecContext->channel_layout = av_get_default_channel_layout(entry.channels);
+        codecContext->sample_fmt     = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+        codecContext->bit_rate       = 64000 * entry.channels;
+        codecContext->time_base      = AVRational{1, entry.sampleRate};
+        codecContext->flags         |= AV_CODEC_FLAG_BITEXACT;
+        // The native Opus and Vorbis encoders are experimental
+        codecContext->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+        if (formatContext->oformat->flags & AVFMT_GLOBALHEADER)
+            codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        if (avcodec_open2(codecContext, codec, nullptr) < 0
+                || avcodec_parameters_from_context(stream->codecpar, codecContext) < 0)
+            break;
+        stream->time_base = codecContext->time_base;
+
+        if (!(formatContext->oformat->flags & AVFMT_NOFILE)
+                && avio_open(&formatContext->pb, path.c_str(), AVIO_FLAG_WRITE) < 0)
+            break;
+        if (avformat_write_header(formatContext, nullptr) < 0)
+            break;
+
+        const int frameSize{codecContext->frame_size > 0 ? codecContext->frame_size : 1024};
+        const bool isFixedFrameSize{codecContext->frame_size > 0
+            && !(codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE)};
+        const int64_t totalSamples{(int64_t)DURATION_S * entry.sampleRate};
+        uint32_t noiseState{12345};
+        bool isFailed{};
+        for (int64_t written{}; written < totalSamples && !isFailed; written += frameSize)
+        {
+            // Fixed-size encoders need the last frame to be full too
+            frame->nb_samples     = isFixedFrameSize
+                ? frameSize : (int)std::min<int64_t>(frameSize, totalSamples - written);
+            frame->format         = codecContext->sample_fmt;
+            frame->channels       = entry.channels;
+            frame->channel_layout = codecContext->channel_layout;
+            frame->sample_rate    = entry.sampleRate;
+            frame->pts            = written;
+            if (av_frame_get_buffer(frame, 0) < 0)
+            {
+                isFailed = true;
+                break;
+            }
+
+            for (int i{}; i < frame->nb_samples; ++i)
+            {
+                for (int channel{}; channel < entry.channels; ++channel)
+                    writeSample(frame, i, channel,
+                            generateSample(written + i, channel, entry.sampleRate, noiseState));
+            }
+            isFailed = encodeFrame(formatContext, codecContext, stream, frame, packet);
+            av_frame_unref(frame);
+        }
+        if (isFailed || encodeFrame(formatContext, codecContext, stream, nullptr, packet))
+            break;
+
+        if (av_write_trailer(formatContext) == 0)
+            result = 0;
+    } while (false);
+
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&codecContext);
+    if (!(formatContext->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&formatContext->pb);
+    avformat_free_context(formatContext);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " DIRECTORY\n";
+        return 1;
+    }
+    const std::string directory{argv[1]};
+
+    std::vector<std::string> fileNames;
+    for (const CorpusEntry &entry : CORPUS)
+    {
+        const std::string fileName{
+            std::string{entry.muxerName} + "_" + entry.encoderNames[0] + "_"
+            + std::to_string(entry.sampleRate) + "_" + std::to_string(entry.channels)
+            + "." + entry.extension};
+        const int result{generateFile(entry, directory + "/" + fileName)};
+        if (result < 0)
+        {
+            std::cerr << "Skipping " << fileName << ", encoder not available\n";
+            continue;
+        }
+        if (result > 0)
+        {
+            std::cerr << "Failed to generate " << fileName << '\n';
+            return 1;
+        }
+        std::cout << "Generated " << fileName << '\n';
+        fileNames.push_back(fileName);
+    }
+
+    // Written last, so the build only sees it if every file is complete
+    std::ofstream list{directory + "/corpus.txt"};
+    for (const std::string &fileName : fileNames)
+        list << fileName << '\n';
+    return list ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Compares reading files through the default file protocol of libav
+ * and through a memory mapping (`MappedInput`).
+ *
+ * For every file given as argument, prints the median time of opening
+ * the file and finding its stream info with a warm and a cold page cache,
+ * then reads every packet and prints the number of read syscalls and
+ * page faults per minute of audio.
+ * The cold runs drop the file from the page cache with `posix_fadvise()`,
+ * which only works for pages that aren't dirty or mapped by others.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "MappedInput.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+constexpr int OPEN_RUN_COUNT = 21;
+
+struct IoCounters
+{
+    long long readSyscalls{};
+    long minorFaults{};
+    long majorFaults{};
+};
+
+}
+
+static IoCounters getIoCounters()
+{
+    IoCounters counters;
+
+    // Linux only, the syscall count stays 0 elsewhere
+    std::ifstream file{"/proc/self/io"};
+    std::string key;
+    long long value{};
+    while (file >> key >> value)
+    {
+        if (key == "syscr:")
+            counters.readSyscalls = value;
+    }
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    counters.minorFaults = usage.ru_minflt;
+    counters.majorFaults = usage.ru_majflt;
+    return counters;
+}
+
+static void dropFromPageCache(const std::string &path)
+{
+    const int fd{open(path.c_str(), O_RDONLY)};
+    if (fd < 0)
+        return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/*
+ * Open the file like `Music` does.
+ * Returns 0 if succeeded, nonzero otherwise.
+ */
+static int openFile(
+        const std::string &path, bool isMapped,
+        MappedInput &mappedInput, AVFormatContext **formatContext)
+{
+    *formatContext = avformat_alloc_context();
+    if (!*formatContext)
+        return 1;
+    if (isMapped && mappedInput.open(path))
+    {
+        std::cerr << "Failed to map: " << path << '\n';
+        avformat_free_context(*formatContext);
+        *formatContext = nullptr;
+        return 1;
+    }
+    if (isMapped)
+        mappedInput.attach(*formatContext);
+
+    if (avformat_open_input(formatContext, path.c_str(), nullptr, nullptr))
+    {
+        mappedInput.close();
+        return 1;
+    }
+    if (avformat_find_stream_info(*formatContext, nullptr) < 0)
+    {
+        avformat_close_input(formatContext);
+        mappedInput.close();
+        return 1;
+    }
+    return 0;
+}
+
+static double measureOpenMs(const std::string &path, bool isMapped, bool isCold)
+{
+    std::vector<double> times;
+    for (int i{}; i < OPEN_RUN_COUNT; ++i)
+    {
+        if (isCold)
+            dropFromPageCache(path);
+
+        MappedInput mappedInput;
+        AVFormatContext *formatContext{};
+        const auto start{Clock::now()};
+        if (openFile(path, isMapped, mappedInput, &formatContext))
+            return -1;
+        const std::chrono::duration<double, std::milli> elapsed{Clock::now() - start};
+        avformat_close_input(&formatContext);
+        mappedInput.close();
+        times.push_back(elapsed.count());
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+static void measureReading(const std::string &path, bool isMapped, double durationMin)
+{
+    dropFromPageCache(path);
+
+    MappedInput mappedInput;
+    AVFormatContext *formatContext{};
+    const IoCounters before{getIoCounters()};
+    const auto start{Clock::now()};
+    if (openFile(path, isMapped, mappedInput, &formatContext))
+        return;
+
+    AVPacket *packet{av_packet_alloc()};
+    size_t packetCount{};
+    while (av_read_frame(formatContext, packet) >= 0)
+    {
+        ++packetCount;
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&formatContext);
+    mappedInput.close();
+
+    const std::chrono::duration<double, std::milli> elapsed{Clock::now() - start};
+    const IoCounters after{getIoCounters()};
+
+    std::cout << "  " << std::setw(8) << std::left << (isMapped ? "mapped" : "default") << std::right
+        << std::fixed << std::setprecision(1)
+        << (after.readSyscalls - before.readSyscalls) / durationMin << " read syscalls/min, "
+        << (after.minorFaults - before.minorFaults) / durationMin << " minor faults/min, "
+        << (after.majorFaults - before.majorFaults) / durationMin << " major faults/min, "
+        << packetCount << " packets in " << elapsed.count() << " ms\n";
+}
+
+static void benchmarkFile(const std::string &path)
+{
+    double durationS{};
+    {
+        MappedInput mappedInput;
+        AVFormatContext *formatContext{};
+        if (openFile(path, false, mappedInput, &formatContext))
+        {
+            std::cerr << "Failed to open: " << path << '\n';
+            return;
+        }
+        durationS = (double)formatContext->duration / AV_TIME_BASE;
+        std::cout << path << " (" << formatContext->iformat->name << ", "
+            << std::fixed << std::setprecision(1) << durationS << " s)\n";
+        avformat_close_input(&formatContext);
+    }
+    if (durationS <= 0)
+    {
+        std::cerr << "Unknown duration: " << path << '\n';
+        return;
+    }
+
+    std::cout << "  open latency (median of " << OPEN_RUN_COUNT << "):\n";
+    for (bool isMapped : {false, true})
+    {
+        const double warmMs{measureOpenMs(path, isMapped, false)};
+        const double coldMs{measureOpenMs(path, isMapped, true)};
+        std::cout << "    " << std::setw(8) << std::left << (isMapped ? "mapped" : "default") << std::right
+            << std::setprecision(3) << "warm " << warmMs << " ms, cold " << coldMs << " ms\n";
+    }
+
+    for (bool isMapped : {false, true})
+        measureReading(path, isMapped, durationS / 60);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc <= 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " FILE...\n";
+        return 1;
+    }
+
+    for (int i{1}; i < argc; ++i)
+        benchmarkFile(argv[i]);
+
+    return 0;
+}
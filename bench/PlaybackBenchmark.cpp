@@ -0,0 +1,403 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * The benchmark suite of the player.
+ *
+ * Usage: lightmusic-bench [CORPUS_DIRECTORY]
+ *
+ * Plays the corpus made by `lightmusic-gen-corpus` (the build puts it
+ * next to the executable) to a null output as fast as possible, and
+ * measures for every file:
+ *  - the time of `Music::open()`
+ *  - decoding, including the conversion to the output format, as a
+ *    multiple of the real time
+ *  - the time from a seek to the first samples of the target
+ * and for the whole corpus the time from switching tracks to the first
+ * samples of the new track, with and without preloading.
+ *
+ * It also plays every file to the libav "null" muxer and checks that the
+ * buffer pools of the track and of the libav sink (frames, packets and
+ * sample blocks) don't allocate after the first second. The benchmark
+ * fails if they do. With glibc it also counts every heap allocation of
+ * that part, which libav still makes for the packets and buffer
+ * references, and reports them per second of audio.
+ *
+ * The results are printed as JSON to the standard output, the log of the
+ * player is not printed.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <streambuf>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include "Music.h"
+#include "Playlist.h"
+#include "NullSink.h"
+#include "LibavSink.h"
+#include "SampleConvert.h"
+#include "version.h"
+#include "AllocationCounter.h"
+
+#ifndef BENCH_CORPUS_DIR
+#define BENCH_CORPUS_DIR "bench-corpus"
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Number of times every file is opened
+static constexpr int OPEN_REPEATS{10};
+// Number of seeks per file
+static constexpr int SEEK_COUNT{20};
+
+// Swallows the log of the player, so it doesn't mix with the results
+// and printing it isn't measured
+class NullStreamBuffer final : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+};
+
+struct Stats
+{
+    std::vector<double> values;
+
+    inline void add(double value) { values.push_back(value); }
+
+    void writeJson(std::ostream &output) const
+    {
+        if (values.empty())
+        {
+            output << "null";
+            return;
+        }
+        std::vector<double> sorted{values};
+        std::sort(sorted.begin(), sorted.end());
+        double sum{};
+        for (double value : sorted)
+            sum += value;
+        output << "{\"count\": " << sorted.size()
+            << ", \"mean\": " << sum / sorted.size()
+            << ", \"median\": " << sorted[sorted.size() / 2]
+            << ", \"min\": " << sorted.front()
+            << ", \"max\": " << sorted.back() << '}';
+    }
+};
+
+static double getElapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>{Clock::now() - start}.count();
+}
+
+static std::string toJsonString(const std::string &str)
+{
+    std::string output{"\""};
+    for (const char c : str)
+    {
+        if (c == '"' || c == '\\')
+            output += '\\';
+        if ((unsigned char)c >= 0x20)
+            output += c;
+    }
+    return output + '"';
+}
+
+/*
+ * Tick `track` until it writes samples after the current position.
+ *
+ * Returns false if the track ended or failed before that.
+ */
+static bool tickUntilOutput(Music &track)
+{
+    const int64_t startPosition{track.getOutputFramePosition()};
+    while (track.getOutputFramePosition() == startPosition)
+    {
+        if (track.hasEnded() || track.isInErrorState())
+            return false;
+        track.tick();
+    }
+    return true;
+}
+
+/*
+ * Measure one file and write its JSON object.
+ *
+ * Returns 0 if succeeded, nonzero otherwise.
+ */
+static int benchmarkFile(const std::string &path, const std::string &name,
+        AudioOutput &output, std::ostream &json)
+{
+    Music track;
+
+    Stats openStats;
+    for (int i{}; i < OPEN_REPEATS; ++i)
+    {
+        const auto start{Clock::now()};
+        if (track.open(path, &output))
+        {
+            std::cerr << "Failed to open: " << path << '\n';
+            return 1;
+        }
+        openStats.add(getElapsedMs(start));
+        if (i + 1 < OPEN_REPEATS)
+            track.closeAndReset();
+    }
+    const TrackMetadata metadata{track.getMetadata()};
+    const int sampleRate{track.getOutputSampleRate()};
+
+    // Decode the whole file
+    track.unPause();
+    const auto decodeStart{Clock::now()};
+    while (!track.hasEnded() && !track.isInErrorState())
+        track.tick();
+    const double decodeS{getElapsedMs(decodeStart) / 1000};
+    const double durationS{(double)track.getOutputFramePosition() / sampleRate};
+
+    // Seek to the same random positions in every run
+    track.closeAndReset();
+    track.open(path, &output);
+    track.unPause();
+    std::mt19937 random{12345};
+    std::uniform_real_distribution<double> distribution{0.0, 0.9};
+    Stats seekStats;
+    for (int i{}; i < SEEK_COUNT; ++i)
+    {
+        const double targetS{durationS * distribution(random)};
+        const auto start{Clock::now()};
+        track.seekToS(targetS);
+        if (tickUntilOutput(track))
+            seekStats.add(getElapsedMs(start));
+    }
+
+    json << "    {\"name\": " << toJsonString(name)
+        << ", \"codec\": " << toJsonString(metadata.codecName)
+        << ", \"sample_rate\": " << sampleRate
+        << ", \"channels\": " << track.getOutputChannelCount()
+        << ", \"duration_s\": " << durationS
+        << ",\n     \"open_ms\": ";
+    openStats.writeJson(json);
+    json << ",\n     \"decode_s\": " << decodeS
+        << ", \"decode_realtime_factor\": " << (decodeS > 0 ? durationS / decodeS : 0)
+        << ",\n     \"seek_ms\": ";
+    seekStats.writeJson(json);
+    json << '}';
+    return 0;
+}
+
+/*
+ * The allocations made after the first second of playing a file.
+ */
+struct SteadyStateAllocations
+{
+    // Frames, packets and blocks allocated by the buffer pools
+    size_t poolCount{};
+    // Every heap allocation of the process, libav included
+    size_t heapCount{};
+    // Length of the played part
+    double durationS{};
+};
+
+/*
+ * Play the file through `sink` and count the allocations made after
+ * the first second of playback.
+ *
+ * Returns 0 if succeeded, nonzero otherwise.
+ */
+static int countSteadyStateAllocations(const std::string &path,
+        AudioOutput &output, const LibavSink &sink, SteadyStateAllocations &allocations)
+{
+    Music track;
+    if (track.open(path, &output))
+        return 1;
+    track.unPause();
+
+    const int64_t warmupFrames{track.getOutputSampleRate()};
+    while (track.getOutputFramePosition() < warmupFrames
+            && !track.hasEnded() && !track.isInErrorState())
+        track.tick();
+    const int64_t framesBefore{track.getOutputFramePosition()};
+    const size_t poolCountBefore{track.getPoolAllocationCount() + sink.getPoolAllocationCount()};
+    const size_t heapCountBefore{AllocationCounter::getCount()};
+
+    while (!track.hasEnded() && !track.isInErrorState())
+        track.tick();
+
+    allocations.heapCount = AllocationCounter::getCount() - heapCountBefore;
+    allocations.poolCount = track.getPoolAllocationCount() + sink.getPoolAllocationCount()
+        - poolCountBefore;
+    allocations.durationS = (double)(track.getOutputFramePosition() - framesBefore)
+        / track.getOutputSampleRate();
+    return track.isInErrorState() ? 1 : 0;
+}
+
+/*
+ * Measure switching between the tracks of a playlist
+ * and write the JSON object.
+ */
+static void benchmarkTrackSwitch(const std::vector<std::string> &paths, std::ostream &json)
+{
+    Playlist playlist{std::make_unique<NullSink>(0.0)};
+    playlist.addNewTracks(paths);
+
+    // Open the track at the index without a preloaded track
+    Stats coldStats;
+    for (size_t i{}; i < paths.size(); ++i)
+    {
+        playlist.cancelPreload();
+        const auto start{Clock::now()};
+        playlist.openTrackAtIndex(i);
+        playlist.unpauseCurrentTrack();
+        if (tickUntilOutput(*playlist.getCurrentTrack()))
+            coldStats.add(getElapsedMs(start));
+    }
+
+    // Play to the end of a track and let the playlist continue
+    // with the preloaded next one
+    Stats gaplessStats;
+    for (size_t i{}; i + 1 < paths.size(); ++i)
+    {
+        playlist.openTrackAtIndex(i);
+        playlist.unpauseCurrentTrack();
+        Music *track{playlist.getCurrentTrack()};
+        track->seekToS(std::max<int64_t>(0, track->getDurationS() - 1));
+        while (!track->hasEnded() && !track->isInErrorState())
+            playlist.tickCurrentTrack();
+        // Waits for the preload, it would be done long ago while playing
+        playlist.isGaplessSwitchPossible();
+
+        const auto start{Clock::now()};
+        while ((size_t)playlist.getCurrentTrackIndex() == i)
+            playlist.tickCurrentTrack();
+        if (!playlist.hasEnded() && tickUntilOutput(*playlist.getCurrentTrack()))
+            gaplessStats.add(getElapsedMs(start));
+    }
+
+    json << "  \"track_switch\": {\"cold_ms\": ";
+    coldStats.writeJson(json);
+    json << ", \"preloaded_ms\": ";
+    gaplessStats.writeJson(json);
+    json << '}';
+}
+
+int main(int argc, char **argv)
+{
+    const std::string corpusDir{argc > 1 ? argv[1] : BENCH_CORPUS_DIR};
+
+    std::vector<std::string> names;
+    {
+        std::ifstream list{corpusDir + "/corpus.txt"};
+        if (!list)
+        {
+            std::cerr << "No corpus in " << corpusDir << ", build the bench-corpus target\n";
+            return 1;
+        }
+        for (std::string name; std::getline(list, name);)
+        {
+            if (!name.empty())
+                names.push_back(name);
+        }
+    }
+
+    // The results go to the original standard output
+    std::ostream json{std::cout.rdbuf()};
+    json << std::fixed << std::setprecision(3);
+    NullStreamBuffer nullBuffer;
+    std::cout.rdbuf(&nullBuffer);
+
+    json << "{\n  \"version\": " << toJsonString(VERSION_STR)
+        << ",\n  \"conversion_instruction_set\": " << toJsonString(SampleConvert::getInstructionSetName())
+        << ",\n  \"files\": [\n";
+
+    AudioOutput output{std::make_unique<NullSink>(0.0)};
+    std::vector<std::string> paths;
+    int result{};
+    for (const std::string &name : names)
+    {
+        const std::string path{corpusDir + "/" + name};
+        std::ostringstream fileJson;
+        fileJson.copyfmt(json);
+        if (benchmarkFile(path, name, output, fileJson))
+        {
+            result = 1;
+            continue;
+        }
+        if (!paths.empty())
+            json << ",\n";
+        json << fileJson.str();
+        paths.push_back(path);
+    }
+    json << "\n  ],\n";
+
+    benchmarkTrackSwitch(paths, json);
+
+    // The steady state of the playback loop must not grow the pools,
+    // the heap allocations left are made by libav and only measured
+    auto libavSinkPtr{std::make_unique<LibavSink>("null")};
+    const LibavSink &libavSink{*libavSinkPtr};
+    AudioOutput libavOutput{std::move(libavSinkPtr)};
+    size_t steadyStatePoolAllocations{};
+    size_t steadyStateHeapAllocations{};
+    double steadyStateDurationS{};
+    for (const std::string &path : paths)
+    {
+        SteadyStateAllocations allocations;
+        if (countSteadyStateAllocations(path, libavOutput, libavSink, allocations))
+        {
+            std::cerr << "Failed to play to the null muxer: " << path << '\n';
+            result = 1;
+            continue;
+        }
+        if (allocations.poolCount > 0)
+        {
+            std::cerr << "The buffer pools allocated " << allocations.poolCount
+                << " times after the first second of " << path << '\n';
+            result = 1;
+        }
+        steadyStatePoolAllocations += allocations.poolCount;
+        steadyStateHeapAllocations += allocations.heapCount;
+        steadyStateDurationS += allocations.durationS;
+    }
+    json << ",\n  \"steady_state_pool_allocations\": " << steadyStatePoolAllocations;
+    if (AllocationCounter::isAvailable())
+    {
+        json << ",\n  \"steady_state_heap_allocations\": " << steadyStateHeapAllocations
+            << ", \"steady_state_heap_allocations_per_s\": "
+            << (steadyStateDurationS > 0 ? steadyStateHeapAllocations / steadyStateDurationS : 0);
+    }
+    json << "\n}\n";
+
+    std::cout.rdbuf(json.rdbuf());
+    return result;
+}
@@ -0,0 +1,92 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Measures the throughput of the metadata scanner.
+ *
+ * Scans the files given as arguments with 1, 2, 4 and one thread per CPU
+ * core and prints the number of files probed per second. The library index
+ * is not used, so every file is opened in every run.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include "MetadataScanner.h"
+
+static double scan(const std::vector<std::string> &paths, unsigned threadCount, size_t *audioFileCount)
+{
+    size_t audioFiles{};
+    MetadataScanner scanner{paths, nullptr,
+        [&audioFiles](std::vector<MetadataScanner::Result> &&batch){
+            audioFiles += std::count_if(batch.begin(), batch.end(),
+                    [](const MetadataScanner::Result &result){ return result.isAudioFile; });
+        }};
+
+    const auto startTime{std::chrono::steady_clock::now()};
+    scanner.start(threadCount);
+    scanner.wait();
+    const std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - startTime};
+
+    if (audioFileCount)
+        *audioFileCount = audioFiles;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc <= 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " FILE...\n";
+        return 1;
+    }
+
+    const std::vector<std::string> paths(argv+1, argv+argc);
+
+    // Warm up the page cache, so the first run is not slower than the others
+    size_t audioFileCount{};
+    scan(paths, std::max(1u, std::thread::hardware_concurrency()), &audioFileCount);
+    std::cout << paths.size() << " files, " << audioFileCount << " audio files\n";
+
+    std::vector<unsigned> threadCounts{1, 2, 4};
+    const unsigned coreCount{std::thread::hardware_concurrency()};
+    if (coreCount > 4)
+        threadCounts.push_back(coreCount);
+
+    for (unsigned threadCount : threadCounts)
+    {
+        const double seconds{scan(paths, threadCount, nullptr)};
+        std::cout << threadCount << " thread(s): " << seconds << " s, "
+            << paths.size() / seconds << " files/s\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Measures the accuracy and the latency of seeking.
+ *
+ * For every file given as argument, seeks to random positions with the
+ * timestamp seek of libav and with a seek index, and prints how far from
+ * the target the first read packet is and how long the seek took.
+ * The time of building the index is printed too.
+ * The decode-skip that `Music` does after the seek is not included, it
+ * removes the remaining distance.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include "SeekIndex.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct SeekStats
+{
+    double totalErrorS{};
+    double maxErrorS{};
+    double totalLatencyMs{};
+    size_t seekCount{};
+    size_t failCount{};
+
+    void add(double errorS, double latencyMs)
+    {
+        totalErrorS += errorS;
+        maxErrorS = std::max(maxErrorS, errorS);
+        totalLatencyMs += latencyMs;
+        ++seekCount;
+    }
+
+    void print(const char *name) const
+    {
+        std::cout << "  " << std::setw(10) << std::left << name << std::right;
+        if (seekCount == 0)
+        {
+            std::cout << "no successful seeks\n";
+            return;
+        }
+        std::cout << std::fixed << std::setprecision(3)
+            << "mean error " << totalErrorS / seekCount << " s, "
+            << "max error " << maxErrorS << " s, "
+            << "mean latency " << totalLatencyMs / seekCount << " ms";
+        if (failCount)
+            std::cout << ", " << failCount << " failed";
+        std::cout << '\n';
+    }
+};
+
+/*
+ * Read packets until one of `streamI` comes and return its timestamp.
+ */
+static int64_t readNextPts(AVFormatContext *formatContext, AVPacket *packet, int streamI)
+{
+    while (av_read_frame(formatContext, packet) >= 0)
+    {
+        const bool isOurs{packet->stream_index == streamI};
+        const int64_t pts{packet->pts};
+        av_packet_unref(packet);
+        if (isOurs)
+            return pts;
+    }
+    return AV_NOPTS_VALUE;
+}
+
+static void benchmarkFile(const std::string &path, const std::vector<double> &targetFractions)
+{
+    AVFormatContext *formatContext{};
+    if (avformat_open_input(&formatContext, path.c_str(), nullptr, nullptr)
+            || avformat_find_stream_info(formatContext, nullptr) < 0)
+    {
+        std::cerr << "Failed to open: " << path << '\n';
+        avformat_close_input(&formatContext);
+        return;
+    }
+
+    const int streamI{av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0)};
+    if (streamI < 0 || formatContext->duration <= 0)
+    {
+        std::cerr << "No audio stream or unknown duration: " << path << '\n';
+        avformat_close_input(&formatContext);
+        return;
+    }
+    const AVRational timeBase{formatContext->streams[streamI]->time_base};
+    const double durationS{(double)formatContext->duration / AV_TIME_BASE};
+
+    std::cout << path << " (" << formatContext->iformat->name << ", "
+        << std::fixed << std::setprecision(1) << durationS << " s)\n";
+
+    const auto scanStart{Clock::now()};
+    SeekIndex index;
+    const bool isIndexOk{SeekIndex::scan(path, streamI, index) == 0};
+    const std::chrono::duration<double, std::milli> scanTime{Clock::now() - scanStart};
+    std::cout << "  index: " << index.getEntryCount() << " entries, built in "
+        << std::setprecision(1) << scanTime.count() << " ms\n";
+
+    AVPacket *packet{av_packet_alloc()};
+    SeekStats timestampStats;
+    SeekStats indexStats;
+    for (double fraction : targetFractions)
+    {
+        const double targetS{durationS * fraction};
+        const int64_t targetPts{(int64_t)(targetS / av_q2d(timeBase))};
+
+        // libav timestamp seek
+        {
+            const auto start{Clock::now()};
+            const int result{av_seek_frame(formatContext, streamI, targetPts, AVSEEK_FLAG_BACKWARD)};
+            const int64_t landingPts{result >= 0
+                ? readNextPts(formatContext, packet, streamI) : AV_NOPTS_VALUE};
+            const std::chrono::duration<double, std::milli> latency{Clock::now() - start};
+            if (landingPts == AV_NOPTS_VALUE)
+                ++timestampStats.failCount;
+            else
+                timestampStats.add(std::abs(landingPts * av_q2d(timeBase) - targetS), latency.count());
+        }
+
+        // Seek by the byte position from the index
+        if (isIndexOk)
+        {
+            const auto start{Clock::now()};
+            const SeekIndex::Entry *entry{index.findEntryBefore(targetPts)};
+            const int result{entry
+                ? av_seek_frame(formatContext, streamI, entry->pos, AVSEEK_FLAG_BYTE) : -1};
+            if (result >= 0)
+                readNextPts(formatContext, packet, streamI);
+            const std::chrono::duration<double, std::milli> latency{Clock::now() - start};
+            // The packet at the position has the timestamp of the entry,
+            // even if the demuxer can't tell it after a byte seek
+            if (result < 0)
+                ++indexStats.failCount;
+            else
+                indexStats.add(std::abs(entry->pts * av_q2d(timeBase) - targetS), latency.count());
+        }
+    }
+    av_packet_free(&packet);
+
+    timestampStats.print("timestamp");
+    if (isIndexOk)
+        indexStats.print("index");
+
+    avformat_close_input(&formatContext);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc <= 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " FILE...\n";
+        return 1;
+    }
+
+    // The same targets for every file and run, so the results are comparable
+    std::mt19937 random{12345};
+    std::uniform_real_distribution<double> distribution{0.0, 0.99};
+    std::vector<double> targetFractions(100);
+    for (double &fraction : targetFractions)
+        fraction = distribution(random);
+
+    for (int i{1}; i < argc; ++i)
+        benchmarkFile(argv[i], targetFractions);
+
+    return 0;
+}
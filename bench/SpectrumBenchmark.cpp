@@ -0,0 +1,109 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2021, timre13
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Measures the cost of the spectrum analyzer.
+ *
+ * Prints the time of an FFT of `SpectrumAnalyzer::FFT_SIZE` with and
+ * without the vector instructions, as a share of a frame at
+ * `SpectrumAnalyzer::FRAME_RATE`, and the time the output thread spends
+ * copying a chunk to the `PcmTap`.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <random>
+#include "Fft.h"
+#include "PcmTap.h"
+#include "SpectrumAnalyzer.h"
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr int FFT_ITERATIONS{20000};
+static constexpr int TAP_ITERATIONS{200000};
+// About the size of a chunk written by the output thread
+static constexpr size_t TAP_CHUNK_FRAMES{1024};
+
+/*
+ * Run `function` `iterations` times and return the nanoseconds per run.
+ */
+template <typename Function>
+static double measure(int iterations, Function function)
+{
+    const auto start{Clock::now()};
+    for (int i{}; i < iterations; ++i)
+        function();
+    const std::chrono::duration<double, std::nano> time{Clock::now() - start};
+    return time.count() / iterations;
+}
+
+int main()
+{
+    const size_t size{SpectrumAnalyzer::FFT_SIZE};
+    const Fft fft{size};
+
+    std::mt19937 random{12345};
+    std::uniform_real_distribution<float> distribution{-1.0f, 1.0f};
+    std::vector<float> input(size);
+    for (float &value : input)
+        value = distribution(random);
+    std::vector<float> re(size);
+    std::vector<float> im(size);
+
+    const double scalarNs{measure(FFT_ITERATIONS, [&](){
+        re = input;
+        std::fill(im.begin(), im.end(), 0.0f);
+        fft.transformScalar(re.data(), im.data());
+    })};
+    const double simdNs{measure(FFT_ITERATIONS, [&](){
+        re = input;
+        std::fill(im.begin(), im.end(), 0.0f);
+        fft.transform(re.data(), im.data());
+    })};
+
+    const double frameNs{1e9 / SpectrumAnalyzer::FRAME_RATE};
+    std::cout << std::fixed << std::setprecision(2)
+        << "FFT of " << size << ": scalar " << scalarNs / 1000 << " us, vector "
+        << simdNs / 1000 << " us (" << scalarNs / simdNs << "x), "
+        << std::setprecision(3) << simdNs / frameNs * 100 << "% of a frame at "
+        << SpectrumAnalyzer::FRAME_RATE << " fps\n";
+
+    PcmTap tap;
+    std::vector<int16_t> chunk(TAP_CHUNK_FRAMES * 2);
+    for (int16_t &sample : chunk)
+        sample = (int16_t)(distribution(random) * 32767);
+    const double tapNs{measure(TAP_ITERATIONS, [&](){
+        tap.write(chunk.data(), TAP_CHUNK_FRAMES, 2, 48000);
+    })};
+    std::cout << std::setprecision(1) << "Tap write of " << TAP_CHUNK_FRAMES
+        << " stereo frames: " << tapNs << " ns\n";
+
+    return 0;
+}
@@ -28,16 +28,31 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
 extern "C"
 {
 #include <libavdevice/avdevice.h>
 }
-#include <FL/Fl.H>
 #include "Playlist.h"
-#include "MainWindow.h"
+#include "AudioSink.h"
+#include "StageTiming.h"
+#include "PlaybackEngine.h"
+#include "LibraryIndex.h"
+#include "MetadataScanner.h"
+#include "LoudnessAnalyzer.h"
+#include "Prefetcher.h"
+#include "ControlServer.h"
 #include "version.h"
+#ifdef LIGHTMUSIC_GUI
+#include <FL/Fl.H>
+#include "MainWindow.h"
+#endif
 
-#define AUDIO_DEV_NAME "alsa" // TODO: Windows compatibility
+// Used if there is no `--output` option, see `AudioSink::create()`
+#define DEFAULT_OUTPUT "alsa" // TODO: Windows compatibility
 
 int main(int argc, char **argv)
 {
@@ -46,30 +61,243 @@ int main(int argc, char **argv)
     // Init audio I/O
     avdevice_register_all();
 
-    auto playlist{std::make_unique<Playlist>(AUDIO_DEV_NAME)};
+    // Metadata of the known tracks, so they can be shown without opening them
+    auto libraryIndex{std::make_unique<LibraryIndex>()};
+    libraryIndex->load(LibraryIndex::getDefaultPath());
+
+    // Options come before the files
+    auto powerProfile{PlaybackEngine::POWERPROFILE_NORMAL};
+    std::string outputDescription{DEFAULT_OUTPUT};
+#ifdef LIGHTMUSIC_GUI
+    bool isHeadless{};
+#else
+    bool isHeadless{true};
+#endif
+    std::string socketPath{ControlServer::getDefaultSocketPath()};
+    double crossfadeS{};
+    auto crossfadeCurve{Crossfader::CURVE_EQUAL_POWER};
+#ifdef LIGHTMUSIC_GUI
+    bool isSpectrumShown{};
+#endif
+    auto replayGainMode{Playlist::REPLAYGAIN_OFF};
+    double replayGainPreampDb{};
+    size_t prefetchTrackCount{Prefetcher::DEFAULT_TRACK_COUNT};
+    size_t prefetchBytesPerTrack{Prefetcher::DEFAULT_BYTES_PER_TRACK};
+    size_t prefetchBudgetBytes{Prefetcher::DEFAULT_BUDGET_BYTES};
+    int firstFileArgI{1};
+    for (; firstFileArgI < argc; ++firstFileArgI)
+    {
+        const std::string arg{argv[firstFileArgI]};
+        if (arg == "--low-power")
+            powerProfile = PlaybackEngine::POWERPROFILE_LOW_POWER;
+        else if (arg.rfind("--output=", 0) == 0)
+            outputDescription = arg.substr(9);
+        else if (arg.rfind("--crossfade=", 0) == 0)
+        {
+            // SECONDS or SECONDS:CURVE
+            const std::string value{arg.substr(12)};
+            const size_t colonI{value.find(':')};
+            const std::string secondsStr{value.substr(0, colonI)};
+            char *end{};
+            crossfadeS = std::strtod(secondsStr.c_str(), &end);
+            if (*end || end == secondsStr.c_str() || crossfadeS < 0 || crossfadeS > Crossfader::MAX_DURATION_S
+                    || (colonI != std::string::npos
+                        && Crossfader::parseCurve(value.substr(colonI + 1), crossfadeCurve)))
+            {
+                std::cerr << "Invalid crossfade: " << value << '\n';
+                return 1;
+            }
+        }
+        else if (arg.rfind("--replaygain=", 0) == 0)
+        {
+            // MODE or MODE:PREAMP_DB
+            const std::string value{arg.substr(13)};
+            const size_t colonI{value.find(':')};
+            const std::string preampStr{
+                colonI == std::string::npos ? "" : value.substr(colonI + 1)};
+            char *end{};
+            if (colonI != std::string::npos)
+                replayGainPreampDb = std::strtod(preampStr.c_str(), &end);
+            if (Playlist::parseReplayGainMode(value.substr(0, colonI), replayGainMode)
+                    || (end && (*end || end == preampStr.c_str())))
+            {
+                std::cerr << "Invalid ReplayGain setting: " << value << '\n';
+                return 1;
+            }
+        }
+        else if (arg.rfind("--prefetch=", 0) == 0)
+        {
+            // TRACKS, TRACKS:MB_PER_TRACK or TRACKS:MB_PER_TRACK:BUDGET_MB
+            const std::string value{arg.substr(11)};
+            unsigned long trackCount{};
+            unsigned long mbPerTrack{prefetchBytesPerTrack >> 20};
+            unsigned long budgetMb{prefetchBudgetBytes >> 20};
+            char end{};
+            // `%lu` would take negative numbers
+            if (value.find('-') != std::string::npos
+                    || (std::sscanf(value.c_str(), "%lu%c", &trackCount, &end) != 1
+                    && std::sscanf(value.c_str(), "%lu:%lu%c", &trackCount, &mbPerTrack, &end) != 2
+                    && std::sscanf(value.c_str(), "%lu:%lu:%lu%c", &trackCount, &mbPerTrack, &budgetMb, &end) != 3))
+            {
+                std::cerr << "Invalid prefetch setting: " << value << '\n';
+                return 1;
+            }
+            prefetchTrackCount = trackCount;
+            prefetchBytesPerTrack = (size_t)mbPerTrack << 20;
+            prefetchBudgetBytes = (size_t)budgetMb << 20;
+        }
+        else if (arg == "--headless")
+            isHeadless = true;
+        else if (arg.rfind("--headless=", 0) == 0)
+        {
+            isHeadless = true;
+            socketPath = arg.substr(11);
+        }
+        else if (arg == "--spectrum")
+#ifdef LIGHTMUSIC_GUI
+            isSpectrumShown = true;
+#else
+            std::cerr << "Built without the GUI, ignoring --spectrum" << '\n';
+#endif
+        else if (arg == "--stage-timing")
+#ifdef LIGHTMUSIC_STAGE_TIMING
+            StageTiming::setEnabled(true);
+#else
+            std::cerr << "Built without stage timing, ignoring --stage-timing" << '\n';
+#endif
+        else
+            break;
+    }
+
+#ifdef LIGHTMUSIC_STAGE_TIMING
+    // Before any other thread is started
+    if (StageTiming::isEnabled())
+        StageTiming::startSignalDumper();
+#endif
+
+    auto sink{AudioSink::create(outputDescription)};
+    if (!sink)
+        return 1;
+
+    auto playlist{std::make_unique<Playlist>(std::move(sink))};
+    playlist->setLibraryIndex(libraryIndex.get());
+    playlist->setCrossfade(crossfadeCurve, crossfadeS);
+    playlist->setReplayGain(replayGainMode, replayGainPreampDb);
+
+    // Measure the loudness of the added tracks in the background
+    std::unique_ptr<LoudnessAnalyzer> loudnessAnalyzer;
+    if (replayGainMode != Playlist::REPLAYGAIN_OFF)
+    {
+        loudnessAnalyzer = std::make_unique<LoudnessAnalyzer>(libraryIndex.get());
+        loudnessAnalyzer->start();
+        playlist->setLoudnessAnalyzer(loudnessAnalyzer.get());
+    }
+
+    // Read the upcoming tracks ahead, so slow disks don't delay the track changes
+    std::unique_ptr<Prefetcher> prefetcher;
+    if (prefetchTrackCount > 0)
+    {
+        prefetcher = std::make_unique<Prefetcher>(
+                prefetchTrackCount, prefetchBytesPerTrack, prefetchBudgetBytes);
+        prefetcher->start();
+        playlist->setPrefetcher(prefetcher.get());
+    }
 
-    if (argc <= 1) // When running as a test
+    std::vector<std::string> filePaths;
+    if (firstFileArgI >= argc && !isHeadless) // When running as a test
     {
         std::cout << "Using test music files" << '\n';
-        playlist->addNewTrack("nonpublic-test-music/csp_short.wav");
-        playlist->addNewTrack("nonpublic-test-music/sd.opus");
-        playlist->addNewTrack("nonpublic-test-music/csp.wav");
-        playlist->addNewTrack("nonpublic-test-music/csp.mp3");
-        playlist->addNewTrack("nonpublic-test-music/csp.ogg");
-        playlist->addNewTrack("nonpublic-test-music/des.mp3");
-        playlist->addNewTrack("nonpublic-test-music/b.mkv");
+        filePaths = {
+            "nonpublic-test-music/csp_short.wav",
+            "nonpublic-test-music/sd.opus",
+            "nonpublic-test-music/csp.wav",
+            "nonpublic-test-music/csp.mp3",
+            "nonpublic-test-music/csp.ogg",
+            "nonpublic-test-music/des.mp3",
+            "nonpublic-test-music/b.mkv",
+        };
     }
     else
     {
-        for (int i{1}; i < argc; ++i)
-            playlist->addNewTrack(argv[i]);
+        filePaths.assign(argv+firstFileArgI, argv+argc);
     }
 
-    playlist->startPlaying();
+    auto engine{std::make_unique<PlaybackEngine>(playlist.get(), powerProfile)};
 
-    auto mainWindow{
-        std::make_unique<MainWindow>(800, 400, "LightMusic", playlist.get())};
-    mainWindow->show();
+    // Without a GUI the player is controlled through a socket
+    std::unique_ptr<ControlServer> controlServer;
+    if (isHeadless)
+    {
+        controlServer = std::make_unique<ControlServer>(engine.get(), socketPath);
+        if (controlServer->start())
+            return 1;
+    }
+#ifdef LIGHTMUSIC_GUI
+    else
+    {
+        // Enable the thread support of FLTK, the engine wakes up
+        // the GUI with `Fl::awake()`
+        Fl::lock();
+    }
+#endif
+
+    engine->start();
 
-    return Fl::run();
+    // Probe the files in the background and add the playable ones
+    // to the playlist as they are found
+    std::unique_ptr<MetadataScanner> scanner;
+    scanner = std::make_unique<MetadataScanner>(
+            std::move(filePaths), libraryIndex.get(),
+            [&engine, &scanner](std::vector<MetadataScanner::Result> &&batch){
+                std::cout << "Scanned " << scanner->getScannedCount()
+                    << '/' << scanner->getTotalCount() << " files\n";
+                engine->post([batch{std::move(batch)}](Playlist &playlist){
+                    const bool wasEmpty{playlist.getNumOfTracks() == 0};
+                    std::vector<std::string> paths;
+                    for (const auto &result : batch)
+                    {
+                        if (result.isAudioFile)
+                            paths.push_back(result.path);
+                        else
+                            std::cerr << "Skipping non-audio file: " << result.path << '\n';
+                    }
+                    playlist.addNewTracks(paths);
+                    if (wasEmpty)
+                        playlist.startPlaying();
+                });
+            });
+    scanner->start();
+
+    int result{};
+    if (isHeadless)
+    {
+        controlServer->run();
+    }
+#ifdef LIGHTMUSIC_GUI
+    else
+    {
+        auto mainWindow{
+            std::make_unique<MainWindow>(800, 400, "LightMusic", engine.get(), isSpectrumShown)};
+        mainWindow->show();
+
+        result = Fl::run();
+    }
+#endif
+    scanner->cancel();
+    engine->stop();
+    if (loudnessAnalyzer)
+        loudnessAnalyzer->stop();
+    if (prefetcher)
+    {
+        prefetcher->stop();
+        const Prefetcher::Stats stats{prefetcher->getStats()};
+        std::cout << "Prefetch: " << stats.hitCount << " hits, " << stats.missCount << " misses, "
+            << stats.cancelledCount << " cancelled, " << (stats.prefetchedBytes >> 20) << " MiB read ahead\n";
+    }
+    libraryIndex->save();
+#ifdef LIGHTMUSIC_STAGE_TIMING
+    if (StageTiming::isEnabled())
+        StageTiming::dump(std::cerr);
+#endif
+    return result;
 }
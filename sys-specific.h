@@ -35,6 +35,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // TODO: Test on Win32
 
 #include <string>
+#include <cstdlib>
+#include <filesystem>
 
 #if defined(__linux__) || defined(__linux) || defined(__unix__) || defined(__unix)
 #include <unistd.h>
@@ -67,4 +69,30 @@ inline void openUrlInWebBrowser(const std::string &url)
 #endif
 }
 
+/*
+ * Return the directory where LightMusic can keep its caches.
+ * The directory is created if it doesn't exist.
+ * Returns an empty string if there is no usable directory.
+ */
+inline std::string getCacheDir()
+{
+    std::filesystem::path dir;
+#if defined(__linux__) || defined(__linux) || defined(__unix__) || defined(__unix)
+    if (const char *xdgCacheHome{std::getenv("XDG_CACHE_HOME")}; xdgCacheHome && *xdgCacheHome)
+        dir = xdgCacheHome;
+    else if (const char *home{std::getenv("HOME")}; home && *home)
+        dir = std::filesystem::path{home} / ".cache";
+#elif defined(__WIN32)
+    if (const char *localAppData{std::getenv("LOCALAPPDATA")}; localAppData && *localAppData)
+        dir = localAppData;
+#endif
+    if (dir.empty())
+        return "";
+
+    dir /= "lightmusic";
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    return error ? "" : dir.string();
+}
+
 } // namespace SysSpecific